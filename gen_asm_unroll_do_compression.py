@@ -91,7 +91,56 @@ def do_unroll_do_compression256_c():
 			print("	NEXT_W();")
 		print(code_block % (j,K256[j]), end="")
 
+# Register and lane of W32[wi] in tsha256a.S.  See the w array layout there.
+def w_slot256_sse4_1(wi):
+	return "xmm" + str(wi // 4) + "," + str(wi % 4)
+
+def w_slot256_sse2(wi):
+	if wi <= 59:
+		return "xmm" + str(wi // 4) + "," + str(wi % 4)
+	return "mm" + str(4 + (wi - 60) // 2) + "," + str(wi % 2)
+
+# Emits the expansion and compression with every W32 access resolved to an
+# immediate register and lane, so get_w/set_w never dispatch through a jump
+# table.
+def do_unroll_straight_line256_asm():
+	isas = [ ("#ifdef HAVE_SSE4_1", w_slot256_sse4_1),
+		("#elif defined(HAVE_SSE2)", w_slot256_sse2) ]
+	print("/* Straight-line expansion generated by gen_asm_unroll_do_compression.py */")
+	for guard, slot in isas:
+		print(guard)
+		for j in range(16,64):
+			print("	expand_message_blocks %d,%s,%s,%s,%s,%s" % (j,
+				slot(j-15), slot(j-2), slot(j-16), slot(j-7),
+				slot(j)))
+	print("#endif")
+	print("")
+	print("/* Straight-line compression generated by gen_asm_unroll_do_compression.py */")
+	for guard, slot in isas:
+		print(guard)
+		for j in range(0,64):
+			print("	do_compression %d,0x%08x,%s" % (j,K256[j],slot(j)))
+	print("#endif")
+
+# Same as do_unroll_straight_line256_asm for the rolling 16 word window.
+# W32[j] is expanded over W32[j-16] right before round j, so every access is
+# in xmm0-xmm3 and one sequence serves both SSE2 and SSE4.1.
+def do_unroll_rolling256_asm():
+	print("/* Rolling straight-line compression generated by gen_asm_unroll_do_compression.py */")
+	for j in range(0,64):
+		if j >= 16:
+			print("	expand_message_blocks %d,%s,%s,%s,%s,%s" % (j,
+				w_slot256_sse4_1((j-15) % 16),
+				w_slot256_sse4_1((j-2) % 16),
+				w_slot256_sse4_1((j-16) % 16),
+				w_slot256_sse4_1((j-7) % 16),
+				w_slot256_sse4_1(j % 16)))
+		print("	do_compression %d,0x%08x,%s" % (j,K256[j],
+			w_slot256_sse4_1(j % 16)))
+
 def main():
+#	do_unroll_rolling256_asm()
+#	do_unroll_straight_line256_asm()
 #	do_unroll_do_compression256_asm()
 #	do_unroll_do_compression256_c()
 	do_unroll_do_comp_exp_512_c()
@@ -22,10 +22,14 @@
 #
 
 # Case generator
+#
+# Set W_SIZE_WORDS=16 for the get_w/set_w cases of the rolling window.
+
+W_SIZE_WORDS=${W_SIZE_WORDS:-64}
 
 get_w_sse4_1() {
 	echo "---"
-	for wi in $(seq 0 63) ; do
+	for wi in $(seq 0 $((${W_SIZE_WORDS} - 1))) ; do
 		RI=$((${wi} / 4))
 		CI=$((${wi} % 4))
 		echo -e "case ${wi}: GET_W(w,${CI},xmm${RI}); break;"
@@ -37,7 +41,7 @@ get_w_sse4_1
 get_w_sse2() {
 	echo "---"
 	MMR=3
-	for wi in $(seq 0 63) ; do
+	for wi in $(seq 0 $((${W_SIZE_WORDS} - 1))) ; do
 		if (( ${wi} <= 59 )) ; then
 			RI=$((${wi} / 4))
 			CI=$(($((${wi} % 4)) * 4))
@@ -59,7 +63,7 @@ get_w_sse2
 
 set_w_sse4_1() {
 	echo "---"
-	for wi in $(seq 0 63) ; do
+	for wi in $(seq 0 $((${W_SIZE_WORDS} - 1))) ; do
 		RI=$((${wi} / 4))
 		CI=$((${wi} % 4))
 		echo -e "case ${wi}: SET_W(w,${CI},xmm${RI}); break;"
@@ -72,7 +76,7 @@ set_w_sse2() {
 	echo "---"
 	echo "---"
 	MMR=3
-	for wi in $(seq 0 63) ; do
+	for wi in $(seq 0 $((${W_SIZE_WORDS} - 1))) ; do
 		if (( ${wi} <= 59 )) ; then
 			RI=$((${wi} / 4))
 			CI=$(($((${wi} % 4)) * 4))
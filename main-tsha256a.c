@@ -59,6 +59,12 @@
 
 #include "tsha256.h"
 #include "tsha256-asm.h"
+#include "tsha-stats.h"
+#include "tsha-probes.h"
+#include "tsha-trace.h"
+#ifdef USE_DISPATCH
+#  include "tsha256-dispatch.h"
+#endif // USE_DISPATCH
 
 #if defined(DEBUG)
 #  define debug_printf(format, ...)						\
@@ -69,13 +75,182 @@
 #    define debug_printf(format, ...)
 #endif // DEBUG
 
+/* A plain memset of locals that are dead afterwards is dropped at -O2 and
+   up.  Calling it through a volatile pointer keeps the wipe. */
+static void *(*const volatile secure_memset)(void *, int, size_t) = memset;
+
+/* Bulk reader.  Whole message blocks go through tsha256a_write_blocks and
+   only a partial head or tail block goes through tsha256a_getch.
+   returns:
+	<0 - error
+	n - bytes read							      */
+s64 tsha256a_write(struct tsha256 *state, const u8 *buf, u64 len)
+{
+	u64 i = 0;
+	s64 bytes_read;
+
+	TSHA_PROBE(tsha256a, write_start, state);
+	while (i < len)
+	{
+		if (state->i_message == 0 && len - i >= MESSAGE_SIZE_BYTES)
+		{
+			TSHA_STATS_TSC_BEGIN();
+			bytes_read = tsha256a_write_blocks(state, buf + i,
+				(len - i) / MESSAGE_SIZE_BYTES);
+			TSHA_STATS_TSC_END(TSHA_STATS_SHA256A);
+			/* The assembly counts the rest but not the bulk
+			   bytes. */
+			if (bytes_read > 0)
+				TSHA_STATS_ADD(TSHA_STATS_SHA256A, bytes,
+					bytes_read);
+		}
+		else
+			bytes_read = tsha256a_getch(state, buf[i]);
+		if (bytes_read < 0)
+		{
+			TSHA_PROBE(tsha256a, write_end, state);
+			return bytes_read;
+		}
+
+		i += bytes_read;
+
+		if (state->event == TSHA256_FSM_INPUT_UPDATE)
+		{
+			TSHA_STATS_TSC_BEGIN();
+			tsha256a_update(state, 0);
+			TSHA_STATS_TSC_END(TSHA_STATS_SHA256A);
+		}
+		else if (bytes_read == 0)
+			break;
+	}
+
+	TSHA_PROBE(tsha256a, write_end, state);
+	return i;
+}
+
+/* One-shot hash of msg into out.  Whole blocks go straight through
+   tsha256a_write_blocks.  The tail, the 0x80 byte, the zero padding and the
+   bit length are laid out in one or two final blocks that are compressed
+   the same way, so the padding FSM never runs.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256a_digest(const u8 *msg, u64 len, u32 *out)
+{
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u8 tail[2 * MESSAGE_SIZE_BYTES];
+	u64 body = len & ~(u64)(MESSAGE_SIZE_BYTES - 1);
+	u64 rem = len - body;
+	u64 nblocks = rem < MESSAGE_SIZE_BYTES - L_SIZE_BYTES ? 1 : 2;
+	u64 len64 = __builtin_bswap64(len << 3);
+	s64 ret;
+
+	if ((msg == NULL && len > 0) || out == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256A, errors, 1);
+		return -EINVAL;
+	}
+
+	memset(tail, 0, sizeof(tail));
+	if (rem > 0)
+		memcpy(tail, msg + body, rem);
+	tail[rem] = 0x80;
+	memcpy(tail + nblocks * MESSAGE_SIZE_BYTES - L_SIZE_BYTES, &len64,
+		L_SIZE_BYTES);
+
+	TSHA_STATS_TSC_BEGIN();
+	tsha256a_reset(&state);
+	ret = tsha256a_write_blocks(&state, msg, body / MESSAGE_SIZE_BYTES);
+	if (ret >= 0)
+		ret = tsha256a_write_blocks(&state, tail, nblocks);
+	if (ret >= 0)
+		memcpy(out, tsha256a_get_hashcode(&state), DIGEST_SIZE_BYTES);
+	tsha256a_close(&state);
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA256A);
+	/* The blocks and errors are counted by the assembly, but the padding
+	   is laid out here and the tail goes in as blocks. */
+	if (ret >= 0)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256A, bytes, len);
+		TSHA_STATS_ADD(TSHA_STATS_SHA256A, finals, 1);
+	}
+
+	/* Securely wipe sensitive data. */
+	secure_memset(tail, 0, sizeof(tail));
+
+	return ret < 0 ? ret : 0;
+}
+
+/* Lets another program such as tsha-bench link this file. */
+#ifndef TSHA256A_NO_MAIN
+/* From main-tsha256r.c built with -DTSHA256R_NO_MAIN */
+s32 tsha256r_digest(const u8 *msg, u64 len, u32 *out);
+
+#ifdef USE_STATS
+/* "abc" counts a block, a final and no error, through the digest and
+   through getch and update.  A NULL message and an update past the end
+   count one error each. */
+static s32 test_stats(void)
+{
+	struct tsha_stats before[TSHA_STATS_NENGINES];
+	struct tsha_stats after[TSHA_STATS_NENGINES];
+	struct tsha_stats *old = &before[TSHA_STATS_SHA256A];
+	struct tsha_stats *now = &after[TSHA_STATS_SHA256A];
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u32 digest[DIGEST_SIZE_WORDS];
+	s32 result = 0;
+	u32 i;
+
+	debug_printf("Stats test:\n");
+	tsha_stats_snapshot(before);
+	tsha256a_digest((const u8 *)"abc", 3, digest);
+	tsha_stats_snapshot(after);
+	if (now->bytes - old->bytes != 3 || now->blocks - old->blocks != 1
+		|| now->finals - old->finals != 1 || now->errors != old->errors)
+		result = -1;
+
+	tsha_stats_snapshot(before);
+	tsha256a_reset(&state);
+	for (i = 0; i < 3; i++)
+		tsha256a_getch(&state, "abc"[i]);
+	do {
+		tsha256a_update(&state, 1);
+	} while (state.event != TSHA256_FSM_COMPLETE
+		&& state.event != TSHA256_FSM_ERROR);
+	tsha_stats_snapshot(after);
+	if (now->bytes - old->bytes != 3 || now->blocks - old->blocks != 1
+		|| now->finals - old->finals != 1 || now->errors != old->errors)
+		result = -1;
+
+	tsha_stats_snapshot(before);
+	tsha256a_update(&state, 1);
+	tsha256a_close(&state);
+	tsha_stats_snapshot(after);
+	if (now->errors - old->errors != 1 || now->finals != old->finals)
+		result = -1;
+
+	tsha_stats_snapshot(before);
+	if (tsha256a_digest(NULL, 1, digest) != -EINVAL)
+		result = -1;
+	tsha_stats_snapshot(after);
+	if (now->errors - old->errors != 1 || now->finals != old->finals)
+		result = -1;
+
+	if (result == 0)
+		debug_printf("Pass\n");
+	else
+		debug_printf("Failed\n");
+	return result;
+}
+#endif // USE_STATS
+
 s32 run_tests() {
 	u32 digest[DIGEST_SIZE_WORDS];
 	s32 ret = 0;
 	s32 failed = 0;
 	struct tsha256 __attribute__ ((aligned (16))) state;
 
-#	define NTESTS 4
+#	define NTESTS 6
 
 	struct TEST_CASES
 	{
@@ -118,6 +293,25 @@ s32 run_tests() {
 		     0x50b2654b, 0x4e88c69a, 0xdf86dfe7, 0xb1a71f40};
 	test_cases[3].expected_digest = t3;
 
+	u8 m4[1000];
+	memset(m4, 'a', sizeof(m4));
+	test_cases[4].description = "16 block, 1000 char message test";
+	test_cases[4].message = m4;
+	test_cases[4].bytes = sizeof(m4);
+	u32 t4[8] = {0x41edece4, 0x2d63e8d9, 0xbf515a9b, 0xa6932e1c,
+		     0x20cbc9f5, 0xa5d13464, 0x5adb5db1, 0xb9737ea3};
+	test_cases[4].expected_digest = t4;
+
+	test_cases[5].description = "1 block, 55 char message test";
+	test_cases[5].message = m4;
+	test_cases[5].bytes = 55;
+	u32 t5[8] = {0x9f4390f8, 0xd30c2dd9, 0x2ec9f095, 0xb65e2b9a,
+		     0xe9b0a925, 0xa5258e24, 0x1c9f1e91, 0x0f734318};
+	test_cases[5].expected_digest = t5;
+
+#ifdef USE_DISPATCH
+	printf("Using the %s kernel\n", tsha256_kernel_name());
+#endif // USE_DISPATCH
 	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
 	{
 		debug_printf("#### start test ####\n");
@@ -184,9 +378,106 @@ s32 run_tests() {
 			debug_printf("Failed\n");
 		debug_printf("---\n");
 		failed |= result;
+
+		debug_printf("Bulk write path:\n");
+		ret = tsha256a_reset(&state);
+		/* Split so that the head, body and tail paths all run. */
+		i = bytes > 0 ? 1 : 0;
+		if (tsha256a_write(&state, message, i) < 0
+			|| tsha256a_write(&state, message + i, bytes - i) < 0)
+		{
+			tsha256a_close(&state);
+			ret = -EINVAL;
+			goto ERROR;
+		}
+		do {
+			tsha256a_update(&state, 1);
+		} while (state.event != TSHA256_FSM_COMPLETE
+			&& state.event != TSHA256_FSM_ERROR);
+		memcpy(digest, tsha256a_get_hashcode(&state), DIGEST_SIZE_BYTES);
+		tsha256a_close(&state);
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed\n");
+		debug_printf("---\n");
+		failed |= result;
+
+		debug_printf("One-shot digest:\n");
+		if (tsha256a_digest(message, bytes, digest) < 0)
+		{
+			ret = -EINVAL;
+			goto ERROR;
+		}
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed\n");
+		debug_printf("---\n");
+		failed |= result;
 		debug_printf("#### end test ####\n");
 	}
 
+	debug_printf("#### start test ####\n");
+	debug_printf("Random lengths against tsha256r\n");
+	{
+		static u8 buf[1 << 17];
+		u32 expected[DIGEST_SIZE_WORDS];
+		u64 bytes, i, n;
+		s32 result = 0;
+
+		srand(1);
+		for (n = 0; n < 16 && result == 0; n++)
+		{
+			bytes = rand() % sizeof(buf);
+			for (i = 0; i < bytes; i++)
+				buf[i] = rand();
+			tsha256r_digest(buf, bytes, expected);
+
+			/* The one-shot path */
+			if (tsha256a_digest(buf, bytes, digest) < 0)
+			{
+				ret = -EINVAL;
+				goto ERROR;
+			}
+			result |= memcmp(expected, digest, DIGEST_SIZE_BYTES);
+
+			/* The FSM path, split at a random byte */
+			ret = tsha256a_reset(&state);
+			i = bytes > 0 ? rand() % bytes : 0;
+			if (tsha256a_write(&state, buf, i) < 0
+				|| tsha256a_write(&state, buf + i, bytes - i) < 0)
+			{
+				tsha256a_close(&state);
+				ret = -EINVAL;
+				goto ERROR;
+			}
+			do {
+				tsha256a_update(&state, 1);
+			} while (state.event != TSHA256_FSM_COMPLETE
+				&& state.event != TSHA256_FSM_ERROR);
+			memcpy(digest, tsha256a_get_hashcode(&state),
+				DIGEST_SIZE_BYTES);
+			tsha256a_close(&state);
+			result |= memcmp(expected, digest, DIGEST_SIZE_BYTES);
+		}
+		memset(buf, 0, sizeof(buf));
+
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed\n");
+		debug_printf("---\n");
+		failed |= result;
+	}
+	debug_printf("#### end test ####\n");
+
+#ifdef USE_STATS
+	failed |= test_stats();
+#endif // USE_STATS
+
 DONE_RT:
 	return failed;
 
@@ -196,7 +487,6 @@ ERROR:
 
 s32 get_hash_argv(s32 argc, char *argv[])
 {
-	struct tsha256 __attribute__ ((aligned (16))) state;
 	s32 ret = 0;
 	s64 i;
 	u32 bytes;
@@ -204,30 +494,9 @@ s32 get_hash_argv(s32 argc, char *argv[])
 	if (argc)
 	if (argc == 2) {
 		bytes = strlen(argv[1]);
-		ret = tsha256a_reset(&state);
-		i = 0;
-		while (i < bytes)
-		{
-			s32 bytes_read = 0;
-			bytes_read = tsha256a_getch(&state, argv[1][i]);
-			if (bytes_read < 0)
-			{
-				tsha256a_close(&state);
-				ret = -EINVAL;
-				goto DONE_ARGV;
-			}
-
-			i += bytes_read;
-			if (state.event == TSHA256_FSM_INPUT_UPDATE)
-				tsha256a_update(&state,0);
-		}
-		do {
-			tsha256a_update(&state,1);
-		} while (state.event != TSHA256_FSM_COMPLETE
-			&& state.event != TSHA256_FSM_ERROR);
-		u32 *hashcode = tsha256a_get_hashcode(&state);
-		memcpy(digest, hashcode, DIGEST_SIZE_BYTES);
-		tsha256a_close(&state);
+		ret = tsha256a_digest(argv[1], bytes, digest);
+		if (ret < 0)
+			goto DONE_ARGV;
 		for (i = 0; i < DIGEST_SIZE_WORDS; i++)
 			debug_printf("%04x", digest[i]);
 	}
@@ -248,3 +517,4 @@ s32 main(s32 argc, char *argv[])
 
 	return ret;
 }
+#endif // !TSHA256A_NO_MAIN
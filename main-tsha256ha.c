@@ -55,9 +55,21 @@
 #define ALG_PLAIN
 
 #include "tsha256.h"
+#include "tsha-prof.h"
+#include "tsha-stats.h"
+#include "tsha-probes.h"
+#include "tsha-trace.h"
+
+/* -DTSHA256HA_SUFFIX renames tsha256ha_digest so tsha-bench can link one
+   object per ISA build of this file.					      */
+#ifdef TSHA256HA_SUFFIX
+#  define TSHA256HA_SYM2(NAME,SUFFIX) NAME##_##SUFFIX
+#  define TSHA256HA_SYM(NAME,SUFFIX) TSHA256HA_SYM2(NAME,SUFFIX)
+#  define tsha256ha_digest TSHA256HA_SYM(tsha256ha_digest,TSHA256HA_SUFFIX)
+#endif // TSHA256HA_SUFFIX
 
 #ifdef HAVE_SSE4_1
-#  warning "Using SSE4.1 (UNTESTED)"
+#  warning "Using SSE4.1"
 #elif defined(HAVE_SSE2)
 #  warning "Using SSE2"
 #else
@@ -65,7 +77,7 @@
 #endif
 
 #ifdef HAVE_BMI
-#  warning "Using BMI (UNTESTED)"
+#  warning "Using BMI"
 #endif
 
 #ifdef HAVE_SSE4_1
@@ -76,6 +88,14 @@
 #  error "You must add -DHAVE_SSE4_1 or -DHAVE_SSE2"
 #endif
 
+/* Block and round detail.  USE_TRACE keeps the rounds in the tsha-trace.h
+   ring instead and tsha-trace-decode.py prints them afterwards. */
+#ifndef USE_TRACE
+#  define block_printf(format, ...) debug_printf(format, ##__VA_ARGS__)
+#else
+#  define block_printf(format, ...)
+#endif // USE_TRACE
+
 /* rotate right */
 #ifndef ROTRL
 u32 ROTRL(const u32 v, const u8 amt)
@@ -88,7 +108,11 @@ void insert_W_byte(u32 bi, u8 c)
 {
 	register u32 gpr0 asm ("r8");
 	gpr0 = 0x000000ff & c;
+#ifdef W_ROLLING
+	insert_W_byte_blend(bi, gpr0);
+#else
 	_insert_W_byte(bi, gpr0);
+#endif
 }
 
 u32 *tsha256ha_get_hashcode(struct tsha256 *state)
@@ -98,21 +122,29 @@ u32 *tsha256ha_get_hashcode(struct tsha256 *state)
 
 s32 tsha256ha_reset(struct tsha256 *state)
 {
+	DECLARE_REGISTERS();
+
 	memset(state, 0, sizeof(struct tsha256));
+	/* Before W is live, see TSHA_STATS_TOUCH. */
+	TSHA_STATS_TOUCH(TSHA_STATS_SHA256HA);
 	CLEAR_A();
 	CLEAR_W();
 	debug_printf("Init digest\n");
 	INIT_H(xmm0,state->digest,H_0,H_0[4]);
+	TSHA_PROBE(tsha256ha, reset, state);
 }
 
 s32 tsha256ha_close(struct tsha256 *state)
 {
 	/* Securely wipe sensitive data.  Especially if password is used as the
 	   message.							      */
+	TSHA_PROBE(tsha256ha, close, state);
+	TSHA_PROF_PUSH(TSHA_PROF_CLEAR);
 	CLEAR_A();
 	CLEAR_W();
 	CLEAR_GPR();
 	memset(state, 0, sizeof(struct tsha256));
+	TSHA_PROF_POP();
 }
 
 void aprintf(u8 *a, s32 size)
@@ -128,6 +160,8 @@ void aprintf(u8 *a, s32 size)
 
 void print_W_array()
 {
+	DECLARE_REGISTERS();
+
 	debug_printf("Dumping xmm\n");
 	register u32 t0 asm ("r8");
 
@@ -231,9 +265,12 @@ s32 tsha256ha_getch(struct tsha256 *state, u8 c)
 		goto GETCH_DONE;
 
 	if (state->i_message < MESSAGE_SIZE_BYTES) {
+		TSHA_PROF_PUSH(TSHA_PROF_INSERT);
 		insert_W_byte(seq[state->i_message], c);
 		state->msglen++;
 		state->i_message++;
+		TSHA_PROF_POP();
+		TSHA_STATS_ADD(TSHA_STATS_SHA256HA, bytes, 1);
 		ret = 1;
 	} else {
 		state->event = TSHA256_FSM_INPUT_UPDATE;
@@ -244,7 +281,7 @@ GETCH_DONE:
 }
 
 #    define YX_SHLQ_REPLACE(MM,GPR)						\
-        asm(	"movq	%1,%q0\n\t"						\
+        asm volatile (	"movq	%1,%q0\n\t"					\
 		"shlq	$32,%q0\n\t"						\
 		"movq	%q0,%1"							\
 		: "+r" (GPR),							\
@@ -264,17 +301,52 @@ GETCH_DONE:
 
 #ifdef HAVE_BMI
 #      define ANDN1								\
-	asm(	"andnq		%%r9d,%%r14,%%r9d"				\
-		:								\
-		:								\
-		: "r9d",							\
-		  "r14");
+	asm volatile (	"andnl		%k0,%k1,%k0"				\
+		: "+r" (r9d)							\
+		: "r" (r14d));
 #else
 #      define ANDN1								\
 	r14d = ~r14d;								\
 	r9d = r14d & r9d;
 #endif
 
+#ifdef HAVE_BMI2
+/* sigma of ebx into D.  ebx is destroyed. */
+#  define SMALL_SIGMA_EBX(D,A0,A1,A2)						\
+	SMALL_SIGMA_RORX(D,ebx,eax,A0,A1,A2)
+/* SIGMA of r14d into D.  rorx keeps r14d so it is not reloaded. */
+#  define BIG_SIGMA_R14D(D,A0,A1,A2)						\
+	BIG_SIGMA_RORX(D,r14d,r10d,A0,A1,A2)
+#  define RELOAD_E()
+#  define RELOAD_A_R10D()							\
+	r10d = r14d
+#else
+#  define SMALL_SIGMA_EBX(D,A0,A1,A2)						\
+do {										\
+	eax = ebx;								\
+	ecx = ebx;								\
+	ROTRL(eax, A0);								\
+	ROTRL(ebx, A1);								\
+	ecx = ecx >> A2;							\
+	ebx = eax ^ ebx;							\
+	D = ebx ^ ecx;								\
+} while(0)
+#  define BIG_SIGMA_R14D(D,A0,A1,A2)						\
+do {										\
+	r10d = r14d;								\
+	r11d = r14d;								\
+	ROTRL(r14d,A0);								\
+	ROTRL(r10d,A1);								\
+	ROTRL(r11d,A2);								\
+	r10d = r14d ^ r10d;							\
+	D = r10d ^ r11d;							\
+} while(0)
+#  define RELOAD_E()								\
+	r14d = get_e()
+#  define RELOAD_A_R10D()							\
+	r10d = get_a()
+#endif // HAVE_BMI2
+
 	/* Parallel register reuse can produce wrong result. */
 	/* Translated from sha256.S. */
 	/* This is manually expanded for deterministic register use
@@ -285,34 +357,21 @@ do {										\
 	register u32 sig0 asm ("r12");						\
 	register u32 sig1 asm ("ecx");						\
 										\
-	ebx = get_w(j-15);							\
-	eax = ebx;								\
-	ecx = ebx;								\
-	ROTRL(eax, 7);								\
-	ROTRL(ebx, 18);								\
-	ecx = ecx >> 3;								\
-	ebx = eax ^ ebx;							\
-	ecx = ebx ^ ecx;							\
-	sig0 = ecx;								\
+	ebx = get_w(WI(j-15));							\
+	SMALL_SIGMA_EBX(sig0, 7, 18, 3);					\
 										\
-	ebx = get_w(j-2);							\
-	eax = ebx;								\
-	ecx = ebx;								\
-	ROTRL(eax, 17);								\
-	ROTRL(ebx, 19);								\
-	ecx = ecx >> 10;							\
-	ebx = eax ^ ebx;							\
-	sig1 = ebx ^ ecx;							\
+	ebx = get_w(WI(j-2));							\
+	SMALL_SIGMA_EBX(sig1, 17, 19, 10);					\
 										\
-	r13d = get_w(j-16);							\
-	r14d = get_w(j-7);							\
+	r13d = get_w(WI(j-16));							\
+	r14d = get_w(WI(j-7));							\
 	r13d = r13d + sig0;							\
 	r13d = r13d + r14d;							\
 	r13d = r13d + sig1;							\
-	set_w(r13d, j);								\
+	set_w(r13d, WI(j));							\
 	if (j % 4 == 0)								\
-		debug_printf("\n");						\
-	debug_printf("%08x ", get_w(j));					\
+		block_printf("\n");						\
+	block_printf("%08x ", get_w(WI(j)));					\
 } while(0)
 
 	/* Translated from sha256.S. */
@@ -328,20 +387,18 @@ do {										\
 	register u32 SIG0 asm ("r11");						\
 	register u32 SIG1 asm ("r11");						\
 										\
+	DO_ROLLING_EXPANSION(j);						\
+	TSHA_TRACE_ROUND(TSHA_TRACE_SHA256HA, j, get_a(), get_b(), get_c(),	\
+		get_d(), get_e(), get_f(), get_g(), get_h(), get_w(WI(j)));	\
+										\
 	r8d = get_h();								\
 	T1 = r8d;								\
 										\
 	r14d = get_e();								\
-	r10d = r14d;								\
-	r11d = r14d;								\
-	ROTRL(r14d,6);								\
-	ROTRL(r10d,11);								\
-	ROTRL(r11d,25);								\
-	r10d = r14d ^ r10d;							\
-	SIG1 = r10d ^ r11d;							\
+	BIG_SIGMA_R14D(SIG1, 6, 11, 25);					\
 	T1 = T1 + SIG1;								\
 										\
-	r14d = get_e();								\
+	RELOAD_E();								\
 	r9d = get_g();								\
 	r15d = get_f();								\
 	r15d = r14d & r15d;							\
@@ -351,20 +408,14 @@ do {										\
 										\
 	T1 = T1 + k;								\
 										\
-	ebx = get_w(j);								\
+	ebx = get_w(WI(j));							\
 	T1 = T1 + ebx;								\
 										\
 	r14d = get_a();								\
-	r10d = r14d;								\
-	r11d = r14d;								\
-	ROTRL(r14d,2);								\
-	ROTRL(r10d,13);								\
-	ROTRL(r11d,22);								\
-	r10d = r14d ^ r10d;							\
-	SIG0 = r10d ^ r11d;							\
+	BIG_SIGMA_R14D(SIG0, 2, 13, 22);					\
 	T2 = SIG0;								\
 										\
-	r10d = get_a();								\
+	RELOAD_A_R10D();							\
 	r11d = get_b();								\
 	r14d = r11d;								\
 	r12d = get_c();								\
@@ -411,36 +462,39 @@ do {										\
 	register u32 sig0 asm ("r12");						\
 	register u32 sig1 asm ("ecx");						\
 										\
-	ebx = get_w(j-15);							\
-	eax = ebx;								\
-	ecx = ebx;								\
-	ROTRL(eax, 7);								\
-	ROTRL(ebx, 18);								\
-	ecx = ecx >> 3;								\
-	ebx = eax ^ ebx;							\
-	ecx = ebx ^ ecx;							\
-	sig0 = ecx;								\
+	ebx = get_w(WI(j-15));							\
+	SMALL_SIGMA_EBX(sig0, 7, 18, 3);					\
 										\
-	ebx = get_w(j-2);							\
-	eax = ebx;								\
-	ecx = ebx;								\
-	ROTRL(eax, 17);								\
-	ROTRL(ebx, 19);								\
-	ecx = ecx >> 10;							\
-	ebx = eax ^ ebx;							\
-	sig1 = ebx ^ ecx;							\
+	ebx = get_w(WI(j-2));							\
+	SMALL_SIGMA_EBX(sig1, 17, 19, 10);					\
 										\
-	r13d = get_w(j-16);							\
-	r14d = get_w(j-7);							\
+	r13d = get_w(WI(j-16));							\
+	r14d = get_w(WI(j-7));							\
 	r13d = r13d + sig0;							\
 	r13d = r13d + r14d;							\
 	r13d = r13d + sig1;							\
-	set_w(r13d, j);								\
+	set_w(r13d, WI(j));							\
 	if (j % 4 == 0)								\
-		debug_printf("\n");						\
-	debug_printf("%08x ", get_w(j));					\
+		block_printf("\n");						\
+	block_printf("%08x ", get_w(WI(j)));					\
 } while(0)
 
+#  ifdef W_ROLLING
+	/* W[j..j+3] overwrite W[j-16..j-13] in xmm0-xmm3, so they are
+	   expanded four at a time right before round j instead of all at once
+	   ahead of the compression. */
+#    define DO_ROLLING_EXPANSION(j)						\
+	if ((j) >= MESSAGE_SIZE_WORDS && (j) % 4 == 0)				\
+	{									\
+		TSHA_PROF_SPLIT_BEGIN(TSHA_PROF_EXPANSION);			\
+		expand_w4(j);							\
+		TSHA_PROF_SPLIT_END();						\
+		block_printf("\n%08x %08x %08x %08x ", get_w(WI(j)),		\
+			get_w(WI(j+1)), get_w(WI(j+2)), get_w(WI(j+3)));	\
+	}
+#    define DO_MESSAGE_EXPANSION()
+#  else
+#    define DO_ROLLING_EXPANSION(j)
 /* Unrolled do_compression generated by gen_asm_unroll_message_expansion.py */
 #    define DO_MESSAGE_EXPANSION()						\
 	DO_MESSAGE_EXPANSION_ASM(16);						\
@@ -491,6 +545,7 @@ do {										\
 	DO_MESSAGE_EXPANSION_ASM(61);						\
 	DO_MESSAGE_EXPANSION_ASM(62);						\
 	DO_MESSAGE_EXPANSION_ASM(63);
+#  endif // W_ROLLING
 #    define DO_MESSAGE_COMPRESSION()						\
 	DO_COMPRESSION_ASM(0,0x428a2f98);					\
 	DO_COMPRESSION_ASM(1,0x71374491);					\
@@ -567,53 +622,62 @@ static void _tsha256ha_complete_message_block(struct tsha256 *state) {
 #       define H6 state->digest[6]
 #       define H7 state->digest[7]
 
+	DECLARE_REGISTERS();
 	u32 i; /* index for component of hash */
 	u32 j; /* index for message blocks */
 
 	debug_printf("Called _tsha256ha_complete_message_block\n");
+	TSHA_PROBE(tsha256ha, block_start, state);
+	TSHA_STATS_TSC_BEGIN();
 
 #ifdef DEBUG
-	debug_printf("Message contents of W32:\n");
+	block_printf("Message contents of W32:\n");
 
 	for (j = 0; j < MESSAGE_SIZE_WORDS ; j++)
 	{
 		if (j % 8 == 0)
-			debug_printf("\n");
-		debug_printf("%08x ", get_w(j));
+			block_printf("\n");
+		block_printf("%08x ", get_w(j));
 	}
-	debug_printf("\n");
+	block_printf("\n");
 #endif
 
-	debug_printf("Expanding message blocks\n");
+	block_printf("Expanding message blocks\n");
+	TSHA_PROF_PUSH(TSHA_PROF_EXPANSION);
 	DO_MESSAGE_EXPANSION()
-	debug_printf("\n");
+	TSHA_PROF_POP();
+	block_printf("\n");
 
+#ifndef USE_TRACE
 	print_W_array();
-	debug_printf("\n");
+#endif // !USE_TRACE
+	block_printf("\n");
 
+	TSHA_PROF_PUSH(TSHA_PROF_ROUNDS);
 	// init state
 	INIT_ABCDEFGH(H0,H2,H4,H6);
 
 	DO_MESSAGE_COMPRESSION()
 
-	debug_printf("\n");
-	debug_printf("Updating intermediate hash values\n");
+	block_printf("\n");
+	block_printf("Updating intermediate hash values\n");
 
-	debug_printf("hex values %d:\n", j-1);
+	block_printf("hex values %d:\n", j-1);
 	H0 = get_a() + H0; H1 = get_b() + H1;
 	H2 = get_c() + H2; H3 = get_d() + H3;
 	H4 = get_e() + H4; H5 = get_f() + H5;
 	H6 = get_g() + H6; H7 = get_h() + H7;
-	debug_printf("%08x%08x%08x%08x%08x%08x%08x%08x\n",
+	TSHA_PROF_POP();
+	block_printf("%08x%08x%08x%08x%08x%08x%08x%08x\n",
 		get_a(), get_b(), get_c(), get_d(),
 		get_e(), get_f(), get_g(), get_h());
 
 
 #ifdef DEBUG
-	debug_printf("\nDigest as in hex little endian:\n");
+	block_printf("\nDigest as in hex little endian:\n");
 	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
-		debug_printf("%08x", state->digest[i]);
-		debug_printf("\n");
+		block_printf("%08x", state->digest[i]);
+		block_printf("\n");
 #endif
 
 	debug_printf("Called _tsha256ha_complete_message_block done\n");
@@ -622,12 +686,20 @@ DONE:
 
 	/* Process next message block. */
 	state->i_message = 0;
+	TSHA_PROF_PUSH(TSHA_PROF_CLEAR);
 	CLEAR_W();
+	TSHA_PROF_POP();
+
+	TSHA_STATS_ADD(TSHA_STATS_SHA256HA, blocks, 1);
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA256HA);
+	TSHA_PROBE(tsha256ha, block_end, state);
 }
 
 void tsha256ha_update(struct tsha256 *state, u32 finish)
 {
 	debug_printf("Called tsha256ha_update\n");
+	TSHA_PROBE(tsha256ha, update_start, state);
+	TSHA_PROF_PUSH(TSHA_PROF_FSM);
 
 	if (finish == 1 || state->i_message >= MESSAGE_SIZE_BYTES)
 	{
@@ -636,7 +708,7 @@ void tsha256ha_update(struct tsha256 *state, u32 finish)
 	else
 	{
 		debug_printf("Message is NOT ready.\n");
-		return;
+		goto UPDATE_DONE;
 	}
 
 	debug_printf("state: %d\n", state->event);
@@ -691,7 +763,7 @@ void tsha256ha_update(struct tsha256 *state, u32 finish)
 	else if (state->event == TSHA256_FSM_APPEND_0_PADDING)
 	{
 		debug_printf("state->event == TSHA256_FSM_APPEND_0_PADDING\n");
-		if (state->i_message < 56) {
+		if (state->i_message <= 56) {
 			debug_printf("Filling padding to i=55\n");
 			state->event = TSHA256_FSM_APPEND_LENGTH;
 		} else {
@@ -705,7 +777,7 @@ void tsha256ha_update(struct tsha256 *state, u32 finish)
 	}
 	else if (state->event == TSHA256_FSM_APPEND_LENGTH) {
 		debug_printf("state->event == TSHA256_FSM_APPEND_LENGTH\n");
-		if (state->i_message < 56) {
+		if (state->i_message <= 56) {
 			/* space check: 56 = MESSAGE_SIZE_BYTES - L_SIZE_BYTES */
 			debug_printf("Message length:\n");
 			/* gets message length */
@@ -729,17 +801,110 @@ void tsha256ha_update(struct tsha256 *state, u32 finish)
 
 			debug_printf("state->event == TSHA256_FSM_COMPLETE\n");
 			state->event = TSHA256_FSM_COMPLETE;
+			TSHA_STATS_ADD(TSHA_STATS_SHA256HA, finals, 1);
 		} else {
-			debug_printf("Expected state->i_message < 56\n");
+			debug_printf("Expected state->i_message <= 56\n");
 			state->event = TSHA256_FSM_ERROR;
+			TSHA_STATS_ADD(TSHA_STATS_SHA256HA, errors, 1);
 		}
 	} else {
 		state->event = TSHA256_FSM_ERROR;
+		TSHA_STATS_ADD(TSHA_STATS_SHA256HA, errors, 1);
 	}
 
+UPDATE_DONE:
+	TSHA_PROF_POP();
+	TSHA_PROBE(tsha256ha, update_end, state);
 	return;
 }
 
+/* Hashes msg in one call through the getch and update FSM.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256ha_digest(const u8 *msg, u64 len, u32 *out)
+{
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u64 i = 0;
+	s32 bytes_read;
+
+	debug_printf("Called tsha256ha_digest\n");
+
+	if ((msg == NULL && len > 0) || out == NULL)
+		return -EINVAL;
+
+	tsha256ha_reset(&state);
+	while (i < len)
+	{
+		bytes_read = tsha256ha_getch(&state, msg[i]);
+		if (bytes_read < 0)
+		{
+			tsha256ha_close(&state);
+			return -EINVAL;
+		}
+
+		i += bytes_read;
+
+		if (state.event == TSHA256_FSM_INPUT_UPDATE)
+			tsha256ha_update(&state, 0);
+	}
+	do {
+		tsha256ha_update(&state, 1);
+	} while (state.event != TSHA256_FSM_COMPLETE
+		&& state.event != TSHA256_FSM_ERROR);
+
+	if (state.event == TSHA256_FSM_ERROR)
+	{
+		tsha256ha_close(&state);
+		return -EINVAL;
+	}
+
+	memcpy(out, tsha256ha_get_hashcode(&state), DIGEST_SIZE_BYTES);
+	tsha256ha_close(&state);
+
+	return 0;
+}
+
+/* Lets another program such as tsha-bench link this file. */
+#ifndef TSHA256HA_NO_MAIN
+#ifdef USE_STATS
+/* "abc" counts three bytes, a block and a final, an update past the end
+   counts one error. */
+static s32 test_stats(void)
+{
+	struct tsha_stats before[TSHA_STATS_NENGINES];
+	struct tsha_stats after[TSHA_STATS_NENGINES];
+	struct tsha_stats *old = &before[TSHA_STATS_SHA256HA];
+	struct tsha_stats *now = &after[TSHA_STATS_SHA256HA];
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u32 digest[DIGEST_SIZE_WORDS];
+	s32 result = 0;
+
+	debug_printf("Stats test:\n");
+	tsha_stats_snapshot(before);
+	tsha256ha_digest((const u8 *)"abc", 3, digest);
+	tsha_stats_snapshot(after);
+	if (now->bytes - old->bytes != 3 || now->blocks - old->blocks != 1
+		|| now->finals - old->finals != 1 || now->errors != old->errors)
+		result = -1;
+
+	tsha_stats_snapshot(before);
+	tsha256ha_reset(&state);
+	state.event = TSHA256_FSM_COMPLETE;
+	tsha256ha_update(&state, 1);
+	tsha256ha_close(&state);
+	tsha_stats_snapshot(after);
+	if (now->errors - old->errors != 1 || now->finals != old->finals)
+		result = -1;
+
+	if (result == 0)
+		debug_printf("Pass\n");
+	else
+		debug_printf("Failed\n");
+	return result;
+}
+#endif // USE_STATS
+
 s32 run_tests() {
 	u32 digest[DIGEST_SIZE_WORDS];
 	s32 ret = 0;
@@ -858,6 +1023,110 @@ s32 run_tests() {
 		debug_printf("#### end test ####\n");
 	}
 
+#ifdef W_ROLLING
+	debug_printf("#### start test ####\n");
+	debug_printf("expand_w4 against the plain expansion\n");
+	{
+		u32 W32[64];
+		u32 w, r0, r1, sig0, sig1;
+		u32 j, n;
+		s32 result = 0;
+
+		srand(1);
+		for (n = 0; n < 256 && result == 0; n++)
+		{
+			for (j = 0; j < MESSAGE_SIZE_WORDS; j++)
+			{
+				W32[j] = (u32)rand() << 16 ^ (u32)rand();
+				set_w(W32[j], WI(j));
+			}
+			/* The scalar rotates also keep gcc from vectorizing this
+			   into the mm registers that are reserved. */
+			for (j = MESSAGE_SIZE_WORDS; j < 64; j++)
+			{
+				r0 = r1 = W32[j-15];
+				ROTRL(r0, 7);
+				ROTRL(r1, 18);
+				sig0 = r0 ^ r1 ^ W32[j-15] >> 3;
+				r0 = r1 = W32[j-2];
+				ROTRL(r0, 17);
+				ROTRL(r1, 19);
+				sig1 = r0 ^ r1 ^ W32[j-2] >> 10;
+				W32[j] = W32[j-16] + sig0 + W32[j-7] + sig1;
+			}
+			for (j = MESSAGE_SIZE_WORDS; j < 64; j += 4)
+			{
+				expand_w4(j);
+				for (w = j; w < j + 4; w++)
+					if (get_w(WI(w)) != W32[w])
+						result = 1;
+			}
+		}
+		CLEAR_W();
+
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed at block %d\n", n - 1);
+		debug_printf("---\n");
+		failed |= result;
+	}
+	debug_printf("#### end test ####\n");
+
+	debug_printf("#### start test ####\n");
+	debug_printf("insert_W_byte_blend against _insert_W_byte\n");
+	{
+		u32 W32[MESSAGE_SIZE_WORDS];
+		u8 *W8 = (u8 *)W32;
+		u32 bi, ch, j, n;
+		s32 result = 0;
+
+		srand(2);
+		for (n = 0; n < 256 && result == 0; n++)
+		{
+			/* The blend has to replace the byte, so W starts out
+			   dirty. */
+			for (j = 0; j < MESSAGE_SIZE_WORDS; j++)
+			{
+				W32[j] = (u32)rand() << 16 ^ (u32)rand();
+				set_w(W32[j], j);
+			}
+			for (j = 0; j < MESSAGE_SIZE_BYTES; j++)
+			{
+				bi = rand() % MESSAGE_SIZE_BYTES;
+				ch = rand() & 0xff;
+				insert_W_byte_blend(bi, ch);
+				W8[bi] = ch;
+			}
+			for (j = 0; j < MESSAGE_SIZE_WORDS; j++)
+				if (get_w(j) != W32[j])
+					result = 1;
+
+			/* The jump table path xors into a cleared W and has to
+			   agree on the byte layout. */
+			CLEAR_W();
+			for (bi = 0; bi < MESSAGE_SIZE_BYTES; bi++)
+				_insert_W_byte(bi, W8[bi]);
+			for (j = 0; j < MESSAGE_SIZE_WORDS; j++)
+				if (get_w(j) != W32[j])
+					result = 1;
+		}
+		CLEAR_W();
+
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed at block %d\n", n - 1);
+		debug_printf("---\n");
+		failed |= result;
+	}
+	debug_printf("#### end test ####\n");
+#endif // W_ROLLING
+
+#ifdef USE_STATS
+	failed |= test_stats();
+#endif // USE_STATS
+
 DONE_RT:
 	return failed;
 
@@ -909,13 +1178,59 @@ DONE_ARGV:
 	return ret;
 }
 
+#ifdef USE_PROF
+/* Streams count messages of bytes bytes through getch and update, the
+   path with every phase, and prints the breakdown.  Nothing from libc may
+   run between reset and close, W and a-h are live in xmm and mm.
+   usage: tsha256ha-prof [bytes [count]]				      */
+s32 run_profile(s32 argc, char *argv[])
+{
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u64 bytes = argc > 1 ? strtoull(argv[1], NULL, 0) : 65536;
+	u64 count = argc > 2 ? strtoull(argv[2], NULL, 0) : 256;
+	u8 *message;
+	u64 i, n;
+
+	message = malloc(bytes ? bytes : 1);
+	if (message == NULL)
+		return -ENOMEM;
+	for (i = 0; i < bytes; i++)
+		message[i] = i * 131 + 7;
+
+	tsha_prof_init();
+	for (n = 0; n < count; n++)
+	{
+		tsha256ha_reset(&state);
+		i = 0;
+		while (i < bytes)
+		{
+			i += tsha256ha_getch(&state, message[i]);
+			if (state.event == TSHA256_FSM_INPUT_UPDATE)
+				tsha256ha_update(&state, 0);
+		}
+		do {
+			tsha256ha_update(&state, 1);
+		} while (state.event != TSHA256_FSM_COMPLETE
+			&& state.event != TSHA256_FSM_ERROR);
+		tsha256ha_close(&state);
+	}
+	tsha_prof_report("tsha256ha", bytes * count);
+
+	free(message);
+	return 0;
+}
+#endif // USE_PROF
+
 s32 main(s32 argc, char *argv[])
 {
 	s32 ret = 0;
-#ifdef DEBUG
+#ifdef USE_PROF
+	ret = run_profile(argc, argv);
+#elif defined(DEBUG)
 	ret = run_tests();
 #else
 	ret = get_hash_argv(argc, argv);
 #endif
 	return ret;
 }
+#endif // !TSHA256HA_NO_MAIN
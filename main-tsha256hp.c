@@ -57,6 +57,10 @@
 #define ALG_PLAIN
 
 #include "tsha256.h"
+#include "tsha-prof.h"
+#include "tsha-stats.h"
+#include "tsha-probes.h"
+#include "tsha-trace.h"
 
 #ifdef HAVE_SSE4_1
 #    warning "Using SSE4.1 (UNTESTED)"
@@ -79,6 +83,14 @@
 #    define debug_printf(format, ...)
 #endif // DEBUG
 
+/* Block and round detail.  USE_TRACE keeps the rounds in the tsha-trace.h
+   ring instead and tsha-trace-decode.py prints them afterwards. */
+#ifndef USE_TRACE
+#  define block_printf(format, ...) debug_printf(format, ##__VA_ARGS__)
+#else
+#  define block_printf(format, ...)
+#endif // USE_TRACE
+
 
 /* rotate right */
 #ifndef ROTRL
@@ -89,6 +101,9 @@ u32 ROTRL(const u32 v, const u8 amt)
 
 #endif // ROTRL
 
+static void _tsha256hp_complete_message_block(struct tsha256 *state);
+static void _tsha256hp_pad_and_complete(struct tsha256 *state);
+
 u32 *tsha256hp_get_hashcode(struct tsha256 *state)
 {
 	return state->digest;
@@ -99,13 +114,31 @@ s32 tsha256hp_reset(struct tsha256 *state)
 	memset(state, 0, sizeof(struct tsha256));
 	debug_printf("Init digest\n");
 	memcpy(state->digest, H_0, N_LETTERS * WORD_SIZE_BYTES);
+	TSHA_PROBE(tsha256hp, reset, state);
+}
+
+/* Same as tsha256hp_reset, but for a message of len bytes that is known up
+   front.  The padding and the length are placed and the final block is
+   compressed as soon as the last byte arrives, so state->event is
+   TSHA256_FSM_COMPLETE without any tsha256hp_update polling.	      */
+s32 tsha256hp_init_with_length(struct tsha256 *state, u64 len)
+{
+	tsha256hp_reset(state);
+	state->total_msglen = len;
+	state->has_total_msglen = 1;
+	if (len == 0)
+		_tsha256hp_pad_and_complete(state);
+	return 0;
 }
 
 s32 tsha256hp_close(struct tsha256 *state)
 {
 	/* Securely wipe sensitive data.  Especially if password is used as the
 	   message.							      */
+	TSHA_PROBE(tsha256hp, close, state);
+	TSHA_PROF_PUSH(TSHA_PROF_CLEAR);
 	memset(state, 0, sizeof(struct tsha256));
+	TSHA_PROF_POP();
 }
 
 /* Reads a character at a time into a x86 calling convention register.
@@ -124,13 +157,31 @@ s32 tsha256hp_getch(struct tsha256 *state, u8 c)
 	}
 
 	if (state->event != TSHA256_FSM_INPUT)
+	{
+		/* More bytes than given to tsha256hp_init_with_length */
+		if (state->has_total_msglen)
+			ret = -EINVAL;
 		goto GETCH_DONE;
+	}
 
 	if (state->i_message < MESSAGE_SIZE_BYTES) {
+		TSHA_PROF_PUSH(TSHA_PROF_INSERT);
 		state->W8[seq[state->i_message]] = c;
 		state->msglen++;
 		state->i_message++;
+		TSHA_PROF_POP();
+		TSHA_STATS_ADD(TSHA_STATS_SHA256HP, bytes, 1);
 		ret = 1;
+
+		/* With a known length there is no need to wait for the next
+		   byte or for the finish flag. */
+		if (state->has_total_msglen)
+		{
+			if (state->msglen == state->total_msglen)
+				_tsha256hp_pad_and_complete(state);
+			else if (state->i_message == MESSAGE_SIZE_BYTES)
+				_tsha256hp_complete_message_block(state);
+		}
 	} else {
 		state->event = TSHA256_FSM_INPUT_UPDATE;
 	}
@@ -141,24 +192,25 @@ GETCH_DONE:
 
 #    define DO_EXPANSION_PLAIN(j)					\
 do {										\
-	state->sig0 =	  ROTRL(W32[j-15], 7)					\
-			^ ROTRL(W32[j-15], 18)					\
-			^ (W32[j-15]  >>  3);					\
-	state->sig1 = 	  ROTRL(W32[j-2], 17)					\
-			^ ROTRL(W32[j-2], 19)					\
-			^   (W32[j-2] >> 10);					\
-	W32[j] = W32[j-16]							\
+	state->sig0 =	  ROTRL(W32[WI(j-15)], 7)				\
+			^ ROTRL(W32[WI(j-15)], 18)				\
+			^ (W32[WI(j-15)]  >>  3);				\
+	state->sig1 = 	  ROTRL(W32[WI(j-2)], 17)				\
+			^ ROTRL(W32[WI(j-2)], 19)				\
+			^   (W32[WI(j-2)] >> 10);				\
+	W32[WI(j)] = W32[WI(j-16)]						\
 				+ state->sig0					\
-				+ W32[j-7]					\
+				+ W32[WI(j-7)]					\
 				+ state->sig1;					\
 	if (j % 4 == 0)								\
-		debug_printf("\n");						\
-	debug_printf("%08x ", W32[j]);						\
+		block_printf("\n");						\
+	block_printf("%08x ", W32[WI(j)]);					\
 } while(0)
 
 #    define DO_COMPRESSION_PLAIN(j, k)						\
 do										\
 {										\
+	DO_ROLLING_EXPANSION(j);						\
 	state->Ch = (e & f) ^ ((~e) & g);					\
 	state->Maj = (a & b) ^ (a & c) ^ (b & c);				\
 	state->SIG0 = ROTRL(a,2) ^ ROTRL(a,13) ^ ROTRL(a,22);			\
@@ -167,16 +219,18 @@ do										\
 			+ state->SIG1						\
 			+ state->Ch						\
 			+ k							\
-			+ W32[j];						\
+			+ W32[WI(j)];						\
 	state->T2   = state->SIG0 + state->Maj;					\
-	debug_printf( "i-1=%d Ch=%08x Maj=%08x SIG0=%08x SIG1=%08x T1=%08x"	\
+	TSHA_TRACE_ROUND(TSHA_TRACE_SHA256HP, j, a, b, c, d, e, f, g, h,	\
+		W32[WI(j)]);							\
+	block_printf( "i-1=%d Ch=%08x Maj=%08x SIG0=%08x SIG1=%08x T1=%08x"	\
 		" T2=%08x h=%08x K=%08x W32=%08x\n",				\
 		j-1, state->Ch, state->Maj, state->SIG0,			\
 		state->SIG1, state->T1, state->T2, h, k,			\
-		W32[j]);							\
+		W32[WI(j)]);							\
 										\
-	debug_printf("Hex values %d:\n", j-1);					\
-	debug_printf("%08x %08x %08x %08x %08x %08x %08x %08x\n",		\
+	block_printf("Hex values %d:\n", j-1);					\
+	block_printf("%08x %08x %08x %08x %08x %08x %08x %08x\n",		\
 		a, b, c, d, e, f, g, h);					\
 	h = g;									\
 	g = f;									\
@@ -207,21 +261,34 @@ do										\
 
 #    define DO_MESSAGE_EXPANSION_PLAIN(j)					\
 do {										\
-	state->sig0 =	  ROTRL(W32[j-15], 7)					\
-			^ ROTRL(W32[j-15], 18)					\
-			^ (W32[j-15]  >>  3);					\
-	state->sig1 =	  ROTRL(W32[j-2], 17)					\
-			^ ROTRL(W32[j-2], 19)					\
-			^   (W32[j-2] >> 10);					\
-	W32[j] = W32[j-16]							\
+	state->sig0 =	  ROTRL(W32[WI(j-15)], 7)				\
+			^ ROTRL(W32[WI(j-15)], 18)				\
+			^ (W32[WI(j-15)]  >>  3);				\
+	state->sig1 =	  ROTRL(W32[WI(j-2)], 17)				\
+			^ ROTRL(W32[WI(j-2)], 19)				\
+			^   (W32[WI(j-2)] >> 10);				\
+	W32[WI(j)] = W32[WI(j-16)]						\
 				+ state->sig0					\
-				+ W32[j-7]					\
+				+ W32[WI(j-7)]					\
 				+ state->sig1;					\
 	if (j % 4 == 0)								\
 		debug_printf("\n");						\
-	debug_printf("%08x ", W32[j]);						\
+	debug_printf("%08x ", W32[WI(j)]);					\
 } while(0)
 
+#  ifdef W_ROLLING
+	/* W[j] overwrites W[j-16], so it is expanded right before round j
+	   instead of all at once ahead of the compression. */
+#    define DO_ROLLING_EXPANSION(j)						\
+	if ((j) >= MESSAGE_SIZE_WORDS)						\
+	{									\
+		TSHA_PROF_SPLIT_BEGIN(TSHA_PROF_EXPANSION);			\
+		DO_MESSAGE_EXPANSION_PLAIN(j);					\
+		TSHA_PROF_SPLIT_END();						\
+	}
+#    define DO_MESSAGE_EXPANSION()
+#  else
+#    define DO_ROLLING_EXPANSION(j)
 /* Unrolled do_compression generated by gen_asm_unroll_message_expansion.py */
 #    define DO_MESSAGE_EXPANSION()						\
 	DO_MESSAGE_EXPANSION_PLAIN(16);						\
@@ -272,6 +339,7 @@ do {										\
 	DO_MESSAGE_EXPANSION_PLAIN(61);						\
 	DO_MESSAGE_EXPANSION_PLAIN(62);						\
 	DO_MESSAGE_EXPANSION_PLAIN(63);
+#  endif // W_ROLLING
 #    define DO_MESSAGE_COMPRESSION()						\
 	DO_COMPRESSION_PLAIN(0,0x428a2f98);					\
 	DO_COMPRESSION_PLAIN(1,0x71374491);					\
@@ -344,53 +412,59 @@ static void _tsha256hp_complete_message_block(struct tsha256 *state) {
 	u32 *W32;
 
 	debug_printf("Called _tsha256hp_complete_message_block\n");
+	TSHA_PROBE(tsha256hp, block_start, state);
+	TSHA_STATS_TSC_BEGIN();
 
 	W32 = (u32*)state->W8;
 
 #  ifdef DEBUG
-	debug_printf("Message contents of W32:\n");
+	block_printf("Message contents of W32:\n");
 
 	for (j = 0; j < MESSAGE_SIZE_WORDS ; j++)
 	{
 		if (j % 8 == 0)
-			debug_printf("\n");
-		debug_printf("%08x ", W32[j]);
+			block_printf("\n");
+		block_printf("%08x ", W32[j]);
 	}
-	debug_printf("\n");
+	block_printf("\n");
 #  endif
 
-	debug_printf("Expanding message blocks\n");
+	block_printf("Expanding message blocks\n");
+	TSHA_PROF_PUSH(TSHA_PROF_EXPANSION);
 	DO_MESSAGE_EXPANSION()
-	debug_printf("\n");
+	TSHA_PROF_POP();
+	block_printf("\n");
 
 	for (j=0; j<W_SIZE_WORDS; j++)
 	{
 		if (j%4 == 0)
-			debug_printf("\n");
-		debug_printf("%08x ", W32[j]);
+			block_printf("\n");
+		block_printf("%08x ", W32[j]);
 	}
-	debug_printf("\n");
+	block_printf("\n");
 
+	TSHA_PROF_PUSH(TSHA_PROF_ROUNDS);
 	// init state
 	a = H0; b = H1; c = H2; d = H3;
 	e = H4; f = H5; g = H6; h = H7;
 
 	DO_MESSAGE_COMPRESSION()
 
-	debug_printf("\n");
-	debug_printf("Updating intermediate hash values\n");
+	block_printf("\n");
+	block_printf("Updating intermediate hash values\n");
 
-	debug_printf("hex values %d:\n", j-1);
+	block_printf("hex values %d:\n", j-1);
 	H0 = a + H0; H1 = b + H1; H2 = c + H2; H3 = d + H3;
 	H4 = e + H4; H5 = f + H5; H6 = g + H6; H7 = h + H7;
-	debug_printf("%08x%08x%08x%08x%08x%08x%08x%08x\n", a, b, c, d, e, f, g, h);
+	TSHA_PROF_POP();
+	block_printf("%08x%08x%08x%08x%08x%08x%08x%08x\n", a, b, c, d, e, f, g, h);
 
 
 #  ifdef DEBUG
-	debug_printf("\nDigest as in hex little endian:\n");
+	block_printf("\nDigest as in hex little endian:\n");
 	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
-		debug_printf("%08x", state->digest[i]);
-		debug_printf("\n");
+		block_printf("%08x", state->digest[i]);
+		block_printf("\n");
 #  endif
 
 	debug_printf("Called _tsha256hp_complete_message_block done\n");
@@ -399,13 +473,51 @@ DONE:
 
 	/* Process next message block. */
 	state->i_message = 0;
+	TSHA_PROF_PUSH(TSHA_PROF_CLEAR);
 	memset(state->W8, 0, MESSAGE_SIZE_BYTES);
+	TSHA_PROF_POP();
+
+	TSHA_STATS_ADD(TSHA_STATS_SHA256HP, blocks, 1);
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA256HP);
+	TSHA_PROBE(tsha256hp, block_end, state);
+}
+
+/* Places the 0x80 byte, the zero padding and the bit length behind the
+   bytes already in W8 and compresses the final block or two.	      */
+static void _tsha256hp_pad_and_complete(struct tsha256 *state)
+{
+	u64 len64;
+	u32 i;
+
+	debug_printf("Called _tsha256hp_pad_and_complete\n");
+	TSHA_PROF_PUSH(TSHA_PROF_FSM);
+
+	if (state->i_message >= MESSAGE_SIZE_BYTES)
+		_tsha256hp_complete_message_block(state);
+
+	/* The rest of W8 is already zero. */
+	state->W8[seq[state->i_message]] = (u8)0x80;
+	if (state->i_message >= MESSAGE_SIZE_BYTES - L_SIZE_BYTES)
+		_tsha256hp_complete_message_block(state);
+
+	len64 = state->msglen << 3; /* *8 */
+	for (i = 0; i < L_SIZE_BYTES; i++)
+		state->W8[seq2[i]] = ((u8*)&len64)[i];
+	_tsha256hp_complete_message_block(state);
+
+	state->event = TSHA256_FSM_COMPLETE;
+	TSHA_STATS_ADD(TSHA_STATS_SHA256HP, finals, 1);
+	TSHA_PROF_POP();
 }
 
 void tsha256hp_update(struct tsha256 *state, u32 finish)
 {
 	debug_printf("Called tsha256hp_update\n");
+	TSHA_PROBE(tsha256hp, update_start, state);
+	TSHA_PROF_PUSH(TSHA_PROF_FSM);
 
+	if (state->event == TSHA256_FSM_COMPLETE)
+		goto UPDATE_DONE;
 
 	if (finish == 1 || state->i_message >= MESSAGE_SIZE_BYTES)
 	{
@@ -414,7 +526,7 @@ void tsha256hp_update(struct tsha256 *state, u32 finish)
 	else
 	{
 		debug_printf("Message is NOT ready.\n");
-		return;
+		goto UPDATE_DONE;
 	}
 
 	debug_printf("state: %d\n", state->event);
@@ -469,7 +581,7 @@ void tsha256hp_update(struct tsha256 *state, u32 finish)
 	else if (state->event == TSHA256_FSM_APPEND_0_PADDING)
 	{
 		debug_printf("state->event == TSHA256_FSM_APPEND_0_PADDING\n");
-		if (state->i_message < 56) {
+		if (state->i_message <= 56) {
 			debug_printf("Filling padding to i=55\n");
 			state->event = TSHA256_FSM_APPEND_LENGTH;
 		} else {
@@ -483,7 +595,7 @@ void tsha256hp_update(struct tsha256 *state, u32 finish)
 	}
 	else if (state->event == TSHA256_FSM_APPEND_LENGTH) {
 		debug_printf("state->event == TSHA256_FSM_APPEND_LENGTH\n");
-		if (state->i_message < 56) {
+		if (state->i_message <= 56) {
 			/* space check: 56 = MESSAGE_SIZE_BYTES - L_SIZE_BYTES */
 			debug_printf("Message length:\n");
 			/* gets message length */
@@ -507,24 +619,85 @@ void tsha256hp_update(struct tsha256 *state, u32 finish)
 
 			debug_printf("state->event == TSHA256_FSM_COMPLETE\n");
 			state->event = TSHA256_FSM_COMPLETE;
+			TSHA_STATS_ADD(TSHA_STATS_SHA256HP, finals, 1);
 		} else {
-			debug_printf("Expected state->i_message < 56\n");
+			debug_printf("Expected state->i_message <= 56\n");
 			state->event = TSHA256_FSM_ERROR;
+			TSHA_STATS_ADD(TSHA_STATS_SHA256HP, errors, 1);
 		}
 	} else {
 		state->event = TSHA256_FSM_ERROR;
+		TSHA_STATS_ADD(TSHA_STATS_SHA256HP, errors, 1);
 	}
 
+UPDATE_DONE:
+	TSHA_PROF_POP();
+	TSHA_PROBE(tsha256hp, update_end, state);
 	return;
 }
 
+/* One-shot hash of msg into out.  Whole blocks are loaded into W32 a word
+   at a time with a byte swap, the tail goes through seq[], then the 0x80
+   byte, the zero padding and the bit length are placed and at most two
+   final blocks are compressed without stepping through the padding FSM.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256hp_digest(const u8 *msg, u64 len, u32 *out)
+{
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u32 *W32 = (u32*)state.W8;
+	u64 i = 0;
+	u32 j;
+	u32 w;
+
+	debug_printf("Called tsha256hp_digest\n");
+
+	if ((msg == NULL && len > 0) || out == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256HP, errors, 1);
+		return -EINVAL;
+	}
+
+	tsha256hp_reset(&state);
+
+	/* Body */
+	while (len - i >= MESSAGE_SIZE_BYTES)
+	{
+		TSHA_PROF_PUSH(TSHA_PROF_INSERT);
+		for (j = 0; j < MESSAGE_SIZE_WORDS; j++)
+		{
+			memcpy(&w, msg + i + j * WORD_SIZE_BYTES, WORD_SIZE_BYTES);
+			W32[j] = _bswap(w);
+		}
+		TSHA_PROF_POP();
+		i += MESSAGE_SIZE_BYTES;
+		_tsha256hp_complete_message_block(&state);
+	}
+
+	/* Tail, W8 is zero past it */
+	for (j = 0; i < len; i++, j++)
+		state.W8[seq[j]] = msg[i];
+	state.i_message = j;
+	state.msglen = len;
+	TSHA_STATS_ADD(TSHA_STATS_SHA256HP, bytes, len);
+	_tsha256hp_pad_and_complete(&state);
+
+	memcpy(out, state.digest, DIGEST_SIZE_BYTES);
+	tsha256hp_close(&state);
+
+	return 0;
+}
+
+/* Lets another program such as tsha-bench link this file. */
+#ifndef TSHA256HP_NO_MAIN
 s32 run_tests() {
 	u32 digest[DIGEST_SIZE_WORDS];
 	s32 ret = 0;
 	s32 failed = 0;
 	struct tsha256 __attribute__ ((aligned (16))) state;
 
-#	define NTESTS 4
+#	define NTESTS 6
 
 	struct TEST_CASES
 	{
@@ -567,6 +740,22 @@ s32 run_tests() {
 		     0x50b2654b, 0x4e88c69a, 0xdf86dfe7, 0xb1a71f40};
 	test_cases[3].expected_digest = t3;
 
+	u8 m4[1000];
+	memset(m4, 'a', sizeof(m4));
+	test_cases[4].description = "16 block, 1000 char message test";
+	test_cases[4].message = m4;
+	test_cases[4].bytes = sizeof(m4);
+	u32 t4[8] = {0x41edece4, 0x2d63e8d9, 0xbf515a9b, 0xa6932e1c,
+		     0x20cbc9f5, 0xa5d13464, 0x5adb5db1, 0xb9737ea3};
+	test_cases[4].expected_digest = t4;
+
+	test_cases[5].description = "1 block, 55 char message test";
+	test_cases[5].message = m4;
+	test_cases[5].bytes = 55;
+	u32 t5[8] = {0x9f4390f8, 0xd30c2dd9, 0x2ec9f095, 0xb65e2b9a,
+		     0xe9b0a925, 0xa5258e24, 0x1c9f1e91, 0x0f734318};
+	test_cases[5].expected_digest = t5;
+
 	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
 	{
 		debug_printf("#### start test ####\n");
@@ -633,6 +822,47 @@ s32 run_tests() {
 			debug_printf("Failed\n");
 		debug_printf("---\n");
 		failed |= result;
+
+		debug_printf("Known length path:\n");
+		tsha256hp_init_with_length(&state, bytes);
+		i = 0;
+		while (i < bytes)
+		{
+			s32 bytes_read = tsha256hp_getch(&state, message[i]);
+			if (bytes_read < 0)
+			{
+				tsha256hp_close(&state);
+				ret = -EINVAL;
+				goto ERROR;
+			}
+			i += bytes_read;
+		}
+		if (state.event != TSHA256_FSM_COMPLETE
+			|| tsha256hp_getch(&state, 0) != -EINVAL)
+			result = -1;
+		else
+			result = memcmp(expected_digest,
+				tsha256hp_get_hashcode(&state), DIGEST_SIZE_BYTES);
+		tsha256hp_close(&state);
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed\n");
+		failed |= result;
+
+		debug_printf("One-shot digest:\n");
+		if (tsha256hp_digest(message, bytes, digest) < 0)
+		{
+			ret = -EINVAL;
+			goto ERROR;
+		}
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed\n");
+		debug_printf("---\n");
+		failed |= result;
 		debug_printf("#### end test ####\n");
 	}
 
@@ -645,7 +875,6 @@ ERROR:
 
 s32 get_hash_argv(s32 argc, char *argv[])
 {
-	struct tsha256 __attribute__ ((aligned (16))) state;
 	s32 ret = 0;
 	u64 i;
 	s32 bytes;
@@ -653,48 +882,70 @@ s32 get_hash_argv(s32 argc, char *argv[])
 	if (argc)
 	if (argc == 2) {
 		bytes = strlen(argv[1]);
-		ret = tsha256hp_reset(&state);
+		ret = tsha256hp_digest(argv[1], bytes, digest);
+		if (ret < 0)
+			goto DONE_ARGV;
+		for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+			debug_printf("%04x", digest[i]);
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+#ifdef USE_PROF
+/* Streams count messages of bytes bytes through getch and update, the
+   path with every phase, and prints the breakdown.
+   usage: tsha256hp-prof [bytes [count]]				      */
+s32 run_profile(s32 argc, char *argv[])
+{
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u64 bytes = argc > 1 ? strtoull(argv[1], NULL, 0) : 65536;
+	u64 count = argc > 2 ? strtoull(argv[2], NULL, 0) : 256;
+	u8 *message;
+	u64 i, n;
+
+	message = malloc(bytes ? bytes : 1);
+	if (message == NULL)
+		return -ENOMEM;
+	for (i = 0; i < bytes; i++)
+		message[i] = i * 131 + 7;
+
+	tsha_prof_init();
+	for (n = 0; n < count; n++)
+	{
+		tsha256hp_reset(&state);
 		i = 0;
 		while (i < bytes)
 		{
-			s32 bytes_read = 0;
-			bytes_read = tsha256hp_getch(&state, argv[1][i]);
-			if (bytes_read < 0)
-			{
-				tsha256hp_close(&state);
-				ret = -EINVAL;
-				goto DONE_ARGV;
-			}
-
-			i += bytes_read;
-
+			i += tsha256hp_getch(&state, message[i]);
 			if (state.event == TSHA256_FSM_INPUT_UPDATE)
-				tsha256hp_update(&state,0);
+				tsha256hp_update(&state, 0);
 		}
 		do {
-			tsha256hp_update(&state,1);
+			tsha256hp_update(&state, 1);
 		} while (state.event != TSHA256_FSM_COMPLETE
 			&& state.event != TSHA256_FSM_ERROR);
-		u32 *hashcode = tsha256hp_get_hashcode(&state);
-		memcpy(digest, hashcode, DIGEST_SIZE_BYTES);
 		tsha256hp_close(&state);
-		for (i = 0; i < DIGEST_SIZE_WORDS; i++)
-			debug_printf("%04x", digest[i]);
 	}
+	tsha_prof_report("tsha256hp", bytes * count);
 
-DONE_ARGV:
-
-	return ret;
+	free(message);
+	return 0;
 }
+#endif // USE_PROF
 
 s32 main(s32 argc, char *argv[])
 {
 	s32 ret = 0;
-#ifdef DEBUG
+#ifdef USE_PROF
+	ret = run_profile(argc, argv);
+#elif defined(DEBUG)
 	ret = run_tests();
 #else
 	ret = get_hash_argv(argc, argv);
 #endif
 	return ret;
 }
-
+#endif // !TSHA256HP_NO_MAIN
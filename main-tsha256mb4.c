@@ -0,0 +1,495 @@
+/*
+ * tsha256mb4 - A 4 lane multi-buffer 256-bit Secure Hashing Algorithm 2 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+   Transposed multi-buffer version.  Four independent messages are hashed
+   at the same time, each one in its own 32-bit lane of every xmm register,
+   so the message expansion and the 64 rounds run on all four streams with
+   SSE2 shifts, ors and adds.
+
+   The messages may have different lengths.  A lane that has run out of
+   blocks still goes through the rounds with a zero block, but its result is
+   masked out of the chaining state.
+
+   The tests link tsha256r in as the reference.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef int s32;
+typedef unsigned long long int u64;
+typedef long long int s64;
+
+#include "tsha-stats.h"
+
+#define NLANES 4
+
+#define LSIZE_BYTES 8
+#define WSIZE_BYTES 4
+#define WSIZE_BITS 32
+
+#define NROUNDS 64
+#define MSIZE_BYTES 64 // 16 * WSIZE_BYTES:4
+#define MSIZE_WORDS 16
+#define NW 64
+
+#define DIGEST_SIZE_BYTES 32
+#define DIGEST_SIZE_WORDS 8
+
+static const u32 H_0[] = {
+	0x6a09e667,
+	0xbb67ae85,
+	0x3c6ef372,
+	0xa54ff53a,
+	0x510e527f,
+	0x9b05688c,
+	0x1f83d9ab,
+	0x5be0cd19
+};
+
+static const u32 K[] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786,	0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147,	0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b,	0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a,	0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* rotate right on each lane */
+#define ROTR4(v, amt) \
+	_mm_or_si128(_mm_srli_epi32(v, amt), _mm_slli_epi32(v, WSIZE_BITS - (amt)))
+
+#define XOR4(x, y, z) \
+	_mm_xor_si128(_mm_xor_si128(x, y), z)
+
+#define ADD4(w, x, y, z) \
+	_mm_add_epi32(_mm_add_epi32(w, x), _mm_add_epi32(y, z))
+
+#ifdef DEBUG
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+/* A plain memset of locals that are dead afterwards is dropped at -O2 and
+   up.  Calling it through a volatile pointer keeps the wipe. */
+static void *(*const volatile secure_memset)(void *, int, size_t) = memset;
+
+/* Number of blocks in the message after padding. */
+static u64 _tsha256mb4_nblocks(u64 len)
+{
+	return (len + 1 + LSIZE_BYTES + MSIZE_BYTES - 1) / MSIZE_BYTES;
+}
+
+/* Gets block i_block of the padded message as big endian words in W32.  The
+   0x80 byte, the zero padding and the bit length are filled in for the last
+   one or two blocks.						      */
+static void _tsha256mb4_get_block(const u8 *msg, u64 len, u64 i_block,
+	u32 *W32)
+{
+	u8 W8[MSIZE_BYTES];
+	u64 offset = i_block * MSIZE_BYTES;
+	u64 len64;
+	u32 j;
+
+	if (offset + MSIZE_BYTES <= len)
+	{
+		memcpy(W8, msg + offset, MSIZE_BYTES);
+	}
+	else
+	{
+		secure_memset(W8, 0, MSIZE_BYTES);
+		if (offset < len)
+			memcpy(W8, msg + offset, len - offset);
+		if (offset <= len)
+			W8[len - offset] = (u8)0x80;
+		if (i_block == _tsha256mb4_nblocks(len) - 1)
+		{
+			len64 = __builtin_bswap64(len*8);
+			memcpy(W8 + MSIZE_BYTES - LSIZE_BYTES, &len64,
+				LSIZE_BYTES);
+		}
+	}
+
+	for (j = 0; j < MSIZE_WORDS; j++)
+	{
+		memcpy(&W32[j], W8 + j * WSIZE_BYTES, WSIZE_BYTES);
+		W32[j] = _bswap(W32[j]);
+	}
+
+	/* Securely wipe sensitive data. */
+	secure_memset(W8, 0, MSIZE_BYTES);
+}
+
+/* Hashes four messages at once.  Lane k reads len[k] bytes from msg[k] and
+   writes its digest to out[k].
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256mb4_digest(const u8 *msg[NLANES], const u64 len[NLANES],
+	u32 *out[NLANES])
+{
+	__m128i W[NW];
+	__m128i H[DIGEST_SIZE_WORDS];
+	__m128i a, b, c, d, e, f, g, h;
+	__m128i sig0, sig1, Ch, Maj, SIG0, SIG1, T1, T2;
+	__m128i mask;
+	u32 W32[NLANES][MSIZE_WORDS];
+	u32 digest[NLANES];
+	u64 nblocks[NLANES];
+	u64 max_nblocks = 0;
+	u64 i_block;
+	u32 i, j, k;
+
+	dprintf("Called tsha256mb4_digest\n");
+
+	for (k = 0; k < NLANES; k++)
+	{
+		if ((msg[k] == NULL && len[k] > 0) || out[k] == NULL)
+		{
+			TSHA_STATS_ADD(TSHA_STATS_SHA256MB4, errors, 1);
+			return -EINVAL;
+		}
+		nblocks[k] = _tsha256mb4_nblocks(len[k]);
+		if (nblocks[k] > max_nblocks)
+			max_nblocks = nblocks[k];
+	}
+
+	TSHA_STATS_TSC_BEGIN();
+	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+		H[i] = _mm_set1_epi32(H_0[i]);
+
+	for (i_block = 0; i_block < max_nblocks; i_block++)
+	{
+		for (k = 0; k < NLANES; k++)
+		{
+			if (i_block < nblocks[k])
+				_tsha256mb4_get_block(msg[k], len[k], i_block,
+					W32[k]);
+			else
+				secure_memset(W32[k], 0, MSIZE_BYTES);
+		}
+
+		/* Transpose so that lane k of W[j] is word j of message k. */
+		for (j = 0; j < MSIZE_WORDS; j++)
+			W[j] = _mm_set_epi32(W32[3][j], W32[2][j], W32[1][j],
+				W32[0][j]);
+
+		/* All ones in the lanes that still have blocks. */
+		mask = _mm_set_epi32(
+			i_block < nblocks[3] ? -1 : 0,
+			i_block < nblocks[2] ? -1 : 0,
+			i_block < nblocks[1] ? -1 : 0,
+			i_block < nblocks[0] ? -1 : 0);
+
+		dprintf("Expanding message blocks\n");
+		for (j = 16; j < NROUNDS; j++)
+		{
+			sig0 = XOR4(ROTR4(W[j-15], 7),
+				    ROTR4(W[j-15], 18),
+				    _mm_srli_epi32(W[j-15], 3));
+			sig1 = XOR4(ROTR4(W[j-2], 17),
+				    ROTR4(W[j-2], 19),
+				    _mm_srli_epi32(W[j-2], 10));
+			W[j] = ADD4(W[j-16], sig0, W[j-7], sig1);
+		}
+
+		// init state
+		a = H[0]; b = H[1]; c = H[2]; d = H[3];
+		e = H[4]; f = H[5]; g = H[6]; h = H[7];
+
+		for (j = 0; j < NROUNDS; j++)
+		{
+			Ch = _mm_xor_si128(_mm_and_si128(e, f),
+				_mm_andnot_si128(e, g));
+			Maj = XOR4(_mm_and_si128(a, b), _mm_and_si128(a, c),
+				_mm_and_si128(b, c));
+			SIG0 = XOR4(ROTR4(a, 2), ROTR4(a, 13), ROTR4(a, 22));
+			SIG1 = XOR4(ROTR4(e, 6), ROTR4(e, 11), ROTR4(e, 25));
+			T1 = _mm_add_epi32(ADD4(h, SIG1, Ch,
+				_mm_set1_epi32(K[j])), W[j]);
+			T2 = _mm_add_epi32(SIG0, Maj);
+
+			h = g;
+			g = f;
+			f = e;
+			e = _mm_add_epi32(d, T1);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm_add_epi32(T1, T2);
+		}
+
+		dprintf("Updating intermediate hash values\n");
+		H[0] = _mm_add_epi32(H[0], _mm_and_si128(mask, a));
+		H[1] = _mm_add_epi32(H[1], _mm_and_si128(mask, b));
+		H[2] = _mm_add_epi32(H[2], _mm_and_si128(mask, c));
+		H[3] = _mm_add_epi32(H[3], _mm_and_si128(mask, d));
+		H[4] = _mm_add_epi32(H[4], _mm_and_si128(mask, e));
+		H[5] = _mm_add_epi32(H[5], _mm_and_si128(mask, f));
+		H[6] = _mm_add_epi32(H[6], _mm_and_si128(mask, g));
+		H[7] = _mm_add_epi32(H[7], _mm_and_si128(mask, h));
+	}
+
+	/* Transpose back into one digest per lane. */
+	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+	{
+		_mm_storeu_si128((__m128i*)digest, H[i]);
+		for (k = 0; k < NLANES; k++)
+			out[k][i] = digest[k];
+	}
+
+	/* Securely wipe sensitive data.  Especially if password is used as the
+	   message.							      */
+	secure_memset(W, 0, sizeof(W));
+	secure_memset(W32, 0, sizeof(W32));
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA256MB4);
+
+	for (k = 0; k < NLANES; k++)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256MB4, bytes, len[k]);
+		TSHA_STATS_ADD(TSHA_STATS_SHA256MB4, blocks, nblocks[k]);
+	}
+	TSHA_STATS_ADD(TSHA_STATS_SHA256MB4, finals, NLANES);
+
+	return 0;
+}
+
+/* Lets another program such as tsha-bench link this file. */
+#ifndef TSHA256MB4_NO_MAIN
+/* From main-tsha256r.c built with -DTSHA256R_NO_MAIN */
+s32 tsha256r_digest(const u8 *msg, u64 len, u32 *out);
+
+s32 run_tests() {
+	u32 digest[NLANES][DIGEST_SIZE_WORDS];
+	u32 expected[DIGEST_SIZE_WORDS];
+	s32 failed = 0;
+	s32 result;
+
+#	define NTESTS 6
+
+	struct TEST_CASES
+	{
+		const u8 *description;
+		const u8 *message;
+		u64 bytes;
+		u32 *expected_digest;
+	} test_cases[NTESTS];
+
+
+	test_cases[0].description = "Empty string test";
+	test_cases[0].message = "";
+	test_cases[0].bytes = 0;
+	u32 t0[8] = {0xe3b0c442, 0x98fc1c14, 0x9afbf4c8, 0x996fb924,
+		     0x27ae41e4, 0x649b934c, 0xa495991b, 0x7852b855};
+	test_cases[0].expected_digest = t0;
+
+	test_cases[1].description = "1 block, 3 char message test";
+	test_cases[1].message = "abc";
+	test_cases[1].bytes = 3;
+	u32 t1[8] = {0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+		     0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad};
+	test_cases[1].expected_digest = t1;
+
+	test_cases[2].description = "2 block, 56 char message test";
+	test_cases[2].message =
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	test_cases[2].bytes = 56;
+	u32 t2[8] = {0x248d6a61, 0xd20638b8, 0xe5c02693, 0x0c3e6039,
+		     0xa33ce459, 0x64ff2167, 0xf6ecedd4, 0x19db06c1};
+	test_cases[2].expected_digest = t2;
+
+	test_cases[3].description = "3 block, 128 char message test";
+	test_cases[3].message =
+		"abcdefghijabcdefghijabcdefghijababcdefghijabcdefghij"
+		"abcdefghijababcdefghijabcdefghijabcdefghijababcdefgh"
+		"ijabcdefghijabcdefghijab";
+	test_cases[3].bytes = 128;
+	u32 t3[8] = {0xc1a8e9a9, 0xd09f4a72, 0xa2ee2693, 0x8170d241,
+		     0x50b2654b, 0x4e88c69a, 0xdf86dfe7, 0xb1a71f40};
+	test_cases[3].expected_digest = t3;
+
+	u8 m4[1000];
+	memset(m4, 'a', sizeof(m4));
+	test_cases[4].description = "16 block, 1000 char message test";
+	test_cases[4].message = m4;
+	test_cases[4].bytes = sizeof(m4);
+	u32 t4[8] = {0x41edece4, 0x2d63e8d9, 0xbf515a9b, 0xa6932e1c,
+		     0x20cbc9f5, 0xa5d13464, 0x5adb5db1, 0xb9737ea3};
+	test_cases[4].expected_digest = t4;
+
+	test_cases[5].description = "1 block, 55 char message test";
+	test_cases[5].message = m4;
+	test_cases[5].bytes = 55;
+	u32 t5[8] = {0x9f4390f8, 0xd30c2dd9, 0x2ec9f095, 0xb65e2b9a,
+		     0xe9b0a925, 0xa5258e24, 0x1c9f1e91, 0x0f734318};
+	test_cases[5].expected_digest = t5;
+
+	/* Each test puts its vector in lane 0 and the next ones in the other
+	   lanes, so every vector runs in every lane next to messages of a
+	   different length. */
+	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
+	{
+		const u8 *message[NLANES];
+		u64 bytes[NLANES];
+		u32 *out[NLANES];
+		u32 i, k;
+
+		dprintf("#### start test ####\n");
+		dprintf("%s\n", test_cases[i_test].description);
+
+		for (k = 0; k < NLANES; k++)
+		{
+			message[k] = test_cases[(i_test + k) % NTESTS].message;
+			bytes[k] = test_cases[(i_test + k) % NTESTS].bytes;
+			out[k] = digest[k];
+		}
+
+		result = tsha256mb4_digest(message, bytes, out);
+		for (k = 0; k < NLANES && result == 0; k++)
+		{
+			dprintf("Lane %d digest as hex:\n", k);
+			for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+				dprintf("%08x", digest[k][i]);
+			dprintf("\n");
+
+			result |= memcmp(test_cases[(i_test + k) % NTESTS]
+				.expected_digest, digest[k], DIGEST_SIZE_BYTES);
+			tsha256r_digest(message[k], bytes[k], expected);
+			result |= memcmp(expected, digest[k], DIGEST_SIZE_BYTES);
+		}
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+		dprintf("#### end test ####\n");
+	}
+
+	dprintf("#### start test ####\n");
+	dprintf("Random lengths against tsha256r\n");
+	{
+		u8 buf[NLANES][300];
+		const u8 *message[NLANES];
+		u64 bytes[NLANES];
+		u32 *out[NLANES];
+		u32 i, k;
+
+		srand(1);
+		result = 0;
+		for (i = 0; i < 64 && result == 0; i++)
+		{
+			for (k = 0; k < NLANES; k++)
+			{
+				u32 n;
+				bytes[k] = rand() % sizeof(buf[k]);
+				for (n = 0; n < bytes[k]; n++)
+					buf[k][n] = rand();
+				message[k] = buf[k];
+				out[k] = digest[k];
+			}
+
+			result = tsha256mb4_digest(message, bytes, out);
+			for (k = 0; k < NLANES && result == 0; k++)
+			{
+				tsha256r_digest(message[k], bytes[k], expected);
+				result |= memcmp(expected, digest[k],
+					DIGEST_SIZE_BYTES);
+			}
+		}
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+	}
+	dprintf("#### end test ####\n");
+
+	return failed;
+}
+
+s32 get_hash_argv(s32 argc, char *argv[])
+{
+	const u8 *message[NLANES];
+	u64 bytes[NLANES];
+	u32 digest[NLANES][DIGEST_SIZE_WORDS];
+	u32 *out[NLANES];
+	s32 ret = 0;
+	u32 i, k;
+
+	/* Up to four arguments, one per lane.  Unused lanes hash "". */
+	for (k = 0; k < NLANES; k++)
+	{
+		message[k] = k + 1 < argc ? (const u8 *)argv[k + 1] : (const u8 *)"";
+		bytes[k] = strlen(message[k]);
+		out[k] = digest[k];
+	}
+
+	ret = tsha256mb4_digest(message, bytes, out);
+	if (ret < 0)
+		goto DONE_ARGV;
+
+	for (k = 0; k + 1 < argc && k < NLANES; k++)
+	{
+		for (i = 0; i < DIGEST_SIZE_WORDS ; i++)
+			dprintf("%08x", digest[k][i]);
+		dprintf("\n");
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+s32 main(s32 argc, char *argv[])
+{
+#ifdef DEBUG
+	return run_tests();
+#else
+	return get_hash_argv(argc, argv);
+#endif
+}
+#endif // !TSHA256MB4_NO_MAIN
@@ -0,0 +1,503 @@
+/*
+ * tsha256mb8 - An 8 lane multi-buffer 256-bit Secure Hashing Algorithm 2 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+   Multi-buffer scheduler for the 8 lane AVX2 kernel in tsha256mb8.S.
+
+   The caller hands over a queue of jobs.  Each lane takes the next job,
+   runs its whole blocks straight from the message, then its one or two
+   padded tail blocks from a per lane buffer.  The kernel is called with
+   the smallest number of blocks left among the busy lanes, so after every
+   call at least one lane is finished with its body or its tail.  Finished
+   lanes are retired and refilled from the queue right away.
+
+   Idle lanes at the end of the queue are pointed at the data of a busy lane
+   so that the kernel never reads out of bounds.  Their results are thrown
+   away.
+
+   The tests link tsha256r in as the reference.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef int s32;
+typedef unsigned long long int u64;
+typedef long long int s64;
+
+#include "tsha-stats.h"
+
+#define NLANES 8
+
+#define LSIZE_BYTES 8
+#define WSIZE_BYTES 4
+
+#define MSIZE_BYTES 64 // 16 * WSIZE_BYTES:4
+
+#define DIGEST_SIZE_BYTES 32
+#define DIGEST_SIZE_WORDS 8
+
+#define CPP_ASMLINKAGE
+#define asmlinkage CPP_ASMLINKAGE __attribute__((regparm(0)))
+
+static const u32 H_0[] = {
+	0x6a09e667,
+	0xbb67ae85,
+	0x3c6ef372,
+	0xa54ff53a,
+	0x510e527f,
+	0x9b05688c,
+	0x1f83d9ab,
+	0x5be0cd19
+};
+
+#ifdef DEBUG
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+/* A plain memset of locals that are dead afterwards is dropped at -O2 and
+   up.  Calling it through a volatile pointer keeps the wipe. */
+static void *(*const volatile secure_memset)(void *, int, size_t) = memset;
+
+struct tsha256mb8_job {
+	const u8 *message;
+	u64 bytes;
+	u32 *digest; // out, DIGEST_SIZE_WORDS
+};
+
+struct tsha256mb8_lane {
+	struct tsha256mb8_job *job; // NULL when idle
+	u64 nblocks; // blocks left before the next stage
+	u32 in_tail;
+	u32 ntail;
+	u8 tail[2 * MSIZE_BYTES];
+};
+
+struct tsha256mb8 {
+	u32 H[DIGEST_SIZE_WORDS][NLANES] __attribute__((aligned(32)));
+	const u8 *ptr[NLANES];
+	struct tsha256mb8_lane lane[NLANES];
+};
+
+asmlinkage void tsha256mb8_compress_blocks(u32 *H, const u8 **ptr,
+	u64 nblocks);
+
+/* Puts a job in lane k and builds its padded tail. */
+static void _tsha256mb8_start_lane(struct tsha256mb8 *mb, u32 k,
+	struct tsha256mb8_job *job)
+{
+	struct tsha256mb8_lane *lane = &mb->lane[k];
+	u64 nbody = job->bytes / MSIZE_BYTES;
+	u64 remaining = job->bytes % MSIZE_BYTES;
+	u64 len64;
+	u32 i;
+
+	dprintf("Starting lane %d with %llu bytes\n", k, job->bytes);
+
+	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+		mb->H[i][k] = H_0[i];
+
+	secure_memset(lane->tail, 0, sizeof(lane->tail));
+	if (remaining > 0)
+		memcpy(lane->tail, job->message + nbody * MSIZE_BYTES,
+			remaining);
+	lane->tail[remaining] = (u8)0x80;
+	lane->ntail = remaining + 1 + LSIZE_BYTES <= MSIZE_BYTES ? 1 : 2;
+	len64 = __builtin_bswap64(job->bytes*8);
+	memcpy(lane->tail + lane->ntail * MSIZE_BYTES - LSIZE_BYTES, &len64,
+		LSIZE_BYTES);
+
+	lane->job = job;
+	if (nbody > 0)
+	{
+		lane->in_tail = 0;
+		lane->nblocks = nbody;
+		mb->ptr[k] = job->message;
+	}
+	else
+	{
+		lane->in_tail = 1;
+		lane->nblocks = lane->ntail;
+		mb->ptr[k] = lane->tail;
+	}
+}
+
+/* Hands the digest of lane k back to its job and frees the lane. */
+static void _tsha256mb8_retire_lane(struct tsha256mb8 *mb, u32 k)
+{
+	struct tsha256mb8_lane *lane = &mb->lane[k];
+	u32 i;
+
+	dprintf("Retiring lane %d\n", k);
+
+	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+		lane->job->digest[i] = mb->H[i][k];
+
+	/* Securely wipe sensitive data. */
+	secure_memset(lane->tail, 0, sizeof(lane->tail));
+	lane->job = NULL;
+}
+
+/* Hashes every job in the queue.  The digest of jobs[i] is written to
+   jobs[i].digest.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256mb8_hash_jobs(struct tsha256mb8_job *jobs, u64 njobs)
+{
+	struct tsha256mb8 mb;
+	u64 next = 0;
+	u64 nblocks;
+	u32 busy;
+	u32 nbusy;
+	u32 k;
+
+	dprintf("Called tsha256mb8_hash_jobs\n");
+
+	if (!__builtin_cpu_supports("avx2"))
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256MB8, errors, 1);
+		return -ENOTSUP;
+	}
+
+	if (jobs == NULL && njobs > 0)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256MB8, errors, 1);
+		return -EINVAL;
+	}
+
+	for (next = 0; next < njobs; next++)
+		if ((jobs[next].message == NULL && jobs[next].bytes > 0)
+			|| jobs[next].digest == NULL)
+		{
+			TSHA_STATS_ADD(TSHA_STATS_SHA256MB8, errors, 1);
+			return -EINVAL;
+		}
+
+	memset(&mb, 0, sizeof(mb));
+
+	next = 0;
+	while (1)
+	{
+		/* Refill idle lanes and find the shortest stage left. */
+		busy = NLANES;
+		nbusy = 0;
+		nblocks = ~0ULL;
+		for (k = 0; k < NLANES; k++)
+		{
+			if (mb.lane[k].job == NULL && next < njobs)
+				_tsha256mb8_start_lane(&mb, k, &jobs[next++]);
+			if (mb.lane[k].job != NULL)
+			{
+				busy = k;
+				nbusy++;
+				if (mb.lane[k].nblocks < nblocks)
+					nblocks = mb.lane[k].nblocks;
+			}
+		}
+
+		if (busy == NLANES)
+			break;
+
+		for (k = 0; k < NLANES; k++)
+			if (mb.lane[k].job == NULL)
+				mb.ptr[k] = mb.ptr[busy];
+
+		{
+			TSHA_STATS_TSC_BEGIN();
+			tsha256mb8_compress_blocks(&mb.H[0][0], mb.ptr, nblocks);
+			TSHA_STATS_TSC_END(TSHA_STATS_SHA256MB8);
+		}
+		/* Idle lanes only repeat a busy one and are not counted. */
+		TSHA_STATS_ADD(TSHA_STATS_SHA256MB8, blocks, nblocks * nbusy);
+
+		for (k = 0; k < NLANES; k++)
+		{
+			struct tsha256mb8_lane *lane = &mb.lane[k];
+
+			if (lane->job == NULL)
+				continue;
+
+			lane->nblocks -= nblocks;
+			if (lane->nblocks > 0)
+				continue;
+
+			if (!lane->in_tail)
+			{
+				lane->in_tail = 1;
+				lane->nblocks = lane->ntail;
+				mb.ptr[k] = lane->tail;
+			}
+			else
+			{
+				TSHA_STATS_ADD(TSHA_STATS_SHA256MB8, bytes, lane->job->bytes);
+				TSHA_STATS_ADD(TSHA_STATS_SHA256MB8, finals, 1);
+				_tsha256mb8_retire_lane(&mb, k);
+			}
+		}
+	}
+
+	/* Securely wipe sensitive data. */
+	secure_memset(&mb, 0, sizeof(mb));
+
+	return 0;
+}
+
+/* Lets another program such as tsha-bench link this file. */
+#ifndef TSHA256MB8_NO_MAIN
+/* From main-tsha256r.c built with -DTSHA256R_NO_MAIN */
+s32 tsha256r_digest(const u8 *msg, u64 len, u32 *out);
+
+s32 run_tests() {
+	u32 expected[DIGEST_SIZE_WORDS];
+	s32 failed = 0;
+	s32 result;
+
+	if (!__builtin_cpu_supports("avx2"))
+	{
+		dprintf("AVX2 is not supported.  Skipping tests.\n");
+		return 0;
+	}
+
+#	define NTESTS 6
+
+	struct TEST_CASES
+	{
+		const u8 *description;
+		const u8 *message;
+		u64 bytes;
+		u32 *expected_digest;
+	} test_cases[NTESTS];
+
+
+	test_cases[0].description = "Empty string test";
+	test_cases[0].message = "";
+	test_cases[0].bytes = 0;
+	u32 t0[8] = {0xe3b0c442, 0x98fc1c14, 0x9afbf4c8, 0x996fb924,
+		     0x27ae41e4, 0x649b934c, 0xa495991b, 0x7852b855};
+	test_cases[0].expected_digest = t0;
+
+	test_cases[1].description = "1 block, 3 char message test";
+	test_cases[1].message = "abc";
+	test_cases[1].bytes = 3;
+	u32 t1[8] = {0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+		     0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad};
+	test_cases[1].expected_digest = t1;
+
+	test_cases[2].description = "2 block, 56 char message test";
+	test_cases[2].message =
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	test_cases[2].bytes = 56;
+	u32 t2[8] = {0x248d6a61, 0xd20638b8, 0xe5c02693, 0x0c3e6039,
+		     0xa33ce459, 0x64ff2167, 0xf6ecedd4, 0x19db06c1};
+	test_cases[2].expected_digest = t2;
+
+	test_cases[3].description = "3 block, 128 char message test";
+	test_cases[3].message =
+		"abcdefghijabcdefghijabcdefghijababcdefghijabcdefghij"
+		"abcdefghijababcdefghijabcdefghijabcdefghijababcdefgh"
+		"ijabcdefghijabcdefghijab";
+	test_cases[3].bytes = 128;
+	u32 t3[8] = {0xc1a8e9a9, 0xd09f4a72, 0xa2ee2693, 0x8170d241,
+		     0x50b2654b, 0x4e88c69a, 0xdf86dfe7, 0xb1a71f40};
+	test_cases[3].expected_digest = t3;
+
+	u8 m4[1000];
+	memset(m4, 'a', sizeof(m4));
+	test_cases[4].description = "16 block, 1000 char message test";
+	test_cases[4].message = m4;
+	test_cases[4].bytes = sizeof(m4);
+	u32 t4[8] = {0x41edece4, 0x2d63e8d9, 0xbf515a9b, 0xa6932e1c,
+		     0x20cbc9f5, 0xa5d13464, 0x5adb5db1, 0xb9737ea3};
+	test_cases[4].expected_digest = t4;
+
+	test_cases[5].description = "1 block, 55 char message test";
+	test_cases[5].message = m4;
+	test_cases[5].bytes = 55;
+	u32 t5[8] = {0x9f4390f8, 0xd30c2dd9, 0x2ec9f095, 0xb65e2b9a,
+		     0xe9b0a925, 0xa5258e24, 0x1c9f1e91, 0x0f734318};
+	test_cases[5].expected_digest = t5;
+
+	/* More jobs than lanes, so lanes are retired and refilled with
+	   messages of other lengths while their neighbours are mid message. */
+	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
+	{
+#		define NJOBS 19
+		struct tsha256mb8_job jobs[NJOBS];
+		u32 digest[NJOBS][DIGEST_SIZE_WORDS];
+		u32 i, k;
+
+		dprintf("#### start test ####\n");
+		dprintf("%s\n", test_cases[i_test].description);
+
+		for (k = 0; k < NJOBS; k++)
+		{
+			jobs[k].message = test_cases[(i_test + k) % NTESTS].message;
+			jobs[k].bytes = test_cases[(i_test + k) % NTESTS].bytes;
+			jobs[k].digest = digest[k];
+		}
+
+		result = tsha256mb8_hash_jobs(jobs, NJOBS);
+		for (k = 0; k < NJOBS && result == 0; k++)
+			result |= memcmp(test_cases[(i_test + k) % NTESTS]
+				.expected_digest, digest[k], DIGEST_SIZE_BYTES);
+
+		if (result == 0)
+		{
+			dprintf("Digest as hex:\n");
+			for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+				dprintf("%08x", digest[0][i]);
+			dprintf("\n");
+		}
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+		dprintf("#### end test ####\n");
+#		undef NJOBS
+	}
+
+	dprintf("#### start test ####\n");
+	dprintf("Fewer jobs than lanes\n");
+	{
+		struct tsha256mb8_job jobs[3];
+		u32 digest[3][DIGEST_SIZE_WORDS];
+		u32 k;
+
+		for (k = 0; k < 3; k++)
+		{
+			jobs[k].message = test_cases[k + 2].message;
+			jobs[k].bytes = test_cases[k + 2].bytes;
+			jobs[k].digest = digest[k];
+		}
+
+		result = tsha256mb8_hash_jobs(jobs, 3);
+		for (k = 0; k < 3 && result == 0; k++)
+			result |= memcmp(test_cases[k + 2].expected_digest,
+				digest[k], DIGEST_SIZE_BYTES);
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+	}
+	dprintf("#### end test ####\n");
+
+	dprintf("#### start test ####\n");
+	dprintf("Random 0-16 KiB lengths against tsha256r\n");
+	{
+#		define NJOBS 100
+#		define MAX_BYTES 16384
+		struct tsha256mb8_job jobs[NJOBS];
+		u32 digest[NJOBS][DIGEST_SIZE_WORDS];
+		u8 *buf = malloc(NJOBS * MAX_BYTES);
+		u32 k, n;
+
+		srand(1);
+		for (k = 0; k < NJOBS; k++)
+		{
+			jobs[k].message = buf + k * MAX_BYTES;
+			jobs[k].bytes = rand() % (MAX_BYTES + 1);
+			for (n = 0; n < jobs[k].bytes; n++)
+				buf[k * MAX_BYTES + n] = rand();
+			jobs[k].digest = digest[k];
+		}
+
+		result = tsha256mb8_hash_jobs(jobs, NJOBS);
+		for (k = 0; k < NJOBS && result == 0; k++)
+		{
+			tsha256r_digest(jobs[k].message, jobs[k].bytes,
+				expected);
+			result |= memcmp(expected, digest[k],
+				DIGEST_SIZE_BYTES);
+		}
+		free(buf);
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+#		undef MAX_BYTES
+#		undef NJOBS
+	}
+	dprintf("#### end test ####\n");
+
+	return failed;
+}
+
+s32 get_hash_argv(s32 argc, char *argv[])
+{
+	struct tsha256mb8_job jobs[argc > 1 ? argc - 1 : 1];
+	u32 digest[argc > 1 ? argc - 1 : 1][DIGEST_SIZE_WORDS];
+	s32 ret = 0;
+	s32 i, k;
+
+	/* One job per argument. */
+	for (k = 0; k + 1 < argc; k++)
+	{
+		jobs[k].message = (const u8 *)argv[k + 1];
+		jobs[k].bytes = strlen(argv[k + 1]);
+		jobs[k].digest = digest[k];
+	}
+
+	ret = tsha256mb8_hash_jobs(jobs, argc > 1 ? argc - 1 : 0);
+	if (ret < 0)
+		goto DONE_ARGV;
+
+	for (k = 0; k + 1 < argc; k++)
+	{
+		for (i = 0; i < DIGEST_SIZE_WORDS ; i++)
+			dprintf("%08x", digest[k][i]);
+		dprintf("\n");
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+s32 main(s32 argc, char *argv[])
+{
+#ifdef DEBUG
+	return run_tests();
+#else
+	return get_hash_argv(argc, argv);
+#endif
+}
+#endif // !TSHA256MB8_NO_MAIN
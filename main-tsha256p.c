@@ -0,0 +1,645 @@
+/*
+ * tsha256p - A portable 256-bit Secure Hashing Algorithm 2 implementation (C)
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/*
+   Portable C version.  It keeps the FSM interface of tsha256r, but the
+   compression function only uses locals so a compiler can keep a..h and
+   the 16 word rolling W window in registers:
+
+	- The rounds are unrolled 16 at a time by macros and the letters are
+	  renamed by argument order instead of being moved.
+	- W[j] is computed over W[j-16] right before round j, so W is one
+	  message block.
+	- Whole message blocks are loaded as big endian words straight from
+	  the caller's buffer.  Only a partial head or tail block is copied.
+
+   There are no intrinsics or inline assembly, so it is the fallback for
+   targets without the x86 register engines.
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef int s32;
+typedef unsigned long long int u64;
+typedef long long int s64;
+
+#include "tsha-stats.h"
+#include "tsha-probes.h"
+
+#define LSIZE_BYTES 8
+#define WSIZE_BYTES 4
+#define WSIZE_BITS 32
+
+#define NROUNDS 64
+#define MSIZE_BYTES 64 // 16 * WSIZE_BYTES:4
+
+#define DIGEST_SIZE_BITS 256
+#define DIGEST_SIZE_BYTES 32
+#define DIGEST_SIZE_WORDS 8
+
+#define TSHA256P_FSM_INPUT		0
+#define TSHA256P_FSM_INPUT_UPDATE	1
+#define TSHA256P_FSM_COMPLETE		5
+#define TSHA256P_FSM_ERROR		255
+
+/* For OOP */
+struct tsha256 {
+	u32 digest[DIGEST_SIZE_WORDS];
+	u64 msglen;
+	u32 i_message;
+	u32 event;
+
+	/* Partial message block in message order */
+	u8 M8[MSIZE_BYTES];
+};
+
+static const u32 H_0[] = {
+	0x6a09e667,
+	0xbb67ae85,
+	0x3c6ef372,
+	0xa54ff53a,
+	0x510e527f,
+	0x9b05688c,
+	0x1f83d9ab,
+	0x5be0cd19
+};
+
+static const u32 K[] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* gcc and clang turn these into ror and bswap or movbe. */
+#define ROTR(v, amt) ((v) >> (amt) | (v) << (WSIZE_BITS - (amt)))
+#define LOAD32_BE(p)								\
+	((u32)(p)[0] << 24 | (u32)(p)[1] << 16 | (u32)(p)[2] << 8 | (u32)(p)[3])
+
+#define SIG0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define SIG1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define sig0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define sig1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+#define Ch(e, f, g) ((((f) ^ (g)) & (e)) ^ (g))
+#define Maj(a, b, c) ((((a) | (b)) & (c)) | ((a) & (b)))
+
+/* W[k] for the first 16 rounds */
+#define W_LOAD(k) (W[k])
+/* W[j] written over W[j-16] for the other rounds.  k = j % 16 */
+#define W_EXPAND(k)								\
+	(W[k] += sig1(W[((k) - 2) & 15]) + W[((k) - 7) & 15]			\
+		+ sig0(W[((k) - 15) & 15]))
+
+/* j is the first round of the 16 and k a constant 0..15, so every W index
+   is a constant and W can live in registers. */
+#define ROUND(a, b, c, d, e, f, g, h, j, k, WK)				\
+	do {									\
+		T1 = (h) + SIG1(e) + Ch(e, f, g) + K[(j) + (k)] + WK(k);	\
+		(d) += T1;							\
+		(h) = T1 + SIG0(a) + Maj(a, b, c);				\
+	} while (0)
+
+#define ROUNDS16(j, WK)								\
+	do {									\
+		ROUND(a, b, c, d, e, f, g, h, j, 0, WK);			\
+		ROUND(h, a, b, c, d, e, f, g, j, 1, WK);			\
+		ROUND(g, h, a, b, c, d, e, f, j, 2, WK);			\
+		ROUND(f, g, h, a, b, c, d, e, j, 3, WK);			\
+		ROUND(e, f, g, h, a, b, c, d, j, 4, WK);			\
+		ROUND(d, e, f, g, h, a, b, c, j, 5, WK);			\
+		ROUND(c, d, e, f, g, h, a, b, j, 6, WK);			\
+		ROUND(b, c, d, e, f, g, h, a, j, 7, WK);			\
+		ROUND(a, b, c, d, e, f, g, h, j, 8, WK);			\
+		ROUND(h, a, b, c, d, e, f, g, j, 9, WK);			\
+		ROUND(g, h, a, b, c, d, e, f, j, 10, WK);			\
+		ROUND(f, g, h, a, b, c, d, e, j, 11, WK);			\
+		ROUND(e, f, g, h, a, b, c, d, j, 12, WK);			\
+		ROUND(d, e, f, g, h, a, b, c, j, 13, WK);			\
+		ROUND(c, d, e, f, g, h, a, b, j, 14, WK);			\
+		ROUND(b, c, d, e, f, g, h, a, j, 15, WK);			\
+	} while (0)
+
+#ifdef DEBUG
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+/* Still type checks the arguments so -Wall stays quiet. */
+#define dprintf(...) do { if (0) printf(__VA_ARGS__); } while (0)
+#endif
+
+/* A plain memset of locals that are dead afterwards is dropped at -O2 and
+   up.  Calling it through a volatile pointer keeps the wipe. */
+static void *(*const volatile secure_memset)(void *, int, size_t) = memset;
+
+/* Compresses nblocks whole message blocks at buf into state->digest. */
+static void _tsha256p_compress(struct tsha256 *state, const u8 *buf,
+	u64 nblocks)
+{
+	u32 *H = state->digest;
+	u32 a, b, c, d, e, f, g, h, T1;
+	u32 W[16];
+	u32 j;
+	TSHA_STATS_TSC_BEGIN();
+	TSHA_PROBE(tsha256p, block_start, state);
+
+	TSHA_STATS_ADD(TSHA_STATS_SHA256P, blocks, nblocks);
+
+	while (nblocks-- > 0)
+	{
+		for (j = 0; j < 16; j++)
+			W[j] = LOAD32_BE(buf + j * WSIZE_BYTES);
+
+		a = H[0]; b = H[1]; c = H[2]; d = H[3];
+		e = H[4]; f = H[5]; g = H[6]; h = H[7];
+
+		ROUNDS16(0, W_LOAD);
+		for (j = 16; j < NROUNDS; j += 16)
+			ROUNDS16(j, W_EXPAND);
+
+		H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+		H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+
+		buf += MSIZE_BYTES;
+	}
+
+	/* Securely wipe sensitive data. */
+	secure_memset(W, 0, sizeof(W));
+
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA256P);
+	TSHA_PROBE(tsha256p, block_end, state);
+}
+
+/* Places the 0x80 byte, the zero padding and the bit length behind the
+   bytes already in M8 and compresses the final block or two.	      */
+static void _tsha256p_pad_and_complete(struct tsha256 *state)
+{
+	u64 len64 = state->msglen * 8;
+	u32 i;
+
+	state->M8[state->i_message++] = 0x80;
+	if (state->i_message > MSIZE_BYTES - LSIZE_BYTES)
+	{
+		memset(state->M8 + state->i_message, 0,
+			MSIZE_BYTES - state->i_message);
+		_tsha256p_compress(state, state->M8, 1);
+		state->i_message = 0;
+	}
+	memset(state->M8 + state->i_message, 0,
+		MSIZE_BYTES - LSIZE_BYTES - state->i_message);
+	for (i = 0; i < LSIZE_BYTES; i++)
+		state->M8[MSIZE_BYTES - 1 - i] = (u8)(len64 >> (8 * i));
+	_tsha256p_compress(state, state->M8, 1);
+
+	state->i_message = 0;
+	secure_memset(state->M8, 0, MSIZE_BYTES);
+	state->event = TSHA256P_FSM_COMPLETE;
+	TSHA_STATS_ADD(TSHA_STATS_SHA256P, finals, 1);
+}
+
+u32 *tsha256p_get_hashcode(struct tsha256 *state)
+{
+	return state->digest;
+}
+
+s32 tsha256p_reset(struct tsha256 *state)
+{
+	if (state == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256P, errors, 1);
+		return -EINVAL;
+	}
+
+	secure_memset(state, 0, sizeof(struct tsha256));
+	memcpy(state->digest, H_0, DIGEST_SIZE_BYTES);
+	TSHA_PROBE(tsha256p, reset, state);
+
+	return 0;
+}
+
+void tsha256p_close(struct tsha256 *state)
+{
+	/* Securely wipe sensitive data.  Especially if password is used as the
+	   message.							      */
+	if (state != NULL)
+	{
+		TSHA_PROBE(tsha256p, close, state);
+		secure_memset(state, 0, sizeof(struct tsha256));
+	}
+}
+
+/* returns:
+	<0 - error
+	n - bytes read							      */
+s32 tsha256p_getch(struct tsha256 *state, u8 c)
+{
+	if (state == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256P, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->event != TSHA256P_FSM_INPUT)
+		return 0;
+
+	if (state->i_message < MSIZE_BYTES)
+	{
+		state->M8[state->i_message++] = c;
+		state->msglen++;
+		TSHA_STATS_ADD(TSHA_STATS_SHA256P, bytes, 1);
+		return 1;
+	}
+
+	state->event = TSHA256P_FSM_INPUT_UPDATE;
+	return 0;
+}
+
+/* Compresses a full message block and, with finish == 1, pads and
+   compresses the final block so state->event is TSHA256P_FSM_COMPLETE.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256p_update(struct tsha256 *state, u32 finish)
+{
+	if (state == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256P, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->event == TSHA256P_FSM_COMPLETE
+		|| state->event == TSHA256P_FSM_ERROR)
+		return 0;
+
+	TSHA_PROBE(tsha256p, update_start, state);
+
+	if (state->i_message == MSIZE_BYTES)
+	{
+		_tsha256p_compress(state, state->M8, 1);
+		state->i_message = 0;
+		state->event = TSHA256P_FSM_INPUT;
+	}
+
+	if (finish == 1)
+		_tsha256p_pad_and_complete(state);
+
+	TSHA_PROBE(tsha256p, update_end, state);
+	return 0;
+}
+
+/* Bulk reader.  Whole message blocks are compressed straight from buf.
+   Only a partial head or tail block is copied into M8.
+   returns:
+	<0 - error
+	n - bytes read							      */
+s64 tsha256p_write(struct tsha256 *state, const u8 *buf, u64 len)
+{
+	u64 i = 0;
+	u64 n;
+
+	if (state == NULL || (buf == NULL && len > 0))
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256P, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->event != TSHA256P_FSM_INPUT
+		&& state->event != TSHA256P_FSM_INPUT_UPDATE)
+		return 0;
+
+	TSHA_PROBE(tsha256p, write_start, state);
+
+	/* Head: top off the partially filled message block. */
+	if (state->i_message > 0)
+	{
+		n = MSIZE_BYTES - state->i_message;
+		if (n > len)
+			n = len;
+		memcpy(state->M8 + state->i_message, buf, n);
+		state->i_message += n;
+		i = n;
+		if (state->i_message == MSIZE_BYTES)
+		{
+			_tsha256p_compress(state, state->M8, 1);
+			state->i_message = 0;
+		}
+	}
+
+	/* Body */
+	n = (len - i) / MSIZE_BYTES;
+	if (n > 0)
+		_tsha256p_compress(state, buf + i, n);
+	i += n * MSIZE_BYTES;
+
+	/* Tail: buffered until the next write or the finish. */
+	memcpy(state->M8 + state->i_message, buf + i, len - i);
+	state->i_message += len - i;
+
+	state->msglen += len;
+	TSHA_STATS_ADD(TSHA_STATS_SHA256P, bytes, len);
+	state->event = TSHA256P_FSM_INPUT;
+
+	TSHA_PROBE(tsha256p, write_end, state);
+	return len;
+}
+
+/* One-shot hash of msg into out.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256p_digest(const u8 *msg, u64 len, u32 *out)
+{
+	struct tsha256 state;
+
+	if ((msg == NULL && len > 0) || out == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256P, errors, 1);
+		return -EINVAL;
+	}
+
+	tsha256p_reset(&state);
+	tsha256p_write(&state, msg, len);
+	tsha256p_update(&state, 1);
+
+	memcpy(out, state.digest, DIGEST_SIZE_BYTES);
+	tsha256p_close(&state);
+
+	return 0;
+}
+
+/* Lets another test program link this file. */
+#ifndef TSHA256P_NO_MAIN
+/* From main-tsha256r.c built with -DTSHA256R_NO_MAIN */
+s32 tsha256r_digest(const u8 *msg, u64 len, u32 *out);
+
+s32 run_tests() {
+	u32 digest[DIGEST_SIZE_WORDS];
+	s32 ret = 0;
+	s32 failed = 0;
+	struct tsha256 state;
+
+#	define NTESTS 6
+
+	struct TEST_CASES
+	{
+		const char *description;
+		const u8 *message;
+		u64 bytes;
+		u32 *expected_digest;
+	} test_cases[NTESTS];
+
+
+	test_cases[0].description = "Empty string test";
+	test_cases[0].message = (const u8 *)"";
+	test_cases[0].bytes = 0;
+	u32 t0[8] = {0xe3b0c442, 0x98fc1c14, 0x9afbf4c8, 0x996fb924,
+		     0x27ae41e4, 0x649b934c, 0xa495991b, 0x7852b855};
+	test_cases[0].expected_digest = t0;
+
+	test_cases[1].description = "1 block, 3 char message test";
+	test_cases[1].message = (const u8 *)"abc";
+	test_cases[1].bytes = 3;
+	u32 t1[8] = {0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+		     0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad};
+	test_cases[1].expected_digest = t1;
+
+	test_cases[2].description = "2 block, 56 char message test";
+	test_cases[2].message =
+		(const u8 *)"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	test_cases[2].bytes = 56;
+	u32 t2[8] = {0x248d6a61, 0xd20638b8, 0xe5c02693, 0x0c3e6039,
+		     0xa33ce459, 0x64ff2167, 0xf6ecedd4, 0x19db06c1};
+	test_cases[2].expected_digest = t2;
+
+	test_cases[3].description = "3 block, 128 char message test";
+	test_cases[3].message =
+		(const u8 *)"abcdefghijabcdefghijabcdefghijababcdefghijabcdefghij"
+		"abcdefghijababcdefghijabcdefghijabcdefghijababcdefgh"
+		"ijabcdefghijabcdefghijab";
+	test_cases[3].bytes = 128;
+	u32 t3[8] = {0xc1a8e9a9, 0xd09f4a72, 0xa2ee2693, 0x8170d241,
+		     0x50b2654b, 0x4e88c69a, 0xdf86dfe7, 0xb1a71f40};
+	test_cases[3].expected_digest = t3;
+
+	u8 m4[1000];
+	memset(m4, 'a', sizeof(m4));
+	test_cases[4].description = "16 block, 1000 char message test";
+	test_cases[4].message = m4;
+	test_cases[4].bytes = 1000;
+	u32 t4[8] = {0x41edece4, 0x2d63e8d9, 0xbf515a9b, 0xa6932e1c,
+		     0x20cbc9f5, 0xa5d13464, 0x5adb5db1, 0xb9737ea3};
+	test_cases[4].expected_digest = t4;
+
+	test_cases[5].description = "1 block, 55 char message test";
+	test_cases[5].message = m4;
+	test_cases[5].bytes = 55;
+	u32 t5[8] = {0x9f4390f8, 0xd30c2dd9, 0x2ec9f095, 0xb65e2b9a,
+		     0xe9b0a925, 0xa5258e24, 0x1c9f1e91, 0x0f734318};
+	test_cases[5].expected_digest = t5;
+
+	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
+	{
+		dprintf("#### start test ####\n");
+		const char *description = test_cases[i_test].description;
+		const u8 *message = test_cases[i_test].message;
+		const u32 *expected_digest = test_cases[i_test].expected_digest;
+		const u64 bytes = test_cases[i_test].bytes;
+		u64 i;
+		s32 result;
+
+		dprintf("%s\n",description);
+
+		tsha256p_reset(&state);
+
+		i = 0;
+		while (i < bytes)
+		{
+			s32 bytes_read = tsha256p_getch(&state, message[i]);
+			if (bytes_read < 0)
+			{
+				tsha256p_close(&state);
+				ret = -EINVAL;
+				goto DONE_RT;
+			}
+
+			i += bytes_read;
+
+			if (state.event == TSHA256P_FSM_INPUT_UPDATE)
+				tsha256p_update(&state, 0);
+		}
+		do {
+			tsha256p_update(&state, 1);
+		} while (state.event != TSHA256P_FSM_COMPLETE
+			&& state.event != TSHA256P_FSM_ERROR);
+		memcpy(digest, tsha256p_get_hashcode(&state), DIGEST_SIZE_BYTES);
+		tsha256p_close(&state);
+
+		dprintf("Digest as hex:\n");
+		for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+			dprintf("%08x", digest[i]);
+		dprintf("\n");
+
+		dprintf("Expected digest as hex:\n");
+		for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+			dprintf("%08x", expected_digest[i]);
+		dprintf("\n");
+
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+
+		dprintf("Bulk write path:\n");
+		tsha256p_reset(&state);
+		/* Split so that the head, body and tail paths all run. */
+		i = bytes > 0 ? 1 : 0;
+		if (tsha256p_write(&state, message, i) < 0
+			|| tsha256p_write(&state, message + i, bytes - i) < 0)
+		{
+			tsha256p_close(&state);
+			ret = -EINVAL;
+			goto DONE_RT;
+		}
+		tsha256p_update(&state, 1);
+		memcpy(digest, tsha256p_get_hashcode(&state), DIGEST_SIZE_BYTES);
+		tsha256p_close(&state);
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		failed |= result;
+
+		dprintf("One-shot digest:\n");
+		if (tsha256p_digest(message, bytes, digest) < 0)
+		{
+			ret = -EINVAL;
+			goto DONE_RT;
+		}
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+		dprintf("#### end test ####\n");
+	}
+
+	dprintf("#### start test ####\n");
+	dprintf("Random lengths against tsha256r\n");
+	{
+		static u8 buf[1 << 17];
+		u32 expected[DIGEST_SIZE_WORDS];
+		u64 bytes, i, n;
+		s32 result = 0;
+
+		srand(1);
+		for (n = 0; n < 16 && result == 0; n++)
+		{
+			bytes = rand() % sizeof(buf);
+			for (i = 0; i < bytes; i++)
+				buf[i] = rand();
+			tsha256r_digest(buf, bytes, expected);
+
+			/* Split at a random byte */
+			tsha256p_reset(&state);
+			i = bytes > 0 ? rand() % bytes : 0;
+			tsha256p_write(&state, buf, i);
+			tsha256p_write(&state, buf + i, bytes - i);
+			tsha256p_update(&state, 1);
+			result |= memcmp(expected, tsha256p_get_hashcode(&state),
+				DIGEST_SIZE_BYTES);
+			tsha256p_close(&state);
+		}
+		memset(buf, 0, sizeof(buf));
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+	}
+	dprintf("#### end test ####\n");
+
+DONE_RT:
+
+	return ret < 0 ? ret : failed;
+}
+
+s32 get_hash_argv(s32 argc, char *argv[])
+{
+	s32 ret = 0;
+	u64 i;
+	u64 bytes;
+	u32 digest[DIGEST_SIZE_WORDS];
+
+	if (argc == 2) {
+		bytes = strlen(argv[1]);
+		ret = tsha256p_digest((const u8 *)argv[1], bytes, digest);
+		if (ret < 0)
+			goto DONE_ARGV;
+		for (i = 0; i < DIGEST_SIZE_WORDS ; i++)
+			printf("%08x", digest[i]);
+		printf("\n");
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+s32 main(s32 argc, char *argv[])
+{
+#ifdef DEBUG
+	(void)argc;
+	(void)argv;
+	return run_tests();
+#else
+	return get_hash_argv(argc, argv);
+#endif
+}
+#endif // !TSHA256P_NO_MAIN
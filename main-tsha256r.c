@@ -45,8 +45,14 @@ typedef unsigned char u8;
 typedef unsigned int u32;
 typedef int s32;
 typedef unsigned long long int u64;
+typedef long long int s64;
 typedef unsigned __int128 u128;
 
+#include "tsha-prof.h"
+#include "tsha-stats.h"
+#include "tsha-probes.h"
+#include "tsha-trace.h"
+
 #define LSIZE_BYTES 8
 #define LSIZE_BITS 64
 #define WSIZE_BYTES 4
@@ -54,7 +60,16 @@ typedef unsigned __int128 u128;
 
 #define NROUNDS 64
 #define MSIZE_BYTES 64 // 16 * WSIZE_BYTES:4
-#define NW 64
+/* W is a rolling window of 16 words like the hybrid engines.  W[j+16] is
+   computed over W[j] right after round j.  Define USE_FULL_W to expand
+   all 64 words ahead of the rounds instead. */
+#ifdef USE_FULL_W
+#  define NW 64
+#else
+#  define W_ROLLING
+#  define NW 16
+#endif
+#define WI(j) ((j) & (NW - 1))
 
 #define DIGEST_SIZE_BITS 256
 #define DIGEST_SIZE_BYTES 32
@@ -104,13 +119,17 @@ struct tsha256 {
 	u8 m15[16];
 #endif
 
+	/* Set by tsha256r_init_with_length */
+	u64 total_msglen;
+	u32 has_total_msglen;
+
 	u32 A[DIGEST_SIZE_WORDS];
-	u8 W8[NW*WSIZE_BYTES]; /* 64 words * 4 bytes each = 256 bytes */
+	u8 W8[NW*WSIZE_BYTES]; /* 16 words * 4 bytes each = 64 bytes */
 	u32 sig0, sig1;
 	u32 Ch, Maj, SIG0, SIG1, T1, T2;
 };
 
-u32 H_0[] = {
+static u32 H_0[] = {
 	0x6a09e667,
 	0xbb67ae85,
 	0x3c6ef372,
@@ -121,7 +140,7 @@ u32 H_0[] = {
 	0x5be0cd19
 };
 
-u32 K[] = {
+static u32 K[] = {
 	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
 	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
 	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
@@ -142,7 +161,7 @@ u32 K[] = {
 
 // char[0] MSB when printing le u64
 // char[7] LSB when printing le u64
-u32 seq[] = {
+static u32 seq[] = {
 	3,  2,   1,  0,
 	7,  6,   5,  4,
 	11, 10,  9,  8,
@@ -161,7 +180,7 @@ u32 seq[] = {
 	63, 62, 61, 60
 };
 // End of sub-array index position: 56 57 58 59 60 61 62 63
-u32 seq2[] = {
+static u32 seq2[] = {
 	60, 61, 62, 63,
 	56, 57, 58, 59
 };
@@ -172,7 +191,7 @@ u32 seq2[] = {
 #define ROTR(v, amt) \
 	__rord(v, amt)
 #else
-u32 ROTR(const u32 v, const u32 amt)
+static u32 ROTR(const u32 v, const u32 amt)
 {
 	return v >> amt | v << (WSIZE_BITS - amt);
 }
@@ -184,6 +203,17 @@ u32 ROTR(const u32 v, const u32 amt)
 #define dprintf(...)
 #endif
 
+/* The block and round detail.  With USE_TRACE the rounds go to the
+   tsha-trace.h ring and tsha-trace-decode.py prints these lines instead. */
+#if defined(DEBUG) && !defined(USE_TRACE)
+#define bprintf(...) printf(__VA_ARGS__)
+#else
+#define bprintf(...)
+#endif
+
+s32 _tsha256r_complete_message_block(struct tsha256 *state);
+void _tsha256r_pad_and_complete(struct tsha256 *state);
+
 u32 *tsha256r_get_hashcode(struct tsha256 *state)
 {
 	return state->digest;
@@ -195,13 +225,30 @@ void tsha256r_reset(struct tsha256 *state)
 
 	dprintf("Init digest\n");
 	memcpy(state->digest, H_0, DIGEST_SIZE_BYTES);
+	TSHA_PROBE(tsha256r, reset, state);
+}
+
+/* Same as tsha256r_reset, but for a message of len bytes that is known up
+   front.  The padding and the length are placed and the final block is
+   compressed as soon as the last byte arrives, so state->event is
+   SHA256B_FSM_COMPLETE without any tsha256r_update polling.		      */
+void tsha256r_init_with_length(struct tsha256 *state, u64 len)
+{
+	tsha256r_reset(state);
+	state->total_msglen = len;
+	state->has_total_msglen = 1;
+	if (len == 0)
+		_tsha256r_pad_and_complete(state);
 }
 
 void tsha256r_close(struct tsha256 *state)
 {
 	/* Securely wipe sensitive data.  Especially if password is used as the
 	   message.							      */
+	TSHA_PROBE(tsha256r, close, state);
+	TSHA_PROF_PUSH(TSHA_PROF_CLEAR);
 	memset(state, 0, sizeof(struct tsha256));
+	TSHA_PROF_POP();
 }
 
 /* returns:
@@ -219,13 +266,31 @@ s32 tsha256r_getch(struct tsha256 *state, u8 c)
 	}
 
 	if (state->event != SHA256B_FSM_INPUT)
+	{
+		/* More bytes than given to tsha256r_init_with_length */
+		if (state->has_total_msglen)
+			ret = -EINVAL;
 		goto GETCH_DONE;
+	}
 
 	if (state->i_message < MSIZE_BYTES) {
+		TSHA_PROF_PUSH(TSHA_PROF_INSERT);
 		state->W8[seq[state->i_message]] = c;
 		state->i_message++;
 		state->msglen++;
+		TSHA_PROF_POP();
+		TSHA_STATS_ADD(TSHA_STATS_SHA256R, bytes, 1);
 		ret = 1;
+
+		/* With a known length there is no need to wait for the next
+		   byte or for the finish flag. */
+		if (state->has_total_msglen)
+		{
+			if (state->msglen == state->total_msglen)
+				_tsha256r_pad_and_complete(state);
+			else if (state->i_message == MSIZE_BYTES)
+				_tsha256r_complete_message_block(state);
+		}
 	} else {
 		state->event = SHA256B_FSM_INPUT_UPDATE;
 	}
@@ -240,6 +305,8 @@ s32 _tsha256r_complete_message_block(struct tsha256 *state) {
 	u32 *W32;
 
 	dprintf("Called _tsha256r_complete_message_block\n");
+	TSHA_PROBE(tsha256r, block_start, state);
+	TSHA_STATS_TSC_BEGIN();
 
 	W32 = (u32*)state->W8;
 
@@ -261,35 +328,46 @@ s32 _tsha256r_complete_message_block(struct tsha256 *state) {
 #	define H6 state->digest[6]
 #	define H7 state->digest[7]
 
+#	define EXPAND_W(j)							\
+	do {									\
+		state->sig0 =	  ROTR(W32[WI(j-15)], 7)			\
+				^ ROTR(W32[WI(j-15)], 18)			\
+				^ (W32[WI(j-15)]  >>  3);			\
+		state->sig1 = 	  ROTR(W32[WI(j-2)], 17)			\
+				^ ROTR(W32[WI(j-2)], 19)			\
+				^   (W32[WI(j-2)] >> 10);			\
+		W32[WI(j)] = W32[WI(j-16)]					\
+					+ state->sig0				\
+					+ W32[WI(j-7)]				\
+					+ state->sig1;				\
+	} while(0)
+
 #ifdef DEBUG
-	dprintf("Message contents of W32:\n");
+	bprintf("Message contents of W32:\n");
 	for (j = 0; j < 16 ; j++)
 	{
 		if (j % 8 == 0)
-			dprintf("\n");
-		dprintf("%08x ", W32[j]);
+			bprintf("\n");
+		bprintf("%08x ", W32[j]);
 	}
-	dprintf("\n");
+	bprintf("\n");
 #endif
 
-	dprintf("Expanding message blocks\n");
+#ifndef W_ROLLING
+	bprintf("Expanding message blocks\n");
+	TSHA_PROF_PUSH(TSHA_PROF_EXPANSION);
 	for (j = 16; j < NROUNDS; j++) {
-		state->sig0 =	  ROTR(W32[j-15], 7)
-				^ ROTR(W32[j-15], 18)
-				^ (W32[j-15]  >>  3);
-		state->sig1 = 	  ROTR(W32[j-2], 17)
-				^ ROTR(W32[j-2], 19)
-				^   (W32[j-2] >> 10);
-		W32[j] = W32[j-16]
-					+ state->sig0
-					+ W32[j-7]
-					+ state->sig1;
+		EXPAND_W(j);
 		if (j % 4 == 0)
-			dprintf("\n");
-		dprintf("%08x ", W32[j]);
+			bprintf("\n");
+		bprintf("%08x ", W32[j]);
 	}
-	dprintf("\n");
+	bprintf("\n");
+
+	TSHA_PROF_POP();
+#endif
 
+	TSHA_PROF_PUSH(TSHA_PROF_ROUNDS);
 	// init state
 	a = H0; b = H1; c = H2; d = H3;
 	e = H4; f = H5; g = H6; h = H7;
@@ -304,16 +382,18 @@ s32 _tsha256r_complete_message_block(struct tsha256 *state) {
 				+ state->SIG1
 				+ state->Ch
 				+ K[j]
-				+ W32[j];
+				+ W32[WI(j)];
 		state->T2   = state->SIG0 + state->Maj;
-		dprintf( "j-1=%d Ch=%08x Maj=%08x SIG0=%08x SIG1=%08x T1=%08x"
+		TSHA_TRACE_ROUND(TSHA_TRACE_SHA256R, j, a, b, c, d, e, f, g, h,
+			W32[WI(j)]);
+		bprintf( "j-1=%d Ch=%08x Maj=%08x SIG0=%08x SIG1=%08x T1=%08x"
 			" T2=%08x h=%08x K=%08x W32=%08x\n",
 			j-1, state->Ch, state->Maj, state->SIG0,
 			state->SIG1, state->T1, state->T2, h, K[j],
-			W32[j]);
+			W32[WI(j)]);
 
-		dprintf("Hex values %d:\n", j-1);
-		dprintf("%08x %08x %08x %08x %08x %08x %08x %08x\n",
+		bprintf("Hex values %d:\n", j-1);
+		bprintf("%08x %08x %08x %08x %08x %08x %08x %08x\n",
 			a, b, c, d, e, f, g, h);
 
 		h = g;
@@ -324,33 +404,157 @@ s32 _tsha256r_complete_message_block(struct tsha256 *state) {
 		c = b;
 		b = a;
 		a = state->T1 + state->T2;
+
+#ifdef W_ROLLING
+		/* W[j+16] overwrites W[j], which this round was the last to
+		   read.  Expanding it here rather than at the top of round j+16
+		   keeps the store off the next round's loads. */
+		if (j < NROUNDS - 16)
+		{
+			TSHA_PROF_SPLIT_BEGIN(TSHA_PROF_EXPANSION);
+			EXPAND_W(j + 16);
+			TSHA_PROF_SPLIT_END();
+		}
+#endif
 	}
 
-	dprintf("Updating intermediate hash values\n");
+	bprintf("Updating intermediate hash values\n");
 	H0 = a + H0; H1 = b + H1; H2 = c + H2; H3 = d + H3;
 	H4 = e + H4; H5 = f + H5; H6 = g + H6; H7 = h + H7;
+	TSHA_PROF_POP();
 
-	dprintf("hex values %d:\n", j-1);
-	dprintf("%08x %08x %08x %08x %08x %08x %08x %08x\n", a, b, c, d, e, f, g, h);
+	bprintf("hex values %d:\n", j-1);
+	bprintf("%08x %08x %08x %08x %08x %08x %08x %08x\n", a, b, c, d, e, f, g, h);
 
 #ifdef DEBUG
-	dprintf("\nDigest as in hex little endian:\n");
+	bprintf("\nDigest as in hex little endian:\n");
 	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
-		dprintf("%08x", state->digest[i]);
-		dprintf("\n");
+		bprintf("%08x", state->digest[i]);
+		bprintf("\n");
 #endif
 
 	dprintf("Called _tsha256r_complete_message_block done\n");
 
 	// process next
 	state->i_message = 0;
+	TSHA_PROF_PUSH(TSHA_PROF_CLEAR);
 	memset(state->W8, 0, MSIZE_BYTES);
+	TSHA_PROF_POP();
+
+	TSHA_STATS_ADD(TSHA_STATS_SHA256R, blocks, 1);
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA256R);
+	TSHA_PROBE(tsha256r, block_end, state);
+}
+
+/* Places the 0x80 byte, the zero padding and the bit length behind the
+   bytes already in W8 and compresses the final block or two.	      */
+void _tsha256r_pad_and_complete(struct tsha256 *state)
+{
+	u64 len64;
+	u32 i;
+
+	dprintf("Called _tsha256r_pad_and_complete\n");
+	TSHA_PROF_PUSH(TSHA_PROF_FSM);
+
+	if (state->i_message >= MSIZE_BYTES)
+		_tsha256r_complete_message_block(state);
+
+	/* The rest of W8 is already zero. */
+	state->W8[seq[state->i_message]] = (u8)0x80;
+	if (state->i_message >= MSIZE_BYTES - LSIZE_BYTES)
+		_tsha256r_complete_message_block(state);
+
+	len64 = state->msglen*8;
+	for (i = 0; i < LSIZE_BYTES; i++)
+		state->W8[seq2[i]] = ((u8*)&len64)[i];
+	_tsha256r_complete_message_block(state);
+
+	state->event = SHA256B_FSM_COMPLETE;
+	TSHA_STATS_ADD(TSHA_STATS_SHA256R, finals, 1);
+	TSHA_PROF_POP();
+}
+
+/* Bulk reader.  Whole message blocks are loaded directly from buf as big
+   endian words into W32 and compressed.  Only a partial head or tail block
+   goes through tsha256r_getch.
+   returns:
+	<0 - error
+	n - bytes read							      */
+s64 tsha256r_write(struct tsha256 *state, const u8 *buf, u64 len)
+{
+	u64 i = 0;
+	u32 j;
+	u32 *W32;
+	u32 w;
+
+	dprintf("Called tsha256r_write\n");
+
+	if (state == NULL || (buf == NULL && len > 0))
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256R, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->has_total_msglen
+		&& len > state->total_msglen - state->msglen)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256R, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->event != SHA256B_FSM_INPUT)
+		return 0;
+
+	TSHA_PROBE(tsha256r, write_start, state);
+
+	/* A full block left behind by tsha256r_getch. */
+	if (state->i_message >= MSIZE_BYTES)
+		_tsha256r_complete_message_block(state);
+
+	/* Head: top off the partially filled message block. */
+	while (state->i_message > 0 && i < len)
+	{
+		i += tsha256r_getch(state, buf[i]);
+		if (state->i_message >= MSIZE_BYTES)
+			_tsha256r_complete_message_block(state);
+	}
+
+	/* Body: whole blocks without the seq[] scatter. */
+	W32 = (u32*)state->W8;
+	while (len - i >= MSIZE_BYTES)
+	{
+		TSHA_PROF_PUSH(TSHA_PROF_INSERT);
+		for (j = 0; j < MSIZE_BYTES / WSIZE_BYTES; j++)
+		{
+			memcpy(&w, buf + i + j * WSIZE_BYTES, WSIZE_BYTES);
+			W32[j] = _bswap(w);
+		}
+		TSHA_PROF_POP();
+		state->msglen += MSIZE_BYTES;
+		TSHA_STATS_ADD(TSHA_STATS_SHA256R, bytes, MSIZE_BYTES);
+		i += MSIZE_BYTES;
+		_tsha256r_complete_message_block(state);
+		if (state->has_total_msglen
+			&& state->msglen == state->total_msglen)
+			_tsha256r_pad_and_complete(state);
+	}
+
+	/* Tail: buffered until the next write or the finish. */
+	while (i < len)
+		i += tsha256r_getch(state, buf[i]);
+
+	TSHA_PROBE(tsha256r, write_end, state);
+	return i;
 }
 
 s32 tsha256r_update(struct tsha256 *state, u32 finish)
 {
 	dprintf("Called tsha256r_update\n");
+	TSHA_PROBE(tsha256r, update_start, state);
+	TSHA_PROF_PUSH(TSHA_PROF_FSM);
 
+	if (state->event == SHA256B_FSM_COMPLETE)
+		goto UPDATE_DONE;
 
 	if (finish == 1 || state->i_message >= MSIZE_BYTES)
 	{
@@ -359,7 +563,7 @@ s32 tsha256r_update(struct tsha256 *state, u32 finish)
 	else
 	{
 		dprintf("Message is NOT ready.\n");
-		return 0;
+		goto UPDATE_DONE;
 	}
 
 
@@ -409,7 +613,7 @@ s32 tsha256r_update(struct tsha256 *state, u32 finish)
 	else if (state->event == SHA256B_FSM_APPEND_0_PADDING)
 	{
 		dprintf("state->event == SHA256B_FSM_APPEND_0_PADDING\n");
-		if (state->i_message < MSIZE_BYTES - LSIZE_BYTES) {
+		if (state->i_message <= MSIZE_BYTES - LSIZE_BYTES) {
 			dprintf("Filling padding to i=MSIZE_BYTES:64-LSIZE_BYTES:8-1=55\n");
 			state->event = SHA256B_FSM_APPEND_LENGTH;
 		} else {
@@ -423,7 +627,7 @@ s32 tsha256r_update(struct tsha256 *state, u32 finish)
 	}
 	else if (state->event == SHA256B_FSM_APPEND_LENGTH) {
 		dprintf("state->event == SHA256B_FSM_APPEND_LENGTH\n");
-		if (state->i_message < MSIZE_BYTES - LSIZE_BYTES) {
+		if (state->i_message <= MSIZE_BYTES - LSIZE_BYTES) {
 			/* space check: 56 = MSIZE_BYTES - LSIZE_BYTES */
 			dprintf("Message length:\n");
 			/* gets message length */
@@ -446,24 +650,139 @@ s32 tsha256r_update(struct tsha256 *state, u32 finish)
 
 			dprintf("state->event == SHA256B_FSM_COMPLETE\n");
 			state->event = SHA256B_FSM_COMPLETE;
+			TSHA_STATS_ADD(TSHA_STATS_SHA256R, finals, 1);
 		} else {
-			dprintf("Expected state->i_message < MSIZE_BYTES - LSIZE_BYTES\n");
+			dprintf("Expected state->i_message <= MSIZE_BYTES - LSIZE_BYTES\n");
 			state->event = SHA256B_FSM_ERROR;
+			TSHA_STATS_ADD(TSHA_STATS_SHA256R, errors, 1);
 		}
 	} else {
 		state->event = SHA256B_FSM_ERROR;
+		TSHA_STATS_ADD(TSHA_STATS_SHA256R, errors, 1);
 	}
 
+UPDATE_DONE:
+	TSHA_PROF_POP();
+	TSHA_PROBE(tsha256r, update_end, state);
 	return 0;
 }
 
+/* One-shot hash of msg into out.  The 0x80 byte, the zero padding and the
+   bit length are written into W8 in one step and at most two final blocks
+   are compressed without stepping through the padding FSM.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha256r_digest(const u8 *msg, u64 len, u32 *out)
+{
+	struct tsha256 state;
+
+	dprintf("Called tsha256r_digest\n");
+
+	if ((msg == NULL && len > 0) || out == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA256R, errors, 1);
+		return -EINVAL;
+	}
+
+	tsha256r_init_with_length(&state, len);
+	tsha256r_write(&state, msg, len);
+
+	memcpy(out, state.digest, DIGEST_SIZE_BYTES);
+	tsha256r_close(&state);
+
+	return 0;
+}
+
+/* Lets another test program link this file as its reference. */
+#ifndef TSHA256R_NO_MAIN
+#ifdef USE_STATS
+static void *stats_thread(void *arg)
+{
+	u32 digest[DIGEST_SIZE_WORDS];
+
+	tsha256r_digest(arg, 3, digest);
+	return NULL;
+}
+
+/* Counts from "abc" in this thread and in one that has exited, and the
+   error from a NULL message. */
+static s32 test_stats(void)
+{
+	struct tsha_stats before[TSHA_STATS_NENGINES];
+	struct tsha_stats after[TSHA_STATS_NENGINES];
+	struct tsha_stats *old = &before[TSHA_STATS_SHA256R];
+	struct tsha_stats *now = &after[TSHA_STATS_SHA256R];
+	u32 digest[DIGEST_SIZE_WORDS];
+	pthread_t thread;
+	s32 result = 0;
+
+	dprintf("Stats test:\n");
+	tsha_stats_snapshot(before);
+	tsha256r_digest((const u8 *)"abc", 3, digest);
+	tsha_stats_snapshot(after);
+	if (now->bytes - old->bytes != 3 || now->blocks - old->blocks != 1
+		|| now->finals - old->finals != 1 || now->errors != old->errors)
+		result = -1;
+
+	tsha_stats_snapshot(before);
+	if (pthread_create(&thread, NULL, stats_thread, "abc") != 0
+		|| pthread_join(thread, NULL) != 0)
+		result = -1;
+	tsha_stats_snapshot(after);
+	if (now->bytes - old->bytes != 3 || now->finals - old->finals != 1)
+		result = -1;
+
+	tsha_stats_snapshot(before);
+	if (tsha256r_digest(NULL, 1, digest) != -EINVAL)
+		result = -1;
+	tsha_stats_snapshot(after);
+	if (now->errors - old->errors != 1)
+		result = -1;
+
+	if (result == 0)
+		dprintf("Pass\n");
+	else
+		dprintf("Failed\n");
+	return result;
+}
+#endif // USE_STATS
+
+#ifdef USE_TRACE
+/* One block is 64 records with H_0 going in and the padded "abc" as the
+   first message word. */
+static s32 test_trace(void)
+{
+	u32 digest[DIGEST_SIZE_WORDS];
+	u64 head = tsha_trace_head;
+	struct tsha_trace_rec *r;
+	s32 result = 0;
+
+	dprintf("Trace test:\n");
+	tsha256r_digest((const u8 *)"abc", 3, digest);
+	if (tsha_trace_head - head != NROUNDS)
+		result = -1;
+	r = &tsha_trace_ring[head & (TSHA_TRACE_NRECS - 1)];
+	if (r->kind != TSHA_TRACE_ROUND_W || r->engine != TSHA_TRACE_SHA256R
+		|| r->j != 0 || memcmp(r->v, H_0, DIGEST_SIZE_BYTES) != 0
+		|| r->w != 0x61626380)
+		result = -1;
+
+	if (result == 0)
+		dprintf("Pass\n");
+	else
+		dprintf("Failed\n");
+	return result;
+}
+#endif // USE_TRACE
+
 s32 run_tests() {
 	u32 digest[DIGEST_SIZE_WORDS];
 	s32 ret = 0;
 	s32 failed = 0;
 	struct tsha256 __attribute__ ((aligned (16))) state;
 
-#	define NTESTS 4
+#	define NTESTS 6
 
 	struct TEST_CASES
 	{
@@ -506,6 +825,22 @@ s32 run_tests() {
 		     0x50b2654b, 0x4e88c69a, 0xdf86dfe7, 0xb1a71f40};
 	test_cases[3].expected_digest = t3;
 
+	u8 m4[1000];
+	memset(m4, 'a', sizeof(m4));
+	test_cases[4].description = "16 block, 1000 char message test";
+	test_cases[4].message = m4;
+	test_cases[4].bytes = 1000;
+	u32 t4[8] = {0x41edece4, 0x2d63e8d9, 0xbf515a9b, 0xa6932e1c,
+		     0x20cbc9f5, 0xa5d13464, 0x5adb5db1, 0xb9737ea3};
+	test_cases[4].expected_digest = t4;
+
+	test_cases[5].description = "1 block, 55 char message test";
+	test_cases[5].message = m4;
+	test_cases[5].bytes = 55;
+	u32 t5[8] = {0x9f4390f8, 0xd30c2dd9, 0x2ec9f095, 0xb65e2b9a,
+		     0xe9b0a925, 0xa5258e24, 0x1c9f1e91, 0x0f734318};
+	test_cases[5].expected_digest = t5;
+
 	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
 	{
 		dprintf("#### start test ####\n");
@@ -573,9 +908,81 @@ s32 run_tests() {
 			dprintf("Failed\n");
 		dprintf("---\n");
 		failed |= result;
+
+		dprintf("Bulk write path:\n");
+		tsha256r_reset(&state);
+		/* Split so that the head, body and tail paths all run. */
+		i = bytes > 0 ? 1 : 0;
+		if (tsha256r_write(&state, message, i) < 0
+			|| tsha256r_write(&state, message + i, bytes - i) < 0)
+		{
+			tsha256r_close(&state);
+			ret = -EINVAL;
+			goto DONE_RT;
+		}
+		do {
+			tsha256r_update(&state, 1);
+		} while (state.event != SHA256B_FSM_COMPLETE
+			&& state.event != SHA256B_FSM_ERROR);
+		memcpy(digest, tsha256r_get_hashcode(&state), DIGEST_SIZE_BYTES);
+		tsha256r_close(&state);
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		failed |= result;
+
+		dprintf("Known length path:\n");
+		tsha256r_init_with_length(&state, bytes);
+		i = 0;
+		while (i < bytes)
+		{
+			s32 bytes_read = tsha256r_getch(&state, message[i]);
+			if (bytes_read < 0)
+			{
+				tsha256r_close(&state);
+				ret = -EINVAL;
+				goto DONE_RT;
+			}
+			i += bytes_read;
+		}
+		if (state.event != SHA256B_FSM_COMPLETE
+			|| tsha256r_getch(&state, 0) != -EINVAL)
+			result = -1;
+		else
+			result = memcmp(expected_digest,
+				tsha256r_get_hashcode(&state), DIGEST_SIZE_BYTES);
+		tsha256r_close(&state);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		failed |= result;
+
+		dprintf("One-shot digest:\n");
+		if (tsha256r_digest(message, bytes, digest) < 0)
+		{
+			ret = -EINVAL;
+			goto DONE_RT;
+		}
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
 		dprintf("#### end test ####\n");
 	}
 
+#ifdef USE_STATS
+	failed |= test_stats();
+#endif // USE_STATS
+#ifdef USE_TRACE
+	failed |= test_trace();
+#endif // USE_TRACE
+
 DONE_RT:
 
 	return failed;
@@ -583,7 +990,6 @@ DONE_RT:
 
 s32 get_hash_argv(s32 argc, char *argv[])
 {
-	struct tsha256 __attribute__ ((aligned (16))) state;
 	s32 ret = 0;
 	u64 i;
 	s32 bytes;
@@ -591,44 +997,68 @@ s32 get_hash_argv(s32 argc, char *argv[])
 	if (argc)
 	if (argc == 2) {
 		bytes = strlen(argv[1]);
+		ret = tsha256r_digest(argv[1], bytes, digest);
+		if (ret < 0)
+			goto DONE_ARGV;
+		for (i = 0; i < DIGEST_SIZE_WORDS ; i++)
+			dprintf("%04x", digest[i]);
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+#ifdef USE_PROF
+/* Streams count messages of bytes bytes through getch and update, the
+   path with every phase, and prints the breakdown.
+   usage: tsha256r-prof [bytes [count]]				      */
+s32 run_profile(s32 argc, char *argv[])
+{
+	struct tsha256 __attribute__ ((aligned (16))) state;
+	u64 bytes = argc > 1 ? strtoull(argv[1], NULL, 0) : 65536;
+	u64 count = argc > 2 ? strtoull(argv[2], NULL, 0) : 256;
+	u8 *message;
+	u64 i, n;
+
+	message = malloc(bytes ? bytes : 1);
+	if (message == NULL)
+		return -ENOMEM;
+	for (i = 0; i < bytes; i++)
+		message[i] = i * 131 + 7;
+
+	tsha_prof_init();
+	for (n = 0; n < count; n++)
+	{
 		tsha256r_reset(&state);
 		i = 0;
 		while (i < bytes)
 		{
-			s32 bytes_read = 0;
-			bytes_read = tsha256r_getch(&state, argv[1][i]);
-			if (bytes_read < 0)
-			{
-				tsha256r_close(&state);
-				ret = -EINVAL;
-				goto DONE_ARGV;
-			}
-
-			i += bytes_read;
+			i += tsha256r_getch(&state, message[i]);
 			if (state.event == SHA256B_FSM_INPUT_UPDATE)
-				tsha256r_update(&state,0);
+				tsha256r_update(&state, 0);
 		}
 		do {
-			tsha256r_update(&state,1);
+			tsha256r_update(&state, 1);
 		} while (state.event != SHA256B_FSM_COMPLETE
 			&& state.event != SHA256B_FSM_ERROR);
-		u32 *hashcode = tsha256r_get_hashcode(&state);
-		memcpy(digest, hashcode, DIGEST_SIZE_BYTES);
 		tsha256r_close(&state);
-		for (i = 0; i < DIGEST_SIZE_WORDS ; i++)
-			dprintf("%04x", digest[i]);
 	}
+	tsha_prof_report("tsha256r", bytes * count);
 
-DONE_ARGV:
-
-	return ret;
+	free(message);
+	return 0;
 }
+#endif // USE_PROF
 
 s32 main(s32 argc, char *argv[])
 {
-#ifdef DEBUG
+#ifdef USE_PROF
+	return run_profile(argc, argv);
+#elif defined(DEBUG)
 	return run_tests();
 #else
 	get_hash_argv(argc, argv);
 #endif
 }
+#endif // !TSHA256R_NO_MAIN
@@ -1 +1,329 @@
+/*
+ * tsha512t256a - A register only implementation of SHA-512/256 in assembly
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
 
+/*
+   The message block is kept in ymm0-ymm3 and a..h in r8-r15.  Only a 16
+   word viewport of the expanded message is kept, which is the message
+   block itself, so the 80 words of SHA-512 never spill to memory.
+
+   It requires this to be adaptated in the kernel space to guarantee
+   non-preempted real-time execution in order for it to be effective so
+   that the AVX state does not get dumped into memory.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#define ALG_ASM
+
+#include "tsha512t256.h"
+#include "tsha512t256-asm.h"
+#include "tsha-stats.h"
+#ifdef USE_DISPATCH
+#  include "tsha512t256-dispatch.h"
+#endif // USE_DISPATCH
+
+#define DIGEST_SIZE_WORDS_TRUNCATED 4
+#define DIGEST_SIZE_BYTES_TRUNCATED 32
+
+#if defined(DEBUG)
+#  define debug_printf(format, ...)						\
+	do {									\
+		printf(format, ##__VA_ARGS__);					\
+	} while(0)
+#  else
+#    define debug_printf(format, ...)
+#endif // DEBUG
+
+/* One-shot hash of msg into out.  Whole blocks go through
+   tsha512t256a_write_blocks, the tail and padding through the per byte
+   reader.  Only the truncated DIGEST_SIZE_WORDS_TRUNCATED words are
+   written.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha512t256a_digest(const u8 *msg, u64 len, u64 *out)
+{
+	struct tsha512 __attribute__ ((aligned (16))) state;
+	u64 i = 0;
+	s64 ret;
+
+	if ((msg == NULL && len > 0) || out == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256A, errors, 1);
+		return -EINVAL;
+	}
+
+	TSHA_STATS_TSC_BEGIN();
+	ret = tsha512t256a_reset(&state);
+	/* Whole blocks are loaded and byte swapped in one go, only the tail
+	   goes through getch. */
+	if (ret >= 0)
+		ret = tsha512t256a_write_blocks(&state, msg,
+			len / MESSAGE_SIZE_BYTES);
+	if (ret >= 0)
+	{
+		i = ret;
+		/* The assembly counts the rest but not the bulk bytes. */
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256A, bytes, ret);
+	}
+	while (ret >= 0 && i < len)
+	{
+		ret = tsha512t256a_getch(&state, msg[i]);
+		if (ret < 0)
+			break;
+
+		i += ret;
+
+		if (state.event == SHA256T_FSM_INPUT_UPDATE)
+			ret = tsha512t256a_update(&state, 0);
+	}
+	while (ret >= 0 && state.event != SHA256T_FSM_COMPLETE
+		&& state.event != SHA256T_FSM_ERROR)
+		ret = tsha512t256a_update(&state, 1);
+	if (ret >= 0 && state.event == SHA256T_FSM_ERROR)
+		ret = -EINVAL;
+	if (ret >= 0)
+		memcpy(out, tsha512t256a_get_hashcode(&state),
+			DIGEST_SIZE_BYTES_TRUNCATED);
+	tsha512t256a_close(&state);
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA512T256A);
+
+	return ret < 0 ? ret : 0;
+}
+
+/* Lets another program such as tsha-bench link this file. */
+#ifndef TSHA512T256A_NO_MAIN
+s32 run_tests() {
+	u64 digest[DIGEST_SIZE_WORDS_TRUNCATED];
+	s32 ret = 0;
+	s32 failed = 0;
+	struct tsha512 __attribute__ ((aligned (16))) state;
+
+#	define NTESTS 9
+
+	struct TEST_CASES
+	{
+		const u8 *description;
+		const u8 *message;
+		u64 bytes;
+		u64 *expected_digest;
+	} test_cases[NTESTS];
+
+
+	test_cases[0].description = "Empty string test";
+	test_cases[0].message = "";
+	test_cases[0].bytes = 0;
+	u64 t0[8] = {0xc672b8d1ef56ed28, 0xab87c3622c511406,
+		     0x9bdd3ad7b8f97374, 0x98d0c01ecef0967a};
+	test_cases[0].expected_digest = t0;
+
+	test_cases[1].description = "1 block, 3 char message test";
+	test_cases[1].message = "abc";
+	test_cases[1].bytes = 3;
+	u64 t1[8] = {0x53048e2681941ef9, 0x9b2e29b76b4c7dab,
+		     0xe4c2d0c634fc6d46, 0xe0e2f13107e7af23};
+	test_cases[1].expected_digest = t1;
+
+	test_cases[2].description = "2 block, 112 char message test";
+	test_cases[2].message =
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghij"
+		"klmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrst"
+		"nopqrstu";
+	test_cases[2].bytes = 112;
+	u64 t2[8] = { 0x3928e184fb8690f8, 0x40da3988121d31be,
+		      0x65cb9d3ef83ee614, 0x6feac861e19b563a};
+	test_cases[2].expected_digest = t2;
+
+	u8 m3[1000];
+	memset(m3, 'a', sizeof(m3));
+	test_cases[3].description = "8 block, 1000 char message test";
+	test_cases[3].message = m3;
+	test_cases[3].bytes = sizeof(m3);
+	u64 t3[8] = { 0x40eb4a70d4d69815, 0x407a9e272f0101cd,
+		      0x67e3d11262a4a0bf, 0xc087712749c7fb53};
+	test_cases[3].expected_digest = t3;
+
+	test_cases[4].description = "1 block, 111 char message test";
+	test_cases[4].message = m3;
+	test_cases[4].bytes = 111;
+	u64 t4[8] = { 0x0239e429f98d0ed6, 0x1ee8e2a7c30afe98,
+		      0xc1c3a80ce5dff62a, 0x107e9c538f7632ce};
+	test_cases[4].expected_digest = t4;
+
+	test_cases[5].description = "1 block, 127 char message test";
+	test_cases[5].message = m3;
+	test_cases[5].bytes = 127;
+	u64 t5[8] = { 0x2fe3b2a6ee7e12f6, 0xfe4ba82166541ad9,
+		      0xb4ed882c493581cb, 0xe300d68f3757b778};
+	test_cases[5].expected_digest = t5;
+
+	test_cases[6].description = "2 block, 128 char message test";
+	test_cases[6].message = m3;
+	test_cases[6].bytes = 128;
+	u64 t6[8] = { 0xb88f97e274f9c1d4, 0x9f181c8cbd01a9c7,
+		      0x4930ad055a46ac44, 0x99a1d601f1c80bf2};
+	test_cases[6].expected_digest = t6;
+
+	test_cases[7].description = "2 block, 239 char message test";
+	test_cases[7].message = m3;
+	test_cases[7].bytes = 239;
+	u64 t7[8] = { 0x78d0a1b37aaad84c, 0x89fff13cbe3cd3d1,
+		      0x025bcdb648268f91, 0x02b7e7032bea7d2a};
+	test_cases[7].expected_digest = t7;
+
+	test_cases[8].description = "3 block, 240 char message test";
+	test_cases[8].message = m3;
+	test_cases[8].bytes = 240;
+	u64 t8[8] = { 0xd48a4d53397b38ab, 0x4e771d781c98ac6b,
+		      0x86712dff2a664cfd, 0x1f27c7ca40f8ce37};
+	test_cases[8].expected_digest = t8;
+
+#ifdef USE_DISPATCH
+	printf("Using the %s kernel\n", tsha512t256_kernel_name());
+#endif // USE_DISPATCH
+	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
+	{
+		debug_printf("#### start test ####\n");
+		const u8 *description = test_cases[i_test].description;
+		const u8 *message = test_cases[i_test].message;
+		const u64 *expected_digest = test_cases[i_test].expected_digest;
+		const u64 bytes = test_cases[i_test].bytes;
+		u64 i;
+
+		debug_printf("%s\n",description);
+
+		ret = tsha512t256a_reset(&state);
+
+		i = 0;
+		while (i < bytes)
+		{
+			s32 bytes_read = 0;
+			bytes_read = tsha512t256a_getch(&state, message[i]);
+			if (bytes_read < 0)
+			{
+				tsha512t256a_close(&state);
+				ret = -EINVAL;
+				goto ERROR;
+			}
+
+			i += bytes_read;
+
+			if (state.event == SHA256T_FSM_INPUT_UPDATE)
+				tsha512t256a_update(&state, 0);
+		}
+		do {
+			tsha512t256a_update(&state, 1);
+		} while (state.event != SHA256T_FSM_COMPLETE
+			&& state.event != SHA256T_FSM_ERROR);
+		u64 *hashcode = tsha512t256a_get_hashcode(&state);
+		memcpy(digest, hashcode, DIGEST_SIZE_BYTES_TRUNCATED);
+		tsha512t256a_close(&state);
+
+		debug_printf("Message as in characters: (len = %lld)\n", bytes);
+		for (i = 0; i < bytes; i++)
+			debug_printf("%c", message[i]);
+		debug_printf("\n");
+
+		debug_printf("Digest as hex:\n");
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED; i++)
+			debug_printf("%016llx", digest[i]);
+		debug_printf("\n");
+
+		debug_printf("Expected digest as hex:\n");
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED; i++)
+			debug_printf("%016llx", expected_digest[i]);
+		debug_printf("\n");
+
+		debug_printf("\n");
+		s32 result = memcmp(expected_digest, digest,
+			DIGEST_SIZE_BYTES_TRUNCATED);
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed\n");
+		debug_printf("---\n");
+		failed |= result;
+
+		debug_printf("One-shot digest:\n");
+		if (tsha512t256a_digest(message, bytes, digest) < 0)
+		{
+			ret = -EINVAL;
+			goto ERROR;
+		}
+		result = memcmp(expected_digest, digest,
+			DIGEST_SIZE_BYTES_TRUNCATED);
+		if (result == 0)
+			debug_printf("Pass\n");
+		else
+			debug_printf("Failed\n");
+		debug_printf("---\n");
+		failed |= result;
+		debug_printf("#### end test ####\n");
+	}
+
+	return failed;
+
+ERROR:
+	return ret;
+}
+
+s32 get_hash_argv(s32 argc, char *argv[])
+{
+	s32 ret = 0;
+	s64 i;
+	u64 bytes;
+	u64 digest[DIGEST_SIZE_WORDS_TRUNCATED];
+
+	if (argc == 2) {
+		bytes = strlen(argv[1]);
+		ret = tsha512t256a_digest(argv[1], bytes, digest);
+		if (ret < 0)
+			goto DONE_ARGV;
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED; i++)
+			debug_printf("%016llx", digest[i]);
+		debug_printf("\n");
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+s32 main(s32 argc, char *argv[])
+{
+	s32 ret = 0;
+#ifdef DEBUG
+	ret = run_tests();
+#else
+	ret = get_hash_argv(argc, argv);
+#endif
+
+	return ret;
+}
+#endif // !TSHA512T256A_NO_MAIN
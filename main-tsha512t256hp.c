@@ -502,7 +502,7 @@ void plain_sha256t_update(struct tsha512 *state, u64 finish)
 	else if (state->event == SHA256T_FSM_APPEND_0_PADDING)
 	{
 		debug_printf("state->event == SHA256T_FSM_APPEND_0_PADDING\n");
-		if (state->i_message < MESSAGE_SIZE_BYTES - L_SIZE_BYTES) {
+		if (state->i_message <= MESSAGE_SIZE_BYTES - L_SIZE_BYTES) {
 			// 112 = MESSAGE_SIZE_BYTES - L_SIZE_BYTES
 			debug_printf("Filling padding to i=111\n");
 			state->event = SHA256T_FSM_APPEND_LENGTH;
@@ -517,7 +517,7 @@ void plain_sha256t_update(struct tsha512 *state, u64 finish)
 	}
 	else if (state->event == SHA256T_FSM_APPEND_LENGTH) {
 		debug_printf("state->event == SHA256T_FSM_APPEND_LENGTH\n");
-		if (state->i_message < MESSAGE_SIZE_BYTES - L_SIZE_BYTES) {
+		if (state->i_message <= MESSAGE_SIZE_BYTES - L_SIZE_BYTES) {
 			/* space check: 112 = MESSAGE_SIZE_BYTES - L_SIZE_BYTES */
 			debug_printf("Message length:\n");
 			/* gets message length */
@@ -542,7 +542,7 @@ void plain_sha256t_update(struct tsha512 *state, u64 finish)
 			debug_printf("state->event == SHA256T_FSM_COMPLETE\n");
 			state->event = SHA256T_FSM_COMPLETE;
 		} else {
-			debug_printf("Expected state->i_message < 112\n");
+			debug_printf("Expected state->i_message <= 112\n");
 			state->event = SHA256T_FSM_ERROR;
 		}
 	} else {
@@ -0,0 +1,500 @@
+/*
+ * tsha512t256mb4 - A 4 lane multi-buffer SHA-512/256 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+   Multi-buffer scheduler for the 4 lane AVX2 kernel in tsha512t256mb4.S.
+
+   The caller hands over a queue of jobs.  Each lane takes the next job,
+   runs its whole blocks straight from the message, then its one or two
+   padded tail blocks from a per lane buffer.  The kernel is called with
+   the smallest number of blocks left among the busy lanes, so after every
+   call at least one lane is finished with its body or its tail.  Finished
+   lanes are retired and refilled from the queue right away.
+
+   Idle lanes at the end of the queue are pointed at the data of a busy lane
+   so that the kernel never reads out of bounds.  Their results are thrown
+   away.
+
+   Only the first 4 words of each lane are handed back, which is the
+   SHA-512/256 truncation.
+
+   The tests link tsha512t256r in as the reference.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef int s32;
+typedef unsigned long long int u64;
+typedef long long int s64;
+
+#include "tsha-stats.h"
+
+#define NLANES 4
+
+#define LSIZE_BYTES 16
+#define WSIZE_BYTES 8
+
+#define MSIZE_BYTES 128 // 16 * WSIZE_BYTES:8
+
+#define DIGEST_SIZE_WORDS 8
+#define DIGEST_SIZE_BYTES_TRUNCATED 32
+#define DIGEST_SIZE_WORDS_TRUNCATED 4
+
+#define CPP_ASMLINKAGE
+#define asmlinkage CPP_ASMLINKAGE __attribute__((regparm(0)))
+
+static const u64 H_0[] = {
+	0x22312194fc2bf72c,
+	0x9f555fa3c84c64c2,
+	0x2393b86b6f53b151,
+	0x963877195940eabd,
+	0x96283ee2a88effe3,
+	0xbe5e1e2553863992,
+	0x2b0199fc2c85b8aa,
+	0x0eb72ddc81c52ca2
+};
+
+#ifdef DEBUG
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+#define dprintf(...)
+#endif
+
+/* A plain memset of locals that are dead afterwards is dropped at -O2 and
+   up.  Calling it through a volatile pointer keeps the wipe. */
+static void *(*const volatile secure_memset)(void *, int, size_t) = memset;
+
+struct tsha512t256mb4_job {
+	const u8 *message;
+	u64 bytes;
+	u64 *digest; // out, DIGEST_SIZE_WORDS_TRUNCATED
+};
+
+struct tsha512t256mb4_lane {
+	struct tsha512t256mb4_job *job; // NULL when idle
+	u64 nblocks; // blocks left before the next stage
+	u32 in_tail;
+	u32 ntail;
+	u8 tail[2 * MSIZE_BYTES];
+};
+
+struct tsha512t256mb4 {
+	u64 H[DIGEST_SIZE_WORDS][NLANES] __attribute__((aligned(32)));
+	const u8 *ptr[NLANES];
+	struct tsha512t256mb4_lane lane[NLANES];
+};
+
+asmlinkage void tsha512t256mb4_compress_blocks(u64 *H, const u8 **ptr,
+	u64 nblocks);
+
+/* Puts a job in lane k and builds its padded tail. */
+static void _tsha512t256mb4_start_lane(struct tsha512t256mb4 *mb, u32 k,
+	struct tsha512t256mb4_job *job)
+{
+	struct tsha512t256mb4_lane *lane = &mb->lane[k];
+	u64 nbody = job->bytes / MSIZE_BYTES;
+	u64 remaining = job->bytes % MSIZE_BYTES;
+	u64 len64;
+	u32 i;
+
+	dprintf("Starting lane %d with %llu bytes\n", k, job->bytes);
+
+	for (i = 0; i < DIGEST_SIZE_WORDS; i++)
+		mb->H[i][k] = H_0[i];
+
+	secure_memset(lane->tail, 0, sizeof(lane->tail));
+	if (remaining > 0)
+		memcpy(lane->tail, job->message + nbody * MSIZE_BYTES,
+			remaining);
+	lane->tail[remaining] = (u8)0x80;
+	lane->ntail = remaining + 1 + LSIZE_BYTES <= MSIZE_BYTES ? 1 : 2;
+	/* The upper 64 bits of the 128 bit length stay zero. */
+	len64 = __builtin_bswap64(job->bytes*8);
+	memcpy(lane->tail + lane->ntail * MSIZE_BYTES - sizeof(len64), &len64,
+		sizeof(len64));
+
+	lane->job = job;
+	if (nbody > 0)
+	{
+		lane->in_tail = 0;
+		lane->nblocks = nbody;
+		mb->ptr[k] = job->message;
+	}
+	else
+	{
+		lane->in_tail = 1;
+		lane->nblocks = lane->ntail;
+		mb->ptr[k] = lane->tail;
+	}
+}
+
+/* Hands the digest of lane k back to its job and frees the lane. */
+static void _tsha512t256mb4_retire_lane(struct tsha512t256mb4 *mb, u32 k)
+{
+	struct tsha512t256mb4_lane *lane = &mb->lane[k];
+	u32 i;
+
+	dprintf("Retiring lane %d\n", k);
+
+	for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED; i++)
+		lane->job->digest[i] = mb->H[i][k];
+
+	/* Securely wipe sensitive data. */
+	secure_memset(lane->tail, 0, sizeof(lane->tail));
+	lane->job = NULL;
+}
+
+/* Hashes every job in the queue.  The digest of jobs[i] is written to
+   jobs[i].digest.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha512t256mb4_hash_jobs(struct tsha512t256mb4_job *jobs, u64 njobs)
+{
+	struct tsha512t256mb4 mb;
+	u64 next = 0;
+	u64 nblocks;
+	u32 busy;
+	u32 nbusy;
+	u32 k;
+
+	dprintf("Called tsha512t256mb4_hash_jobs\n");
+
+	if (!__builtin_cpu_supports("avx2"))
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256MB4, errors, 1);
+		return -ENOTSUP;
+	}
+
+	if (jobs == NULL && njobs > 0)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256MB4, errors, 1);
+		return -EINVAL;
+	}
+
+	for (next = 0; next < njobs; next++)
+		if ((jobs[next].message == NULL && jobs[next].bytes > 0)
+			|| jobs[next].digest == NULL)
+		{
+			TSHA_STATS_ADD(TSHA_STATS_SHA512T256MB4, errors, 1);
+			return -EINVAL;
+		}
+
+	memset(&mb, 0, sizeof(mb));
+
+	next = 0;
+	while (1)
+	{
+		/* Refill idle lanes and find the shortest stage left. */
+		busy = NLANES;
+		nbusy = 0;
+		nblocks = ~0ULL;
+		for (k = 0; k < NLANES; k++)
+		{
+			if (mb.lane[k].job == NULL && next < njobs)
+				_tsha512t256mb4_start_lane(&mb, k, &jobs[next++]);
+			if (mb.lane[k].job != NULL)
+			{
+				busy = k;
+				nbusy++;
+				if (mb.lane[k].nblocks < nblocks)
+					nblocks = mb.lane[k].nblocks;
+			}
+		}
+
+		if (busy == NLANES)
+			break;
+
+		for (k = 0; k < NLANES; k++)
+			if (mb.lane[k].job == NULL)
+				mb.ptr[k] = mb.ptr[busy];
+
+		{
+			TSHA_STATS_TSC_BEGIN();
+			tsha512t256mb4_compress_blocks(&mb.H[0][0], mb.ptr, nblocks);
+			TSHA_STATS_TSC_END(TSHA_STATS_SHA512T256MB4);
+		}
+		/* Idle lanes only repeat a busy one and are not counted. */
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256MB4, blocks, nblocks * nbusy);
+
+		for (k = 0; k < NLANES; k++)
+		{
+			struct tsha512t256mb4_lane *lane = &mb.lane[k];
+
+			if (lane->job == NULL)
+				continue;
+
+			lane->nblocks -= nblocks;
+			if (lane->nblocks > 0)
+				continue;
+
+			if (!lane->in_tail)
+			{
+				lane->in_tail = 1;
+				lane->nblocks = lane->ntail;
+				mb.ptr[k] = lane->tail;
+			}
+			else
+			{
+				TSHA_STATS_ADD(TSHA_STATS_SHA512T256MB4, bytes, lane->job->bytes);
+				TSHA_STATS_ADD(TSHA_STATS_SHA512T256MB4, finals, 1);
+				_tsha512t256mb4_retire_lane(&mb, k);
+			}
+		}
+	}
+
+	/* Securely wipe sensitive data. */
+	secure_memset(&mb, 0, sizeof(mb));
+
+	return 0;
+}
+
+/* Lets another program such as tsha-bench link this file. */
+#ifndef TSHA512T256MB4_NO_MAIN
+/* From main-tsha512t256r.c built with -DTSHA512T256R_NO_MAIN */
+s32 plain_sha512t256_digest(const u8 *msg, u64 len, u64 *out);
+
+s32 run_tests() {
+	u64 expected[DIGEST_SIZE_WORDS_TRUNCATED];
+	s32 failed = 0;
+	s32 result;
+
+	if (!__builtin_cpu_supports("avx2"))
+	{
+		dprintf("AVX2 is not supported.  Skipping tests.\n");
+		return 0;
+	}
+
+#	define NTESTS 5
+
+	struct TEST_CASES
+	{
+		const u8 *description;
+		const u8 *message;
+		u64 bytes;
+		u64 *expected_digest;
+	} test_cases[NTESTS];
+
+
+	test_cases[0].description = "Empty string test";
+	test_cases[0].message = "";
+	test_cases[0].bytes = 0;
+	u64 t0[4] = {0xc672b8d1ef56ed28, 0xab87c3622c511406,
+		     0x9bdd3ad7b8f97374, 0x98d0c01ecef0967a};
+	test_cases[0].expected_digest = t0;
+
+	test_cases[1].description = "1 block, 3 char message test";
+	test_cases[1].message = "abc";
+	test_cases[1].bytes = 3;
+	u64 t1[4] = {0x53048e2681941ef9, 0x9b2e29b76b4c7dab,
+		     0xe4c2d0c634fc6d46, 0xe0e2f13107e7af23};
+	test_cases[1].expected_digest = t1;
+
+	test_cases[2].description = "2 block, 112 char message test";
+	test_cases[2].message =
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghij"
+		"klmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrst"
+		"nopqrstu";
+	test_cases[2].bytes = 112;
+	u64 t2[4] = { 0x3928e184fb8690f8, 0x40da3988121d31be,
+		      0x65cb9d3ef83ee614, 0x6feac861e19b563a};
+	test_cases[2].expected_digest = t2;
+
+	u8 m3[1000];
+	memset(m3, 'a', sizeof(m3));
+	test_cases[3].description = "8 block, 1000 char message test";
+	test_cases[3].message = m3;
+	test_cases[3].bytes = sizeof(m3);
+	u64 t3[4] = { 0x40eb4a70d4d69815, 0x407a9e272f0101cd,
+		      0x67e3d11262a4a0bf, 0xc087712749c7fb53};
+	test_cases[3].expected_digest = t3;
+
+	test_cases[4].description = "1 block, 111 char message test";
+	test_cases[4].message = m3;
+	test_cases[4].bytes = 111;
+	u64 t4[4] = { 0x0239e429f98d0ed6, 0x1ee8e2a7c30afe98,
+		      0xc1c3a80ce5dff62a, 0x107e9c538f7632ce};
+	test_cases[4].expected_digest = t4;
+
+	/* More jobs than lanes, so lanes are retired and refilled with
+	   messages of other lengths while their neighbours are mid message. */
+	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
+	{
+#		define NJOBS 19
+		struct tsha512t256mb4_job jobs[NJOBS];
+		u64 digest[NJOBS][DIGEST_SIZE_WORDS_TRUNCATED];
+		u32 i, k;
+
+		dprintf("#### start test ####\n");
+		dprintf("%s\n", test_cases[i_test].description);
+
+		for (k = 0; k < NJOBS; k++)
+		{
+			jobs[k].message = test_cases[(i_test + k) % NTESTS].message;
+			jobs[k].bytes = test_cases[(i_test + k) % NTESTS].bytes;
+			jobs[k].digest = digest[k];
+		}
+
+		result = tsha512t256mb4_hash_jobs(jobs, NJOBS);
+		for (k = 0; k < NJOBS && result == 0; k++)
+			result |= memcmp(test_cases[(i_test + k) % NTESTS]
+				.expected_digest, digest[k], DIGEST_SIZE_BYTES_TRUNCATED);
+
+		if (result == 0)
+		{
+			dprintf("Digest as hex:\n");
+			for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED; i++)
+				dprintf("%016llx", digest[0][i]);
+			dprintf("\n");
+		}
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+		dprintf("#### end test ####\n");
+#		undef NJOBS
+	}
+
+	dprintf("#### start test ####\n");
+	dprintf("Fewer jobs than lanes\n");
+	{
+		struct tsha512t256mb4_job jobs[3];
+		u64 digest[3][DIGEST_SIZE_WORDS_TRUNCATED];
+		u32 k;
+
+		for (k = 0; k < 3; k++)
+		{
+			jobs[k].message = test_cases[k + 1].message;
+			jobs[k].bytes = test_cases[k + 1].bytes;
+			jobs[k].digest = digest[k];
+		}
+
+		result = tsha512t256mb4_hash_jobs(jobs, 3);
+		for (k = 0; k < 3 && result == 0; k++)
+			result |= memcmp(test_cases[k + 1].expected_digest,
+				digest[k], DIGEST_SIZE_BYTES_TRUNCATED);
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+	}
+	dprintf("#### end test ####\n");
+
+	dprintf("#### start test ####\n");
+	dprintf("Random 0-16 KiB lengths against tsha512t256r\n");
+	{
+#		define NJOBS 100
+#		define MAX_BYTES 16384
+		struct tsha512t256mb4_job jobs[NJOBS];
+		u64 digest[NJOBS][DIGEST_SIZE_WORDS_TRUNCATED];
+		u8 *buf = malloc(NJOBS * MAX_BYTES);
+		u32 k, n;
+
+		srand(1);
+		for (k = 0; k < NJOBS; k++)
+		{
+			jobs[k].message = buf + k * MAX_BYTES;
+			jobs[k].bytes = rand() % (MAX_BYTES + 1);
+			for (n = 0; n < jobs[k].bytes; n++)
+				buf[k * MAX_BYTES + n] = rand();
+			jobs[k].digest = digest[k];
+		}
+
+		result = tsha512t256mb4_hash_jobs(jobs, NJOBS);
+		for (k = 0; k < NJOBS && result == 0; k++)
+		{
+			plain_sha512t256_digest(jobs[k].message, jobs[k].bytes,
+				expected);
+			result |= memcmp(expected, digest[k],
+				DIGEST_SIZE_BYTES_TRUNCATED);
+		}
+		free(buf);
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+#		undef MAX_BYTES
+#		undef NJOBS
+	}
+	dprintf("#### end test ####\n");
+
+	return failed;
+}
+
+s32 get_hash_argv(s32 argc, char *argv[])
+{
+	struct tsha512t256mb4_job jobs[argc > 1 ? argc - 1 : 1];
+	u64 digest[argc > 1 ? argc - 1 : 1][DIGEST_SIZE_WORDS_TRUNCATED];
+	s32 ret = 0;
+	s32 i, k;
+
+	/* One job per argument. */
+	for (k = 0; k + 1 < argc; k++)
+	{
+		jobs[k].message = (const u8 *)argv[k + 1];
+		jobs[k].bytes = strlen(argv[k + 1]);
+		jobs[k].digest = digest[k];
+	}
+
+	ret = tsha512t256mb4_hash_jobs(jobs, argc > 1 ? argc - 1 : 0);
+	if (ret < 0)
+		goto DONE_ARGV;
+
+	for (k = 0; k + 1 < argc; k++)
+	{
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED ; i++)
+			dprintf("%016llx", digest[k][i]);
+		dprintf("\n");
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+s32 main(s32 argc, char *argv[])
+{
+#ifdef DEBUG
+	return run_tests();
+#else
+	return get_hash_argv(argc, argv);
+#endif
+}
+#endif // !TSHA512T256MB4_NO_MAIN
@@ -0,0 +1,644 @@
+/*
+ * tsha512t256p - A portable 512/256-bit Secure Hashing Algorithm 2 implementation (C)
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/*
+   Portable C version of SHA-512/256.  It keeps the FSM interface of
+   main-tsha512t256r.c and is laid out like main-tsha256p.c: locals only,
+   rounds unrolled 16 at a time by macros, a 16 word rolling W window and
+   whole block loads, with 64 bit words and 80 rounds.
+*/
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef int s32;
+typedef unsigned long long int u64;
+typedef long long int s64;
+
+#include "tsha-stats.h"
+#include "tsha-probes.h"
+
+#define LSIZE_BYTES 16
+#define WSIZE_BYTES 8
+#define WSIZE_BITS 64
+
+#define NROUNDS 80
+#define MSIZE_BYTES 128 // 16 * WSIZE_BYTES:8
+
+#define DIGEST_SIZE_BITS 512
+#define DIGEST_SIZE_BYTES 64
+#define DIGEST_SIZE_BYTES_TRUNCATED 32
+#define DIGEST_SIZE_WORDS 8
+#define DIGEST_SIZE_WORDS_TRUNCATED 4
+
+#define TSHA512T256P_FSM_INPUT		0
+#define TSHA512T256P_FSM_INPUT_UPDATE	1
+#define TSHA512T256P_FSM_COMPLETE	5
+#define TSHA512T256P_FSM_ERROR		255
+
+/* For OOP */
+struct tsha512 {
+	u64 digest[DIGEST_SIZE_WORDS];
+	u64 msglen;
+	u32 i_message;
+	u32 event;
+
+	/* Partial message block in message order */
+	u8 M8[MSIZE_BYTES];
+};
+
+static const u64 H_0[] = {
+	0x22312194fc2bf72c,
+	0x9f555fa3c84c64c2,
+	0x2393b86b6f53b151,
+	0x963877195940eabd,
+	0x96283ee2a88effe3,
+	0xbe5e1e2553863992,
+	0x2b0199fc2c85b8aa,
+	0x0eb72ddc81c52ca2
+};
+
+static const u64 K[] = {
+	0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
+	0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+	0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+	0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
+	0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+	0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+	0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
+	0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
+	0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+	0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+	0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
+	0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+	0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
+	0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+	0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+	0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
+	0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
+	0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+	0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
+	0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
+};
+
+#define ROTR(v, amt) ((v) >> (amt) | (v) << (WSIZE_BITS - (amt)))
+#define LOAD64_BE(p)								\
+	((u64)(p)[0] << 56 | (u64)(p)[1] << 48 | (u64)(p)[2] << 40		\
+	| (u64)(p)[3] << 32 | (u64)(p)[4] << 24 | (u64)(p)[5] << 16		\
+	| (u64)(p)[6] << 8 | (u64)(p)[7])
+
+#define SIG0(x) (ROTR(x, 28) ^ ROTR(x, 34) ^ ROTR(x, 39))
+#define SIG1(x) (ROTR(x, 14) ^ ROTR(x, 18) ^ ROTR(x, 41))
+#define sig0(x) (ROTR(x, 1) ^ ROTR(x, 8) ^ ((x) >> 7))
+#define sig1(x) (ROTR(x, 19) ^ ROTR(x, 61) ^ ((x) >> 6))
+#define Ch(e, f, g) ((((f) ^ (g)) & (e)) ^ (g))
+#define Maj(a, b, c) ((((a) | (b)) & (c)) | ((a) & (b)))
+
+/* W[k] for the first 16 rounds */
+#define W_LOAD(k) (W[k])
+/* W[j] written over W[j-16] for the other rounds.  k = j % 16 */
+#define W_EXPAND(k)								\
+	(W[k] += sig1(W[((k) - 2) & 15]) + W[((k) - 7) & 15]			\
+		+ sig0(W[((k) - 15) & 15]))
+
+/* j is the first round of the 16 and k a constant 0..15, so every W index
+   is a constant and W can live in registers. */
+#define ROUND(a, b, c, d, e, f, g, h, j, k, WK)				\
+	do {									\
+		T1 = (h) + SIG1(e) + Ch(e, f, g) + K[(j) + (k)] + WK(k);	\
+		(d) += T1;							\
+		(h) = T1 + SIG0(a) + Maj(a, b, c);				\
+	} while (0)
+
+#define ROUNDS16(j, WK)								\
+	do {									\
+		ROUND(a, b, c, d, e, f, g, h, j, 0, WK);			\
+		ROUND(h, a, b, c, d, e, f, g, j, 1, WK);			\
+		ROUND(g, h, a, b, c, d, e, f, j, 2, WK);			\
+		ROUND(f, g, h, a, b, c, d, e, j, 3, WK);			\
+		ROUND(e, f, g, h, a, b, c, d, j, 4, WK);			\
+		ROUND(d, e, f, g, h, a, b, c, j, 5, WK);			\
+		ROUND(c, d, e, f, g, h, a, b, j, 6, WK);			\
+		ROUND(b, c, d, e, f, g, h, a, j, 7, WK);			\
+		ROUND(a, b, c, d, e, f, g, h, j, 8, WK);			\
+		ROUND(h, a, b, c, d, e, f, g, j, 9, WK);			\
+		ROUND(g, h, a, b, c, d, e, f, j, 10, WK);			\
+		ROUND(f, g, h, a, b, c, d, e, j, 11, WK);			\
+		ROUND(e, f, g, h, a, b, c, d, j, 12, WK);			\
+		ROUND(d, e, f, g, h, a, b, c, j, 13, WK);			\
+		ROUND(c, d, e, f, g, h, a, b, j, 14, WK);			\
+		ROUND(b, c, d, e, f, g, h, a, j, 15, WK);			\
+	} while (0)
+
+#ifdef DEBUG
+#define dprintf(...) printf(__VA_ARGS__)
+#else
+/* Still type checks the arguments so -Wall stays quiet. */
+#define dprintf(...) do { if (0) printf(__VA_ARGS__); } while (0)
+#endif
+
+/* A plain memset of locals that are dead afterwards is dropped at -O2 and
+   up.  Calling it through a volatile pointer keeps the wipe. */
+static void *(*const volatile secure_memset)(void *, int, size_t) = memset;
+
+/* Compresses nblocks whole message blocks at buf into state->digest. */
+static void _tsha512t256p_compress(struct tsha512 *state, const u8 *buf,
+	u64 nblocks)
+{
+	u64 *H = state->digest;
+	u64 a, b, c, d, e, f, g, h, T1;
+	u64 W[16];
+	u32 j;
+	TSHA_STATS_TSC_BEGIN();
+	TSHA_PROBE(tsha512t256p, block_start, state);
+
+	TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, blocks, nblocks);
+
+	while (nblocks-- > 0)
+	{
+		for (j = 0; j < 16; j++)
+			W[j] = LOAD64_BE(buf + j * WSIZE_BYTES);
+
+		a = H[0]; b = H[1]; c = H[2]; d = H[3];
+		e = H[4]; f = H[5]; g = H[6]; h = H[7];
+
+		ROUNDS16(0, W_LOAD);
+		for (j = 16; j < NROUNDS; j += 16)
+			ROUNDS16(j, W_EXPAND);
+
+		H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+		H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+
+		buf += MSIZE_BYTES;
+	}
+
+	/* Securely wipe sensitive data. */
+	secure_memset(W, 0, sizeof(W));
+
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA512T256P);
+	TSHA_PROBE(tsha512t256p, block_end, state);
+}
+
+/* Places the 0x80 byte, the zero padding and the bit length behind the
+   bytes already in M8 and compresses the final block or two.	      */
+static void _tsha512t256p_pad_and_complete(struct tsha512 *state)
+{
+	/* The bit length is 128 bits.  Its high word is msglen >> 61. */
+	u64 len_hi = state->msglen >> 61;
+	u64 len_lo = state->msglen << 3;
+	u32 i;
+
+	state->M8[state->i_message++] = 0x80;
+	if (state->i_message > MSIZE_BYTES - LSIZE_BYTES)
+	{
+		memset(state->M8 + state->i_message, 0,
+			MSIZE_BYTES - state->i_message);
+		_tsha512t256p_compress(state, state->M8, 1);
+		state->i_message = 0;
+	}
+	memset(state->M8 + state->i_message, 0,
+		MSIZE_BYTES - LSIZE_BYTES - state->i_message);
+	for (i = 0; i < WSIZE_BYTES; i++)
+	{
+		state->M8[MSIZE_BYTES - 1 - i] = (u8)(len_lo >> (8 * i));
+		state->M8[MSIZE_BYTES - 1 - WSIZE_BYTES - i] =
+			(u8)(len_hi >> (8 * i));
+	}
+	_tsha512t256p_compress(state, state->M8, 1);
+
+	state->i_message = 0;
+	secure_memset(state->M8, 0, MSIZE_BYTES);
+	state->event = TSHA512T256P_FSM_COMPLETE;
+	TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, finals, 1);
+}
+
+u64 *tsha512t256p_get_hashcode(struct tsha512 *state)
+{
+	return state->digest;
+}
+
+s32 tsha512t256p_reset(struct tsha512 *state)
+{
+	if (state == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, errors, 1);
+		return -EINVAL;
+	}
+
+	secure_memset(state, 0, sizeof(struct tsha512));
+	memcpy(state->digest, H_0, DIGEST_SIZE_BYTES);
+	TSHA_PROBE(tsha512t256p, reset, state);
+
+	return 0;
+}
+
+void tsha512t256p_close(struct tsha512 *state)
+{
+	/* Securely wipe sensitive data.  Especially if password is used as the
+	   message.							      */
+	if (state != NULL)
+	{
+		TSHA_PROBE(tsha512t256p, close, state);
+		secure_memset(state, 0, sizeof(struct tsha512));
+	}
+}
+
+/* returns:
+	<0 - error
+	n - bytes read							      */
+s32 tsha512t256p_getch(struct tsha512 *state, u8 c)
+{
+	if (state == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->event != TSHA512T256P_FSM_INPUT)
+		return 0;
+
+	if (state->i_message < MSIZE_BYTES)
+	{
+		state->M8[state->i_message++] = c;
+		state->msglen++;
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, bytes, 1);
+		return 1;
+	}
+
+	state->event = TSHA512T256P_FSM_INPUT_UPDATE;
+	return 0;
+}
+
+/* Compresses a full message block and, with finish == 1, pads and
+   compresses the final block so state->event is TSHA512T256P_FSM_COMPLETE.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha512t256p_update(struct tsha512 *state, u32 finish)
+{
+	if (state == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->event == TSHA512T256P_FSM_COMPLETE
+		|| state->event == TSHA512T256P_FSM_ERROR)
+		return 0;
+
+	TSHA_PROBE(tsha512t256p, update_start, state);
+
+	if (state->i_message == MSIZE_BYTES)
+	{
+		_tsha512t256p_compress(state, state->M8, 1);
+		state->i_message = 0;
+		state->event = TSHA512T256P_FSM_INPUT;
+	}
+
+	if (finish == 1)
+		_tsha512t256p_pad_and_complete(state);
+
+	TSHA_PROBE(tsha512t256p, update_end, state);
+	return 0;
+}
+
+/* Bulk reader.  Whole message blocks are compressed straight from buf.
+   Only a partial head or tail block is copied into M8.
+   returns:
+	<0 - error
+	n - bytes read							      */
+s64 tsha512t256p_write(struct tsha512 *state, const u8 *buf, u64 len)
+{
+	u64 i = 0;
+	u64 n;
+
+	if (state == NULL || (buf == NULL && len > 0))
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, errors, 1);
+		return -EINVAL;
+	}
+
+	if (state->event != TSHA512T256P_FSM_INPUT
+		&& state->event != TSHA512T256P_FSM_INPUT_UPDATE)
+		return 0;
+
+	TSHA_PROBE(tsha512t256p, write_start, state);
+
+	/* Head: top off the partially filled message block. */
+	if (state->i_message > 0)
+	{
+		n = MSIZE_BYTES - state->i_message;
+		if (n > len)
+			n = len;
+		memcpy(state->M8 + state->i_message, buf, n);
+		state->i_message += n;
+		i = n;
+		if (state->i_message == MSIZE_BYTES)
+		{
+			_tsha512t256p_compress(state, state->M8, 1);
+			state->i_message = 0;
+		}
+	}
+
+	/* Body */
+	n = (len - i) / MSIZE_BYTES;
+	if (n > 0)
+		_tsha512t256p_compress(state, buf + i, n);
+	i += n * MSIZE_BYTES;
+
+	/* Tail: buffered until the next write or the finish. */
+	memcpy(state->M8 + state->i_message, buf + i, len - i);
+	state->i_message += len - i;
+
+	state->msglen += len;
+	TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, bytes, len);
+	state->event = TSHA512T256P_FSM_INPUT;
+
+	TSHA_PROBE(tsha512t256p, write_end, state);
+	return len;
+}
+
+/* One-shot hash of msg into out.  out receives the truncated
+   DIGEST_SIZE_WORDS_TRUNCATED words.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 tsha512t256p_digest(const u8 *msg, u64 len, u64 *out)
+{
+	struct tsha512 state;
+
+	if ((msg == NULL && len > 0) || out == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256P, errors, 1);
+		return -EINVAL;
+	}
+
+	tsha512t256p_reset(&state);
+	tsha512t256p_write(&state, msg, len);
+	tsha512t256p_update(&state, 1);
+
+	memcpy(out, state.digest, DIGEST_SIZE_BYTES_TRUNCATED);
+	tsha512t256p_close(&state);
+
+	return 0;
+}
+
+/* Lets another test program link this file. */
+#ifndef TSHA512T256P_NO_MAIN
+/* From main-tsha512t256r.c built with -DTSHA512T256R_NO_MAIN */
+s32 plain_sha512t256_digest(const u8 *msg, u64 len, u64 *out);
+
+s32 run_tests() {
+	u64 digest[DIGEST_SIZE_WORDS];
+	s32 ret = 0;
+	s32 failed = 0;
+	struct tsha512 state;
+
+#	define NTESTS 5
+
+	struct TEST_CASES
+	{
+		const char *description;
+		const u8 *message;
+		u64 bytes;
+		u64 *expected_digest;
+	} test_cases[NTESTS];
+
+
+	test_cases[0].description = "Empty string test";
+	test_cases[0].message = (const u8 *)"";
+	test_cases[0].bytes = 0;
+	u64 t0[8] = {0xc672b8d1ef56ed28, 0xab87c3622c511406,
+		     0x9bdd3ad7b8f97374, 0x98d0c01ecef0967a};
+	test_cases[0].expected_digest = t0;
+
+	test_cases[1].description = "1 block, 3 char message test";
+	test_cases[1].message = (const u8 *)"abc";
+	test_cases[1].bytes = 3;
+	u64 t1[8] = {0x53048e2681941ef9, 0x9b2e29b76b4c7dab,
+		     0xe4c2d0c634fc6d46, 0xe0e2f13107e7af23};
+	test_cases[1].expected_digest = t1;
+
+	test_cases[2].description = "2 block, 112 char message test";
+	test_cases[2].message =
+		(const u8 *)"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghij"
+		"klmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrst"
+		"nopqrstu";
+	test_cases[2].bytes = 112;
+	u64 t2[8] = { 0x3928e184fb8690f8, 0x40da3988121d31be,
+		      0x65cb9d3ef83ee614, 0x6feac861e19b563a};
+	test_cases[2].expected_digest = t2;
+
+	u8 m3[1000];
+	memset(m3, 'a', sizeof(m3));
+	test_cases[3].description = "8 block, 1000 char message test";
+	test_cases[3].message = m3;
+	test_cases[3].bytes = sizeof(m3);
+	u64 t3[8] = { 0x40eb4a70d4d69815, 0x407a9e272f0101cd,
+		      0x67e3d11262a4a0bf, 0xc087712749c7fb53};
+	test_cases[3].expected_digest = t3;
+
+	test_cases[4].description = "1 block, 111 char message test";
+	test_cases[4].message = m3;
+	test_cases[4].bytes = 111;
+	u64 t4[8] = { 0x0239e429f98d0ed6, 0x1ee8e2a7c30afe98,
+		      0xc1c3a80ce5dff62a, 0x107e9c538f7632ce};
+	test_cases[4].expected_digest = t4;
+
+	for (s32 i_test = 0 ; i_test < NTESTS ; i_test++)
+	{
+		dprintf("#### start test ####\n");
+		const char *description = test_cases[i_test].description;
+		const u8 *message = test_cases[i_test].message;
+		const u64 *expected_digest = test_cases[i_test].expected_digest;
+		const u64 bytes = test_cases[i_test].bytes;
+		u64 i;
+		s32 result;
+
+		dprintf("%s\n",description);
+
+		tsha512t256p_reset(&state);
+
+		i = 0;
+		while (i < bytes)
+		{
+			s32 bytes_read = tsha512t256p_getch(&state, message[i]);
+			if (bytes_read < 0)
+			{
+				tsha512t256p_close(&state);
+				ret = -EINVAL;
+				goto DONE_RT;
+			}
+
+			i += bytes_read;
+
+			if (state.event == TSHA512T256P_FSM_INPUT_UPDATE)
+				tsha512t256p_update(&state, 0);
+		}
+		do {
+			tsha512t256p_update(&state, 1);
+		} while (state.event != TSHA512T256P_FSM_COMPLETE
+			&& state.event != TSHA512T256P_FSM_ERROR);
+		memcpy(digest, tsha512t256p_get_hashcode(&state),
+			DIGEST_SIZE_BYTES_TRUNCATED);
+		tsha512t256p_close(&state);
+
+		dprintf("Digest as hex:\n");
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED; i++)
+			dprintf("%016llx", digest[i]);
+		dprintf("\n");
+
+		dprintf("Expected digest as hex:\n");
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED; i++)
+			dprintf("%016llx", expected_digest[i]);
+		dprintf("\n");
+
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES_TRUNCATED);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+
+		dprintf("Bulk write path:\n");
+		tsha512t256p_reset(&state);
+		/* Split so that the head, body and tail paths all run. */
+		i = bytes > 0 ? 1 : 0;
+		if (tsha512t256p_write(&state, message, i) < 0
+			|| tsha512t256p_write(&state, message + i, bytes - i) < 0)
+		{
+			tsha512t256p_close(&state);
+			ret = -EINVAL;
+			goto DONE_RT;
+		}
+		tsha512t256p_update(&state, 1);
+		memcpy(digest, tsha512t256p_get_hashcode(&state),
+			DIGEST_SIZE_BYTES_TRUNCATED);
+		tsha512t256p_close(&state);
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES_TRUNCATED);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		failed |= result;
+
+		dprintf("One-shot digest:\n");
+		if (tsha512t256p_digest(message, bytes, digest) < 0)
+		{
+			ret = -EINVAL;
+			goto DONE_RT;
+		}
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES_TRUNCATED);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+		dprintf("#### end test ####\n");
+	}
+
+	dprintf("#### start test ####\n");
+	dprintf("Random lengths against main-tsha512t256r.c\n");
+	{
+		static u8 buf[1 << 15];
+		u64 expected[DIGEST_SIZE_WORDS];
+		u64 bytes, i, n;
+		s32 result = 0;
+
+		srand(1);
+		for (n = 0; n < 16 && result == 0; n++)
+		{
+			bytes = rand() % sizeof(buf);
+			for (i = 0; i < bytes; i++)
+				buf[i] = rand();
+			plain_sha512t256_digest(buf, bytes, expected);
+
+			/* Split at a random byte */
+			tsha512t256p_reset(&state);
+			i = bytes > 0 ? rand() % bytes : 0;
+			tsha512t256p_write(&state, buf, i);
+			tsha512t256p_write(&state, buf + i, bytes - i);
+			tsha512t256p_update(&state, 1);
+			result |= memcmp(expected, tsha512t256p_get_hashcode(&state),
+				DIGEST_SIZE_BYTES_TRUNCATED);
+			tsha512t256p_close(&state);
+		}
+		memset(buf, 0, sizeof(buf));
+
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
+	}
+	dprintf("#### end test ####\n");
+
+DONE_RT:
+
+	return ret < 0 ? ret : failed;
+}
+
+s32 get_hash_argv(s32 argc, char *argv[])
+{
+	s32 ret = 0;
+	u64 i;
+	u64 bytes;
+	u64 digest[DIGEST_SIZE_WORDS];
+
+	if (argc == 2) {
+		bytes = strlen(argv[1]);
+		ret = tsha512t256p_digest((const u8 *)argv[1], bytes, digest);
+		if (ret < 0)
+			goto DONE_ARGV;
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED ; i++)
+			printf("%016llx", digest[i]);
+		printf("\n");
+	}
+
+DONE_ARGV:
+
+	return ret;
+}
+
+s32 main(s32 argc, char *argv[])
+{
+#ifdef DEBUG
+	(void)argc;
+	(void)argv;
+	return run_tests();
+#else
+	return get_hash_argv(argc, argv);
+#endif
+}
+#endif // !TSHA512T256P_NO_MAIN
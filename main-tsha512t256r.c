@@ -42,12 +42,16 @@
 #include <x86intrin.h>
 
 typedef unsigned char u8;
+typedef unsigned int u32;
 typedef int s32;
 typedef long long int s64;
 typedef unsigned long long int u64;
 typedef long long int s64;
 typedef unsigned __int128 u128;
 
+#include "tsha-stats.h"
+#include "tsha-probes.h"
+
 #define LSIZE_BYTES 16
 #define LSIZE_BITS 128
 #define WSIZE_BYTES 8
@@ -107,13 +111,17 @@ struct tsha512 {
 	u8 m15[16];
 #endif
 
+	/* Set by plain_sha512t256_init_with_length */
+	u64 total_msglen;
+	u64 has_total_msglen;
+
 	u64 A[DIGEST_SIZE_WORDS];
 	u8 W8[NW*WSIZE_BYTES]; /* 80 words * 8 bytes each = 640 bytes */
 	u64 sig0, sig1;
 	u64 Ch, Maj, SIG0, SIG1, T1, T2;
 };
 
-u64 H_0[] = {
+static u64 H_0[] = {
 	0x22312194fc2bf72c,
 	0x9f555fa3c84c64c2,
 	0x2393b86b6f53b151,
@@ -124,7 +132,7 @@ u64 H_0[] = {
 	0x0eb72ddc81c52ca2
 };
 
-u64 K[80] = {
+static u64 K[80] = {
 	0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
 	0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
 	0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
@@ -149,7 +157,7 @@ u64 K[80] = {
 /* Faster than byteswap because of loop overhead and duplicate loops */
 /* char[0] MSB when printing le u64 */
 /* char[7] LSB when printing le u64 */
-u64 seq[] = {
+static u64 seq[] = {
 	 7,  6,  5,  4,  3,  2,  1,  0,
 	15, 14, 13, 12, 11, 10,  9,  8,
 	23, 22, 21, 20, 19, 18, 17, 16,
@@ -169,13 +177,13 @@ u64 seq[] = {
 };
 /* End of sub-array index position: 56 57 58 59 60 61 62 63 */
 /* 63 is lsb and 56 is msb */
-u64 seq2[] = {
+static u64 seq2[] = {
 	120, 121, 122, 123, 124, 125, 126, 127,   /* 127 is msb, 120 is mid */
 	112, 113, 114, 115, 116, 117, 118, 119   /* 119 is mid. 112 is msb */
 };
 
 /* rotate right */
-u64 ROTR(const u64 v, const u64 amt)
+static u64 ROTR(const u64 v, const u64 amt)
 {
 	return v >> amt | v << (WSIZE_BITS - amt);
 }
@@ -186,6 +194,9 @@ u64 ROTR(const u64 v, const u64 amt)
 #define dprintf(...)
 #endif
 
+s32 _plain_sha512t256_complete_message_block(struct tsha512 *state);
+void _plain_sha512t256_pad_and_complete(struct tsha512 *state);
+
 u64 *plain_sha512t256_get_hashcode(struct tsha512 *state)
 {
 	return state->digest;
@@ -197,12 +208,27 @@ void plain_sha512t256_reset(struct tsha512 *state)
 
 	dprintf("Init digest\n");
 	memcpy(state->digest, H_0, DIGEST_SIZE_WORDS * WSIZE_BYTES);
+	TSHA_PROBE(tsha512t256r, reset, state);
+}
+
+/* Same as plain_sha512t256_reset, but for a message of len bytes that is
+   known up front.  The padding and the length are placed and the final
+   block is compressed as soon as the last byte arrives, so state->event is
+   SHA512T256_FSM_COMPLETE without any plain_sha512t256_update polling.     */
+void plain_sha512t256_init_with_length(struct tsha512 *state, u64 len)
+{
+	plain_sha512t256_reset(state);
+	state->total_msglen = len;
+	state->has_total_msglen = 1;
+	if (len == 0)
+		_plain_sha512t256_pad_and_complete(state);
 }
 
 void plain_sha512t256_close(struct tsha512 *state)
 {
 	/* Securely wipe sensitive data.  Especially if password is used as the
 	   message.							      */
+	TSHA_PROBE(tsha512t256r, close, state);
 	memset(state, 0, sizeof(struct tsha512));
 }
 
@@ -221,13 +247,29 @@ s32 plain_sha512t256_getch(struct tsha512 *state, u8 c)
 	}
 
 	if (state->event != SHA512T256_FSM_INPUT)
+	{
+		/* More bytes than given to plain_sha512t256_init_with_length */
+		if (state->has_total_msglen)
+			ret = -EINVAL;
 		goto GETCH_DONE;
+	}
 
 	if (state->i_message < MSIZE_BYTES) {
 		state->W8[seq[state->i_message]] = c;
 		state->i_message++;
 		state->msglen++;
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, bytes, 1);
 		ret = 1;
+
+		/* With a known length there is no need to wait for the next
+		   byte or for the finish flag. */
+		if (state->has_total_msglen)
+		{
+			if (state->msglen == state->total_msglen)
+				_plain_sha512t256_pad_and_complete(state);
+			else if (state->i_message == MSIZE_BYTES)
+				_plain_sha512t256_complete_message_block(state);
+		}
 	} else {
 		state->event = SHA512T256_FSM_INPUT_UPDATE;
 	}
@@ -242,6 +284,8 @@ s32 _plain_sha512t256_complete_message_block(struct tsha512 *state) {
 	u64 *W64;
 
 	dprintf("Called _plain_sha512t256_complete_message_block\n");
+	TSHA_PROBE(tsha512t256r, block_start, state);
+	TSHA_STATS_TSC_BEGIN();
 
 	W64 = (u64*)state->W8;
 
@@ -347,12 +391,45 @@ s32 _plain_sha512t256_complete_message_block(struct tsha512 *state) {
 	// process next
 	state->i_message = 0;
 	memset(state->W8, 0, MSIZE_BYTES);
+
+	TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, blocks, 1);
+	TSHA_STATS_TSC_END(TSHA_STATS_SHA512T256R);
+	TSHA_PROBE(tsha512t256r, block_end, state);
+}
+
+/* Places the 0x80 byte, the zero padding and the bit length behind the
+   bytes already in W8 and compresses the final block or two.	      */
+void _plain_sha512t256_pad_and_complete(struct tsha512 *state)
+{
+	u128 len128;
+	u64 i;
+
+	dprintf("Called _plain_sha512t256_pad_and_complete\n");
+
+	if (state->i_message >= MSIZE_BYTES)
+		_plain_sha512t256_complete_message_block(state);
+
+	/* The rest of W8 is already zero. */
+	state->W8[seq[state->i_message]] = (u8)0x80;
+	if (state->i_message >= MSIZE_BYTES - LSIZE_BYTES)
+		_plain_sha512t256_complete_message_block(state);
+
+	len128 = (u128)state->msglen*8;
+	for (i = 0; i < LSIZE_BYTES; i++)
+		state->W8[seq2[i]] = ((u8*)&len128)[i];
+	_plain_sha512t256_complete_message_block(state);
+
+	state->event = SHA512T256_FSM_COMPLETE;
+	TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, finals, 1);
 }
 
 void plain_sha512t256_update(struct tsha512 *state, u64 finish)
 {
 	dprintf("Called plain_sha512t256_update\n");
+	TSHA_PROBE(tsha512t256r, update_start, state);
 
+	if (state->event == SHA512T256_FSM_COMPLETE)
+		goto UPDATE_DONE;
 
 	if (finish == 1 || state->i_message >= MSIZE_BYTES)
 	{
@@ -361,7 +438,7 @@ void plain_sha512t256_update(struct tsha512 *state, u64 finish)
 	else
 	{
 		dprintf("Message is NOT ready.\n");
-		return;
+		goto UPDATE_DONE;
 	}
 
 
@@ -411,7 +488,7 @@ void plain_sha512t256_update(struct tsha512 *state, u64 finish)
 	else if (state->event == SHA512T256_FSM_APPEND_0_PADDING)
 	{
 		dprintf("state->event == SHA512T256_FSM_APPEND_0_PADDING\n");
-		if (state->i_message < MSIZE_BYTES - LSIZE_BYTES) {
+		if (state->i_message <= MSIZE_BYTES - LSIZE_BYTES) {
 			dprintf("Filling padding to and including i=MSIZE_BYTES:128-LSIZE_BYTES:16-1=111\n");
 			state->event = SHA512T256_FSM_APPEND_LENGTH;
 		} else {
@@ -425,7 +502,7 @@ void plain_sha512t256_update(struct tsha512 *state, u64 finish)
 	}
 	else if (state->event == SHA512T256_FSM_APPEND_LENGTH) {
 		dprintf("state->event == SHA512T256_FSM_APPEND_LENGTH\n");
-		if (state->i_message < MSIZE_BYTES - LSIZE_BYTES) {
+		if (state->i_message <= MSIZE_BYTES - LSIZE_BYTES) {
 			/* space check: 112 = MSIZE_BYTES:128 - LSIZE_BYTES:16 */
 			dprintf("Message length:\n");
 			/* gets message length */
@@ -448,24 +525,83 @@ void plain_sha512t256_update(struct tsha512 *state, u64 finish)
 
 			dprintf("state->event == SHA512T256_FSM_COMPLETE\n");
 			state->event = SHA512T256_FSM_COMPLETE;
+			TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, finals, 1);
 		} else {
-			dprintf("Expected state->i_message < MSIZE_BYTES - LSIZE_BYTES\n");
+			dprintf("Expected state->i_message <= MSIZE_BYTES - LSIZE_BYTES\n");
 			state->event = SHA512T256_FSM_ERROR;
+			TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, errors, 1);
 		}
 	} else {
 		state->event = SHA512T256_FSM_ERROR;
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, errors, 1);
 	}
 
+UPDATE_DONE:
+	TSHA_PROBE(tsha512t256r, update_end, state);
 	return;
 }
 
+/* One-shot hash of msg into out.  Whole blocks are loaded into W64 a word
+   at a time with a byte swap, the tail goes through seq[], then the 0x80
+   byte, the zero padding and the bit length are placed and at most two
+   final blocks are compressed without stepping through the padding FSM.
+   out receives the truncated DIGEST_SIZE_WORDS_TRUNCATED words.
+   returns:
+	<0 - error
+	0 - success							      */
+s32 plain_sha512t256_digest(const u8 *msg, u64 len, u64 *out)
+{
+	struct tsha512 state;
+	u64 *W64 = (u64*)state.W8;
+	u64 i = 0;
+	u64 w;
+	u32 j;
+
+	dprintf("Called plain_sha512t256_digest\n");
+
+	if ((msg == NULL && len > 0) || out == NULL)
+	{
+		TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, errors, 1);
+		return -EINVAL;
+	}
+
+	plain_sha512t256_reset(&state);
+
+	/* Body */
+	while (len - i >= MSIZE_BYTES)
+	{
+		for (j = 0; j < MSIZE_BYTES / WSIZE_BYTES; j++)
+		{
+			memcpy(&w, msg + i + j * WSIZE_BYTES, WSIZE_BYTES);
+			W64[j] = _bswap64(w);
+		}
+		i += MSIZE_BYTES;
+		_plain_sha512t256_complete_message_block(&state);
+	}
+
+	/* Tail, W8 is zero past it */
+	for (j = 0; i < len; i++, j++)
+		state.W8[seq[j]] = msg[i];
+	state.i_message = j;
+	state.msglen = len;
+	TSHA_STATS_ADD(TSHA_STATS_SHA512T256R, bytes, len);
+	_plain_sha512t256_pad_and_complete(&state);
+
+	memcpy(out, state.digest, DIGEST_SIZE_BYTES_TRUNCATED);
+	plain_sha512t256_close(&state);
+
+	return 0;
+}
+
+/* Lets another test program link this file as its reference. */
+#ifndef TSHA512T256R_NO_MAIN
 s32 run_tests() {
 	u64 digest[DIGEST_SIZE_WORDS];
 	s32 ret;
 	u64 failed = 0;
 	struct tsha512 __attribute__ ((aligned (16))) state;
 
-#	define NTESTS 3
+#	define NTESTS 5
 
 	struct TEST_CASES
 	{
@@ -500,6 +636,22 @@ s32 run_tests() {
 		      0x65cb9d3ef83ee614, 0x6feac861e19b563a};
 	test_cases[2].expected_digest = t2;
 
+	u8 m3[1000];
+	memset(m3, 'a', sizeof(m3));
+	test_cases[3].description = "8 block, 1000 char message test";
+	test_cases[3].message = m3;
+	test_cases[3].bytes = sizeof(m3);
+	u64 t3[8] = { 0x40eb4a70d4d69815, 0x407a9e272f0101cd,
+		      0x67e3d11262a4a0bf, 0xc087712749c7fb53};
+	test_cases[3].expected_digest = t3;
+
+	test_cases[4].description = "1 block, 111 char message test";
+	test_cases[4].message = m3;
+	test_cases[4].bytes = 111;
+	u64 t4[8] = { 0x0239e429f98d0ed6, 0x1ee8e2a7c30afe98,
+		      0xc1c3a80ce5dff62a, 0x107e9c538f7632ce};
+	test_cases[4].expected_digest = t4;
+
 	for (u64 i_test = 0 ; i_test < NTESTS ; i_test++)
 	{
 		dprintf("#### start test ####\n");
@@ -569,6 +721,48 @@ s32 run_tests() {
 			dprintf("Failed\n");
 		dprintf("---\n");
 		failed |= result;
+
+		dprintf("Known length path:\n");
+		plain_sha512t256_init_with_length(&state, bytes);
+		i = 0;
+		while (i < bytes)
+		{
+			s32 bytes_read = plain_sha512t256_getch(&state, message[i]);
+			if (bytes_read < 0)
+			{
+				plain_sha512t256_close(&state);
+				ret = -EINVAL;
+				goto DONE_RT;
+			}
+			i += bytes_read;
+		}
+		if (state.event != SHA512T256_FSM_COMPLETE
+			|| plain_sha512t256_getch(&state, 0) != -EINVAL)
+			result = -1;
+		else
+			result = memcmp(expected_digest,
+				plain_sha512t256_get_hashcode(&state),
+				DIGEST_SIZE_BYTES_TRUNCATED);
+		plain_sha512t256_close(&state);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		failed |= result;
+
+		dprintf("One-shot digest:\n");
+		if (plain_sha512t256_digest(message, bytes, digest) < 0)
+		{
+			ret = -EINVAL;
+			goto DONE_RT;
+		}
+		result = memcmp(expected_digest, digest, DIGEST_SIZE_BYTES_TRUNCATED);
+		if (result == 0)
+			dprintf("Pass\n");
+		else
+			dprintf("Failed\n");
+		dprintf("---\n");
+		failed |= result;
 		dprintf("#### end test ####\n");
 	}
 
@@ -579,9 +773,7 @@ DONE_RT:
 
 s32 get_hash_argv(s32 argc, char *argv[])
 {
-	struct tsha512 __attribute__ ((aligned (16))) state;
-
-	s32 ret;
+	s32 ret = 0;
 	s64 i;
 	s64 bytes;
 	u64 digest[DIGEST_SIZE_WORDS];
@@ -589,32 +781,10 @@ s32 get_hash_argv(s32 argc, char *argv[])
 	if (argc)
 	if (argc == 2) {
 		bytes = strlen(argv[1]);
-		plain_sha512t256_reset(&state);
-		i = 0;
-		while (i < bytes)
-		{
-			s64 bytes_read = 0;
-			bytes_read = plain_sha512t256_getch(&state, argv[1][i]);
-			if (bytes_read < 0)
-			{
-				plain_sha512t256_close(&state);
-				ret = -EINVAL;
-				goto DONE_ARGV;
-			}
-
-			i += bytes_read;
-
-			if (state.event == SHA512T256_FSM_INPUT_UPDATE)
-				plain_sha512t256_update(&state,0);
-		}
-		do {
-			plain_sha512t256_update(&state,1);
-		} while (state.event != SHA512T256_FSM_COMPLETE
-			&& state.event != SHA512T256_FSM_ERROR);
-		u64 *hashcode = plain_sha512t256_get_hashcode(&state);
-		memcpy(digest, hashcode, DIGEST_SIZE_BYTES);
-		plain_sha512t256_close(&state);
-		for (i = 0; i < DIGEST_SIZE_WORDS ; i++)
+		ret = plain_sha512t256_digest(argv[1], bytes, digest);
+		if (ret < 0)
+			goto DONE_ARGV;
+		for (i = 0; i < DIGEST_SIZE_WORDS_TRUNCATED ; i++)
 			dprintf("%016llx", digest[i]);
 	}
 
@@ -631,3 +801,4 @@ s32 main(s32 argc, char *argv[])
 	get_hash_argv(argc, argv);
 #endif
 }
+#endif // !TSHA512T256R_NO_MAIN
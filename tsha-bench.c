@@ -0,0 +1,1387 @@
+/*
+ * tsha-bench - Throughput benchmark across the tsha256 and tsha512t256 variants
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+   Every working variant is linked into one binary through its one-shot
+   digest entry point, built with -D<VARIANT>_NO_MAIN, so they are timed
+   with the same harness on the same buffers:
+
+	- Before timing, each variant is checked against the reference
+	  (tsha256r or the plain sha512/256) at every size.  A mismatch
+	  skips the variant.
+	- A warm-up run picks the number of calls per sample so a sample
+	  takes about --min-time ms.
+	- --repeat samples are taken.  The median, p10, p90 and the minimum
+	  of the time per hash are reported.
+	- The rdtsc cycles per byte are reported next to the clock_gettime
+	  time.  The TSC ticks at a fixed rate, so under turbo it is not the
+	  core clock.  With --ghz the wall time is also converted to core
+	  cycles at that clock.
+
+   A multi-buffer call hashes one message per lane.  Its time per hash is
+   the call time divided by the lanes, and its MB/s counts every lane.
+
+   With --replay=FILE the sizes come from a workload file instead and every
+   single message variant hashes the whole workload one message at a time.
+   A line of the file is one of
+
+	SIZE		- one message, a raw size trace is a list of these
+	SIZE COUNT	- COUNT messages of SIZE bytes
+	LO-HI COUNT	- COUNT messages of uniformly random size in LO..HI
+
+   with K and M suffixes allowed and # starting a comment.  A trace is
+   replayed in file order.  When any line has a COUNT, the expanded list is
+   shuffled with a fixed seed so the sizes are interleaved as in real
+   traffic.  Each message is timed with rdtsc.  The aggregate MB/s, the
+   latency percentiles and the share of time in finalization are reported.
+   The finalization time of a message is measured as a second, separate
+   hash of its last partial block, len % block size bytes, which is the
+   part that goes through the padding and the output of the digest.  The
+   rest is bulk compression.  --repeat is the number of passes over the
+   workload and defaults to 1 here.
+
+   --save-baseline=FILE stores the cycles per byte of every sample under a
+   key of the CPU model, the CPU features and the compiler and flags, next
+   to the baselines of other hosts.  --compare=FILE runs the same way and
+   prints each variant and size against the baseline of this host.  A
+   kernel has regressed when its median is more than --threshold percent
+   slower and a one sided Mann-Whitney U test of the samples gives p below
+   --alpha, so a single slow sample does not fail it.  Samples taken back to
+   back share the state of the machine, so --runs=N repeats the whole run
+   and pools the samples of all N; use the same --runs for the baseline and
+   the comparison.  The exit status is 1 on a regression.
+
+   The dispatch builds are left out because they bind to one of the
+   tsha256a kernels already listed.
+*/
+
+#define _GNU_SOURCE
+#include <cpuid.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+typedef int s32;
+typedef unsigned long long int u64;
+typedef long long int s64;
+
+#define DIGEST_SIZE_BYTES 32
+#define MAX_LANES 8
+#define MAX_SIZES 32
+#define MAX_REPEAT 1001
+#define REPLAY_WINDOW (1ULL << 20) // small messages are spread over this
+
+#ifndef TSHA_BENCH_CFLAGS
+#  define TSHA_BENCH_CFLAGS "unknown"
+#endif
+
+/* From main-tsha256r.c built with -DTSHA256R_NO_MAIN */
+s32 tsha256r_digest(const u8 *msg, u64 len, u32 *out);
+/* From main-tsha256p.c built with -DTSHA256P_NO_MAIN */
+s32 tsha256p_digest(const u8 *msg, u64 len, u32 *out);
+/* From main-tsha256hp.c built with -DTSHA256HP_NO_MAIN */
+s32 tsha256hp_digest(const u8 *msg, u64 len, u32 *out);
+/* From main-tsha256a.c built with -DTSHA256A_NO_MAIN -DTSHA256A_SUFFIX=x */
+s32 tsha256a_digest_sse2(const u8 *msg, u64 len, u32 *out);
+s32 tsha256a_digest_sse4_1(const u8 *msg, u64 len, u32 *out);
+s32 tsha256a_digest_bmi(const u8 *msg, u64 len, u32 *out);
+s32 tsha256a_digest_bmi2(const u8 *msg, u64 len, u32 *out);
+s32 tsha256a_digest_avx2(const u8 *msg, u64 len, u32 *out);
+s32 tsha256a_digest_shani(const u8 *msg, u64 len, u32 *out);
+/* From main-tsha256ha.c built with -DTSHA256HA_NO_MAIN -DTSHA256HA_SUFFIX=x */
+s32 tsha256ha_digest_sse2(const u8 *msg, u64 len, u32 *out);
+s32 tsha256ha_digest_sse4_1(const u8 *msg, u64 len, u32 *out);
+s32 tsha256ha_digest_bmi2(const u8 *msg, u64 len, u32 *out);
+/* From main-tsha256mb4.c built with -DTSHA256MB4_NO_MAIN */
+s32 tsha256mb4_digest(const u8 *msg[4], const u64 len[4], u32 *out[4]);
+/* From main-tsha256mb8.c built with -DTSHA256MB8_NO_MAIN */
+struct tsha256mb8_job {
+	const u8 *message;
+	u64 bytes;
+	u32 *digest;
+};
+s32 tsha256mb8_hash_jobs(struct tsha256mb8_job *jobs, u64 njobs);
+
+/* From main-tsha512t256r.c built with -DTSHA512T256R_NO_MAIN */
+s32 plain_sha512t256_digest(const u8 *msg, u64 len, u64 *out);
+/* From main-tsha512t256p.c built with -DTSHA512T256P_NO_MAIN */
+s32 tsha512t256p_digest(const u8 *msg, u64 len, u64 *out);
+/* From main-tsha512t256a.c built with -DTSHA512T256A_NO_MAIN */
+s32 tsha512t256a_digest(const u8 *msg, u64 len, u64 *out);
+/* From main-tsha512t256mb4.c built with -DTSHA512T256MB4_NO_MAIN */
+struct tsha512t256mb4_job {
+	const u8 *message;
+	u64 bytes;
+	u64 *digest;
+};
+s32 tsha512t256mb4_hash_jobs(struct tsha512t256mb4_job *jobs, u64 njobs);
+
+/* One call hashes msg[k] of len bytes into out[k] for each lane k. */
+typedef s32 (*bench_fn)(const u8 *msg[MAX_LANES], u64 len,
+	u8 *out[MAX_LANES]);
+
+#define ALG_SHA256 0
+#define ALG_SHA512T256 1
+
+struct variant {
+	const char *name;
+	u32 alg;
+	u32 lanes;
+	bench_fn fn;
+	const char *cpu_feature[3]; // NULL terminated, __builtin_cpu_supports
+};
+
+#define SINGLE_LANE_SHA256(NAME,FN)						\
+	static s32 NAME(const u8 *msg[MAX_LANES], u64 len,			\
+		u8 *out[MAX_LANES])						\
+	{									\
+		return FN(msg[0], len, (u32 *)out[0]);				\
+	}
+
+#define SINGLE_LANE_SHA512T256(NAME,FN)						\
+	static s32 NAME(const u8 *msg[MAX_LANES], u64 len,			\
+		u8 *out[MAX_LANES])						\
+	{									\
+		return FN(msg[0], len, (u64 *)out[0]);				\
+	}
+
+SINGLE_LANE_SHA256(bench_sha256r, tsha256r_digest)
+SINGLE_LANE_SHA256(bench_sha256p, tsha256p_digest)
+SINGLE_LANE_SHA256(bench_sha256hp, tsha256hp_digest)
+SINGLE_LANE_SHA256(bench_sha256a_sse2, tsha256a_digest_sse2)
+SINGLE_LANE_SHA256(bench_sha256a_sse4_1, tsha256a_digest_sse4_1)
+SINGLE_LANE_SHA256(bench_sha256a_bmi, tsha256a_digest_bmi)
+SINGLE_LANE_SHA256(bench_sha256a_bmi2, tsha256a_digest_bmi2)
+SINGLE_LANE_SHA256(bench_sha256a_avx2, tsha256a_digest_avx2)
+SINGLE_LANE_SHA256(bench_sha256a_shani, tsha256a_digest_shani)
+SINGLE_LANE_SHA256(bench_sha256ha_sse2, tsha256ha_digest_sse2)
+SINGLE_LANE_SHA256(bench_sha256ha_sse4_1, tsha256ha_digest_sse4_1)
+SINGLE_LANE_SHA256(bench_sha256ha_bmi2, tsha256ha_digest_bmi2)
+SINGLE_LANE_SHA512T256(bench_sha512t256r, plain_sha512t256_digest)
+SINGLE_LANE_SHA512T256(bench_sha512t256p, tsha512t256p_digest)
+SINGLE_LANE_SHA512T256(bench_sha512t256a, tsha512t256a_digest)
+
+static s32 bench_sha256mb4(const u8 *msg[MAX_LANES], u64 len,
+	u8 *out[MAX_LANES])
+{
+	const u64 lens[4] = { len, len, len, len };
+	u32 *digests[4] = {
+		(u32 *)out[0], (u32 *)out[1], (u32 *)out[2], (u32 *)out[3]
+	};
+
+	return tsha256mb4_digest(msg, lens, digests);
+}
+
+static s32 bench_sha256mb8(const u8 *msg[MAX_LANES], u64 len,
+	u8 *out[MAX_LANES])
+{
+	struct tsha256mb8_job jobs[8];
+	u32 k;
+
+	for (k = 0; k < 8; k++)
+	{
+		jobs[k].message = msg[k];
+		jobs[k].bytes = len;
+		jobs[k].digest = (u32 *)out[k];
+	}
+	return tsha256mb8_hash_jobs(jobs, 8);
+}
+
+static s32 bench_sha512t256mb4(const u8 *msg[MAX_LANES], u64 len,
+	u8 *out[MAX_LANES])
+{
+	struct tsha512t256mb4_job jobs[4];
+	u32 k;
+
+	for (k = 0; k < 4; k++)
+	{
+		jobs[k].message = msg[k];
+		jobs[k].bytes = len;
+		jobs[k].digest = (u64 *)out[k];
+	}
+	return tsha512t256mb4_hash_jobs(jobs, 4);
+}
+
+static const struct variant variants[] = {
+	{ "sha256r", ALG_SHA256, 1, bench_sha256r, { NULL } },
+	{ "sha256p", ALG_SHA256, 1, bench_sha256p, { NULL } },
+	{ "sha256hp", ALG_SHA256, 1, bench_sha256hp, { NULL } },
+	{ "sha256a-sse2", ALG_SHA256, 1, bench_sha256a_sse2, { NULL } },
+	{ "sha256a-sse4_1", ALG_SHA256, 1, bench_sha256a_sse4_1,
+		{ "sse4.1", NULL } },
+	{ "sha256a-bmi", ALG_SHA256, 1, bench_sha256a_bmi,
+		{ "sse4.1", "bmi" } },
+	{ "sha256a-bmi2", ALG_SHA256, 1, bench_sha256a_bmi2,
+		{ "sse4.1", "bmi2" } },
+	{ "sha256a-avx2", ALG_SHA256, 1, bench_sha256a_avx2,
+		{ "avx2", "bmi2" } },
+	{ "sha256a-shani", ALG_SHA256, 1, bench_sha256a_shani,
+		{ "sha", "sse4.1" } },
+	{ "sha256ha", ALG_SHA256, 1, bench_sha256ha_sse2, { NULL } },
+	{ "sha256ha-sse4_1", ALG_SHA256, 1, bench_sha256ha_sse4_1,
+		{ "sse4.1", NULL } },
+	{ "sha256ha-bmi2", ALG_SHA256, 1, bench_sha256ha_bmi2,
+		{ "sse4.1", "bmi", "bmi2" } },
+	{ "sha256mb4", ALG_SHA256, 4, bench_sha256mb4, { NULL } },
+	{ "sha256mb8", ALG_SHA256, 8, bench_sha256mb8, { "avx2", NULL } },
+	{ "sha512/256r", ALG_SHA512T256, 1, bench_sha512t256r, { NULL } },
+	{ "sha512/256p", ALG_SHA512T256, 1, bench_sha512t256p, { NULL } },
+	{ "sha512/256a", ALG_SHA512T256, 1, bench_sha512t256a,
+		{ "avx2", NULL } },
+	{ "sha512/256mb4", ALG_SHA512T256, 4, bench_sha512t256mb4,
+		{ "avx2", NULL } },
+};
+#define NVARIANTS (sizeof(variants) / sizeof(variants[0]))
+
+static const u64 default_sizes[] = {
+	0, 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576
+};
+
+struct options {
+	u32 warmup_ms;
+	u32 min_time_ms;
+	u32 repeat;
+	s32 cpu;
+	double ghz;
+	u32 json;
+	const char *filter;
+	u64 sizes[MAX_SIZES];
+	u32 nsizes;
+	const char *replay;
+	const char *save_baseline;
+	const char *compare;
+	u32 runs;
+	double threshold; // percent
+	double alpha;
+};
+
+/* Message sizes to replay, from load_workload */
+struct workload {
+	u64 *sizes;
+	u64 n;
+	u64 cap;
+	u64 bytes;
+	u64 max_size;
+};
+
+struct result {
+	u64 iters; // calls per sample
+	double ns_median, ns_p10, ns_p90, ns_min; // per hash
+	double tsc_median; // per call
+	double cpb[MAX_REPEAT]; // TSC cycles per byte of each sample, sorted
+};
+
+struct replay_result {
+	double mbps, msgps;
+	double ns_p50, ns_p90, ns_p99, ns_p999, ns_max; // per message
+	double final_share; // 0..1 of the hashing time
+};
+
+static volatile u8 sink;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+static s32 cpu_has(const char *f)
+{
+	/* __builtin_cpu_supports only takes string literals. */
+	if (!strcmp(f, "sse4.1"))
+		return __builtin_cpu_supports("sse4.1");
+	else if (!strcmp(f, "bmi"))
+		return __builtin_cpu_supports("bmi");
+	else if (!strcmp(f, "bmi2"))
+		return __builtin_cpu_supports("bmi2");
+	else if (!strcmp(f, "avx2"))
+		return __builtin_cpu_supports("avx2");
+	else if (!strcmp(f, "sha"))
+		return __builtin_cpu_supports("sha");
+	return 0;
+}
+
+static s32 variant_supported(const struct variant *v)
+{
+	u32 i;
+
+	for (i = 0; i < 3 && v->cpu_feature[i]; i++)
+		if (!cpu_has(v->cpu_feature[i]))
+			return 0;
+	return 1;
+}
+
+static s32 variant_selected(const struct variant *v, const char *filter)
+{
+	return filter == NULL || strstr(v->name, filter) != NULL;
+}
+
+/* Compares every lane against the reference for the algorithm. */
+static s32 check_variant(const struct variant *v, const u8 *msg[MAX_LANES],
+	u64 len, u8 *out[MAX_LANES])
+{
+	u8 expected[DIGEST_SIZE_BYTES];
+	u32 k;
+
+	memset(out[0], 0, DIGEST_SIZE_BYTES);
+	if (v->fn(msg, len, out) < 0)
+		return -EIO;
+	for (k = 0; k < v->lanes; k++)
+	{
+		if (v->alg == ALG_SHA256)
+			tsha256r_digest(msg[k], len, (u32 *)expected);
+		else
+			plain_sha512t256_digest(msg[k], len, (u64 *)expected);
+		if (memcmp(expected, out[k], DIGEST_SIZE_BYTES))
+			return -EIO;
+	}
+	return 0;
+}
+
+static u64 run_calls(const struct variant *v, const u8 *msg[MAX_LANES],
+	u64 len, u8 *out[MAX_LANES], u64 iters)
+{
+	u64 i;
+
+	for (i = 0; i < iters; i++)
+		v->fn(msg, len, out);
+	sink ^= out[0][0];
+	return iters;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of a sorted array */
+static double percentile(const double *sorted, u32 n, u32 p)
+{
+	u32 rank = (p * n + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void bench_variant(const struct variant *v, const struct options *o,
+	const u8 *msg[MAX_LANES], u64 len, u8 *out[MAX_LANES],
+	struct result *r)
+{
+	double ns[MAX_REPEAT], tsc[MAX_REPEAT];
+	u64 iters = 1, t0, t1, c0, c1, elapsed;
+	u64 warmup_end;
+	u32 i;
+
+	/* Warm the caches and the clock, then size a sample. */
+	warmup_end = now_ns() + (u64)o->warmup_ms * 1000000ULL;
+	do
+	{
+		t0 = now_ns();
+		run_calls(v, msg, len, out, iters);
+		elapsed = now_ns() - t0;
+		if (elapsed < (u64)o->min_time_ms * 1000000ULL)
+			iters = elapsed > 0
+				? iters * o->min_time_ms * 1000000ULL / elapsed + 1
+				: iters * 2;
+	} while (now_ns() < warmup_end
+		|| elapsed < (u64)o->min_time_ms * 1000000ULL / 2);
+
+	for (i = 0; i < o->repeat; i++)
+	{
+		t0 = now_ns();
+		c0 = __rdtsc();
+		run_calls(v, msg, len, out, iters);
+		c1 = __rdtsc();
+		t1 = now_ns();
+		ns[i] = (double)(t1 - t0) / iters / v->lanes;
+		tsc[i] = (double)(c1 - c0) / iters;
+	}
+
+	qsort(ns, o->repeat, sizeof(double), cmp_double);
+	qsort(tsc, o->repeat, sizeof(double), cmp_double);
+	/* Per hash instead of per byte for the empty message */
+	for (i = 0; i < o->repeat; i++)
+		r->cpb[i] = tsc[i] / ((double)(len ? len : 1) * v->lanes);
+	r->iters = iters;
+	r->ns_median = percentile(ns, o->repeat, 50);
+	r->ns_p10 = percentile(ns, o->repeat, 10);
+	r->ns_p90 = percentile(ns, o->repeat, 90);
+	r->ns_min = ns[0];
+	r->tsc_median = percentile(tsc, o->repeat, 50);
+}
+
+/* Nominal TSC rate in GHz, measured against CLOCK_MONOTONIC */
+static double tsc_ghz(void)
+{
+	u64 t0 = now_ns(), c0 = __rdtsc(), t1, c1;
+
+	do
+		t1 = now_ns();
+	while (t1 - t0 < 100000000ULL);
+	c1 = __rdtsc();
+	return (double)(c1 - c0) / (double)(t1 - t0);
+}
+
+static void print_result(const struct variant *v, const struct options *o,
+	u64 len, const struct result *r, u32 first)
+{
+	double bytes = (double)len * v->lanes;
+	double mbps = len ? len / r->ns_median * 1000.0 : 0.0;
+	double cpb_tsc = len ? r->tsc_median / bytes : 0.0;
+	double cpb_clk = len ? r->ns_median * o->ghz / len : 0.0;
+
+	if (o->json)
+	{
+		printf("%s\n\t\t{ \"variant\": \"%s\", \"lanes\": %u, "
+			"\"size\": %llu, \"iters\": %llu, "
+			"\"ns_per_hash\": { \"median\": %.2f, \"p10\": %.2f, "
+			"\"p90\": %.2f, \"min\": %.2f }, ",
+			first ? "" : ",", v->name, v->lanes, len, r->iters,
+			r->ns_median, r->ns_p10, r->ns_p90, r->ns_min);
+		if (len)
+			printf("\"mb_per_s\": %.2f, \"cycles_per_byte_tsc\": "
+				"%.3f, ", mbps, cpb_tsc);
+		else
+			printf("\"mb_per_s\": null, \"cycles_per_byte_tsc\": "
+				"null, ");
+		if (len && o->ghz > 0.0)
+			printf("\"cycles_per_byte_clk\": %.3f }", cpb_clk);
+		else
+			printf("\"cycles_per_byte_clk\": null }");
+		return;
+	}
+
+	printf("%-15s %8llu %10.1f %10.1f %10.1f", v->name, len,
+		r->ns_median, r->ns_p10, r->ns_p90);
+	if (len)
+		printf(" %9.1f %8.2f", mbps, cpb_tsc);
+	else
+		printf(" %9s %8s", "-", "-");
+	if (o->ghz > 0.0)
+	{
+		if (len)
+			printf(" %8.2f", cpb_clk);
+		else
+			printf(" %8s", "-");
+	}
+	printf("\n");
+}
+
+/* The samples of one variant at one size, for --save-baseline/--compare */
+struct sample_set {
+	char variant[32];
+	u64 size;
+	u32 n;
+	double cpb[MAX_REPEAT];
+};
+
+struct sample_list {
+	struct sample_set *sets;
+	u32 n;
+	u32 cap;
+};
+
+static struct sample_set *sample_list_add(struct sample_list *l,
+	const char *variant, u64 size)
+{
+	struct sample_set *s;
+
+	if (l->n == l->cap)
+	{
+		u32 cap = l->cap ? l->cap * 2 : 64;
+		struct sample_set *sets = realloc(l->sets, cap * sizeof(*sets));
+
+		if (sets == NULL)
+			return NULL;
+		l->sets = sets;
+		l->cap = cap;
+	}
+	s = &l->sets[l->n++];
+	memset(s, 0, sizeof(*s));
+	snprintf(s->variant, sizeof(s->variant), "%s", variant);
+	s->size = size;
+	return s;
+}
+
+static struct sample_set *sample_list_find(const struct sample_list *l,
+	const char *variant, u64 size)
+{
+	u32 i;
+
+	for (i = 0; i < l->n; i++)
+		if (l->sets[i].size == size && !strcmp(l->sets[i].variant, variant))
+			return &l->sets[i];
+	return NULL;
+}
+
+/* CPU model, the kernel features and the build.  A baseline only applies
+   to the same key. */
+static void host_key(char *key, u32 len)
+{
+	static const char *features[] = { "sse4.1", "bmi", "bmi2", "avx2", "sha" };
+	u32 brand[13] = { 0 };
+	char *model = (char *)brand;
+	u32 i, n;
+
+	if (__get_cpuid_max(0x80000000, NULL) >= 0x80000004)
+		for (i = 0; i < 3; i++)
+			__get_cpuid(0x80000002 + i, &brand[i * 4], &brand[i * 4 + 1],
+				&brand[i * 4 + 2], &brand[i * 4 + 3]);
+	while (*model == ' ')
+		model++;
+	n = snprintf(key, len, "%s |", *model ? model : "unknown");
+	for (i = 0; i < sizeof(features) / sizeof(features[0]); i++)
+		if (cpu_has(features[i]) && n < len)
+			n += snprintf(key + n, len - n, " %s", features[i]);
+	if (n < len)
+		snprintf(key + n, len - n, " | cc %s | %s", __VERSION__,
+			TSHA_BENCH_CFLAGS);
+}
+
+/* Reads the samples under the "host KEY" line of path.
+   returns:
+	<0 - error
+	n - sets read							      */
+static s32 baseline_load(const char *path, const char *key,
+	struct sample_list *l)
+{
+	char line[MAX_REPEAT * 16 + 256];
+	u32 mine = 0;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -errno;
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		char variant[32], *p, *end;
+		struct sample_set *s;
+		u64 size;
+		s32 at;
+
+		line[strcspn(line, "\n")] = '\0';
+		if (!strncmp(line, "host ", 5))
+		{
+			mine = !strcmp(line + 5, key);
+			continue;
+		}
+		if (!mine || line[0] == '#'
+			|| sscanf(line, "%31s %llu%n", variant, &size, &at) != 2)
+			continue;
+		s = sample_list_add(l, variant, size);
+		if (s == NULL)
+		{
+			fclose(fp);
+			return -ENOMEM;
+		}
+		for (p = line + at; s->n < MAX_REPEAT; p = end)
+		{
+			s->cpb[s->n] = strtod(p, &end);
+			if (end == p)
+				break;
+			s->n++;
+		}
+	}
+	fclose(fp);
+	return l->n;
+}
+
+/* Replaces the section of this host in path and keeps the other hosts.
+   returns:
+	<0 - error
+	0 - success							      */
+static s32 baseline_save(const char *path, const char *key,
+	const struct sample_list *l)
+{
+	char tmp[4096], line[MAX_REPEAT * 16 + 256];
+	u32 mine = 0, i, j;
+	FILE *in, *out;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	out = fopen(tmp, "w");
+	if (out == NULL)
+		return -errno;
+	in = fopen(path, "r");
+	if (in == NULL)
+		fprintf(out, "# tsha-bench baselines, TSC cycles per byte of each "
+			"sample (per hash at size 0)\n");
+	while (in && fgets(line, sizeof(line), in) != NULL)
+	{
+		if (!strncmp(line, "host ", 5))
+		{
+			line[strcspn(line, "\n")] = '\0';
+			mine = !strcmp(line + 5, key);
+			if (!mine)
+				fprintf(out, "%s\n", line);
+			continue;
+		}
+		if (!mine)
+			fputs(line, out);
+	}
+	if (in)
+		fclose(in);
+
+	fprintf(out, "host %s\n", key);
+	for (i = 0; i < l->n; i++)
+	{
+		fprintf(out, "%s %llu", l->sets[i].variant, l->sets[i].size);
+		for (j = 0; j < l->sets[i].n; j++)
+			fprintf(out, " %.4f", l->sets[i].cpb[j]);
+		fprintf(out, "\n");
+	}
+	if (fclose(out) != 0 || rename(tmp, path) < 0)
+		return -errno;
+	return 0;
+}
+
+/* One sided Mann-Whitney U test that now is slower than base.  Uses the
+   normal approximation with the tie correction, which is fine from about
+   7 samples a side; fewer samples can never reach a small p. */
+static double mann_whitney_p(const double *base, u32 nb, const double *now,
+	u32 nn)
+{
+	double rank_now = 0.0, ties = 0.0, u, mean, sigma, z;
+	u32 n = nb + nn, i, j, k;
+	struct { double v; u32 now; } all[2 * MAX_REPEAT], t;
+
+	for (i = 0; i < nb; i++)
+		all[i].v = base[i], all[i].now = 0;
+	for (i = 0; i < nn; i++)
+		all[nb + i].v = now[i], all[nb + i].now = 1;
+	for (i = 1; i < n; i++) // insertion sort, n is small
+	{
+		t = all[i];
+		for (j = i; j > 0 && all[j - 1].v > t.v; j--)
+			all[j] = all[j - 1];
+		all[j] = t;
+	}
+	for (i = 0; i < n; i = j)
+	{
+		for (j = i; j < n && all[j].v == all[i].v; j++)
+			;
+		/* Ranks i+1..j share their average */
+		for (k = i; k < j; k++)
+			if (all[k].now)
+				rank_now += (i + 1 + j) / 2.0;
+		ties += (double)(j - i) * (j - i) * (j - i) - (j - i);
+	}
+
+	u = rank_now - nn * (nn + 1) / 2.0;
+	mean = nb * nn / 2.0;
+	sigma = sqrt(nb * nn / 12.0 * ((n + 1) - ties / ((double)n * (n - 1))));
+	if (sigma == 0.0)
+		return 1.0;
+	z = (u - mean - 0.5) / sigma;
+	return 0.5 * erfc(z / sqrt(2.0));
+}
+
+static double median(const double *sorted, u32 n)
+{
+	return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+}
+
+/* Median of a set that may hold several separately sorted runs. */
+static double median_unsorted(const double *cpb, u32 n)
+{
+	double sorted[MAX_REPEAT];
+
+	memcpy(sorted, cpb, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), cmp_double);
+	return median(sorted, n);
+}
+
+/* Prints now against base.  A set regressed when its median is more than
+   --threshold percent slower and the test gives p < --alpha.
+   returns:
+	n - regressions							      */
+static u32 baseline_compare(const struct options *o, FILE *fp,
+	const struct sample_list *base, const struct sample_list *now)
+{
+	u32 regressions = 0, i;
+
+	fprintf(fp, "%-15s %8s %10s %10s %8s %8s\n", "variant", "bytes",
+		"base cyc/B", "now cyc/B", "change", "p");
+	for (i = 0; i < now->n; i++)
+	{
+		const struct sample_set *s = &now->sets[i];
+		const struct sample_set *b = sample_list_find(base, s->variant,
+			s->size);
+		double mb, mn, change, p;
+		const char *verdict;
+
+		if (b == NULL || b->n == 0)
+		{
+			fprintf(fp, "%-15s %8llu %10s %10.3f %8s %8s  new\n",
+				s->variant, s->size, "-",
+				median_unsorted(s->cpb, s->n),
+				"-", "-");
+			continue;
+		}
+		mb = median_unsorted(b->cpb, b->n);
+		mn = median_unsorted(s->cpb, s->n);
+		change = mb > 0.0 ? (mn - mb) / mb * 100.0 : 0.0;
+		p = mann_whitney_p(b->cpb, b->n, s->cpb, s->n);
+		if (change > o->threshold && p < o->alpha)
+		{
+			verdict = "REGRESSED";
+			regressions++;
+		}
+		else if (change < -o->threshold
+			&& 1.0 - p < o->alpha)
+			verdict = "faster";
+		else
+			verdict = "ok";
+		fprintf(fp, "%-15s %8llu %10.3f %10.3f %+7.1f%% %8.4f  %s\n",
+			s->variant, s->size, mb, mn, change, p, verdict);
+	}
+	if (regressions)
+		fprintf(fp, "%u regression(s) of more than %.1f%% at p < %g\n",
+			regressions, o->threshold, o->alpha);
+	else
+		fprintf(fp, "No regressions of more than %.1f%% at p < %g\n",
+			o->threshold, o->alpha);
+	return regressions;
+}
+
+/* One size with an optional K or M suffix.  *end is left past it. */
+static s32 parse_size(const char *p, char **end, u64 *n)
+{
+	*n = strtoull(p, end, 10);
+	if (*end == p)
+		return -EINVAL;
+	if (**end == 'K' || **end == 'k')
+		*n <<= 10, (*end)++;
+	else if (**end == 'M' || **end == 'm')
+		*n <<= 20, (*end)++;
+	return 0;
+}
+
+static s32 parse_sizes(struct options *o, const char *arg)
+{
+	const char *p = arg;
+	char *end;
+
+	o->nsizes = 0;
+	while (*p)
+	{
+		u64 n;
+
+		if (parse_size(p, &end, &n) < 0 || o->nsizes == MAX_SIZES)
+			return -EINVAL;
+		o->sizes[o->nsizes++] = n;
+		if (*end == ',')
+			end++;
+		else if (*end)
+			return -EINVAL;
+		p = end;
+	}
+	return o->nsizes ? 0 : -EINVAL;
+}
+
+/* Random in 0..n-1, n may exceed RAND_MAX */
+static u64 rand_below(u64 n)
+{
+	u64 r = ((u64)rand() << 31) ^ (u64)rand();
+
+	return n ? r % n : 0;
+}
+
+static s32 workload_add(struct workload *wl, u64 size)
+{
+	if (wl->n == wl->cap)
+	{
+		u64 cap = wl->cap ? wl->cap * 2 : 1024;
+		u64 *sizes = realloc(wl->sizes, cap * sizeof(u64));
+
+		if (sizes == NULL)
+			return -ENOMEM;
+		wl->sizes = sizes;
+		wl->cap = cap;
+	}
+	wl->sizes[wl->n++] = size;
+	wl->bytes += size;
+	if (size > wl->max_size)
+		wl->max_size = size;
+	return 0;
+}
+
+/* Reads the size distribution in path, see the comment at the top.
+   returns:
+	<0 - error
+	0 - success							      */
+static s32 load_workload(struct workload *wl, const char *path)
+{
+	char line[256];
+	u32 histogram = 0, lineno = 0;
+	s32 ret = 0;
+	FILE *fp;
+	u64 i;
+
+	memset(wl, 0, sizeof(*wl));
+	fp = fopen(path, "r");
+	if (fp == NULL)
+	{
+		perror(path);
+		return -errno;
+	}
+	srand(1);
+	while (ret == 0 && fgets(line, sizeof(line), fp) != NULL)
+	{
+		char *p = line, *end;
+		u64 lo, hi, count = 1;
+
+		lineno++;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '#' || *p == '\n' || *p == '\0')
+			continue;
+		if (parse_size(p, &end, &lo) < 0)
+			goto BAD_LINE;
+		hi = lo;
+		if (*end == '-' && (parse_size(end + 1, &end, &hi) < 0 || hi < lo))
+			goto BAD_LINE;
+		p = end;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p >= '0' && *p <= '9')
+		{
+			count = strtoull(p, &end, 10);
+			histogram = 1;
+			p = end;
+		}
+		else if (hi != lo)
+			goto BAD_LINE; // a range needs a count
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+			p++;
+		if (*p != '\0' && *p != '#')
+			goto BAD_LINE;
+		while (ret == 0 && count--)
+			ret = workload_add(wl, lo + rand_below(hi - lo + 1));
+		continue;
+BAD_LINE:
+		fprintf(stderr, "%s:%u: expected SIZE, SIZE COUNT or LO-HI COUNT\n",
+			path, lineno);
+		ret = -EINVAL;
+	}
+	fclose(fp);
+	if (ret == 0 && wl->n == 0)
+	{
+		fprintf(stderr, "%s: no messages\n", path);
+		ret = -EINVAL;
+	}
+	if (ret < 0)
+	{
+		free(wl->sizes);
+		return ret;
+	}
+
+	/* Fisher-Yates, so a histogram does not replay as sorted runs. */
+	if (histogram)
+	{
+		for (i = wl->n - 1; i > 0; i--)
+		{
+			u64 j = rand_below(i + 1), t = wl->sizes[i];
+
+			wl->sizes[i] = wl->sizes[j];
+			wl->sizes[j] = t;
+		}
+	}
+	return 0;
+}
+
+/* Where message i of len bytes starts in a buffer of window bytes.  Small
+   messages are spread out so they do not all hit the same cache lines. */
+static u64 replay_offset(u64 i, u64 len, u64 window)
+{
+	return ((i * 4160) % (window - len + 1)) & ~63ULL;
+}
+
+/* Nearest rank, p in per mille */
+static double permille(const double *sorted, u64 n, u32 p)
+{
+	u64 rank = (p * n + 999) / 1000;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static s32 replay_variant(const struct variant *v, const struct options *o,
+	const struct workload *wl, const u8 *buf, u64 window,
+	u8 *out[MAX_LANES], double ghz, struct replay_result *r)
+{
+	u64 block = v->alg == ALG_SHA256 ? 64 : 128;
+	u64 total = 0, final = 0, n = wl->n * o->repeat, i, k;
+	u64 warmup_end, c0, c1;
+	const u8 *msg[MAX_LANES];
+	double *ns;
+	u32 pass;
+
+	ns = malloc(n * sizeof(double));
+	if (ns == NULL)
+		return -ENOMEM;
+
+	warmup_end = now_ns() + (u64)o->warmup_ms * 1000000ULL;
+	for (i = 0; now_ns() < warmup_end; i = (i + 1) % wl->n)
+	{
+		msg[0] = buf + replay_offset(i, wl->sizes[i], window);
+		v->fn(msg, wl->sizes[i], out);
+	}
+
+	for (pass = 0, k = 0; pass < o->repeat; pass++)
+	{
+		for (i = 0; i < wl->n; i++, k++)
+		{
+			u64 len = wl->sizes[i];
+
+			msg[0] = buf + replay_offset(i, len, window);
+			c0 = __rdtsc();
+			v->fn(msg, len, out);
+			c1 = __rdtsc();
+			total += c1 - c0;
+			ns[k] = (double)(c1 - c0) / ghz;
+
+			/* The tail alone: reset, the last partial block, the
+			   padding and the output. */
+			msg[0] += len - len % block;
+			c0 = __rdtsc();
+			v->fn(msg, len % block, out);
+			c1 = __rdtsc();
+			final += c1 - c0;
+		}
+	}
+	sink ^= out[0][0];
+
+	qsort(ns, n, sizeof(double), cmp_double);
+	r->mbps = (double)wl->bytes * o->repeat / ((double)total / ghz) * 1000.0;
+	r->msgps = (double)n / ((double)total / ghz) * 1e9;
+	r->ns_p50 = permille(ns, n, 500);
+	r->ns_p90 = permille(ns, n, 900);
+	r->ns_p99 = permille(ns, n, 990);
+	r->ns_p999 = permille(ns, n, 999);
+	r->ns_max = ns[n - 1];
+	r->final_share = final < total ? (double)final / total : 1.0;
+	free(ns);
+	return 0;
+}
+
+static void print_replay(const struct variant *v, const struct options *o,
+	const struct replay_result *r, u32 first)
+{
+	if (o->json)
+	{
+		printf("%s\n\t\t{ \"variant\": \"%s\", \"mb_per_s\": %.2f, "
+			"\"messages_per_s\": %.1f, \"ns_per_message\": { "
+			"\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, "
+			"\"p99.9\": %.1f, \"max\": %.1f }, "
+			"\"finalization_share\": %.4f }",
+			first ? "" : ",", v->name, r->mbps, r->msgps, r->ns_p50,
+			r->ns_p90, r->ns_p99, r->ns_p999, r->ns_max,
+			r->final_share);
+		return;
+	}
+
+	printf("%-15s %9.1f %10.0f %12.1f %12.1f %12.1f %12.1f %12.1f "
+		"%6.1f%%\n", v->name, r->mbps, r->msgps, r->ns_p50, r->ns_p90,
+		r->ns_p99, r->ns_p999, r->ns_max, r->final_share * 100.0);
+}
+
+/* The --replay run of every selected single message variant */
+static s32 replay(const struct options *o)
+{
+	struct workload wl;
+	struct replay_result r;
+	const u8 *msg[MAX_LANES];
+	u8 *out[MAX_LANES];
+	u8 *buf, *digests;
+	u64 window, i, j;
+	u32 first = 1, k;
+	double ghz;
+
+	if (load_workload(&wl, o->replay) < 0)
+		return 1;
+	window = wl.max_size > REPLAY_WINDOW ? wl.max_size : REPLAY_WINDOW;
+	buf = aligned_alloc(64, window);
+	digests = aligned_alloc(64, 64 * MAX_LANES);
+	if (buf == NULL || digests == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	for (i = 0; i < window; i++)
+		buf[i] = rand();
+	for (k = 0; k < MAX_LANES; k++)
+	{
+		msg[k] = buf;
+		out[k] = digests + 64 * k;
+	}
+
+	ghz = tsc_ghz();
+	if (o->json)
+		printf("{\n\t\"tsc_ghz\": %.4f,\n\t\"workload\": \"%s\",\n"
+			"\t\"messages\": %llu,\n\t\"bytes\": %llu,\n"
+			"\t\"passes\": %u,\n\t\"results\": [", ghz, o->replay,
+			wl.n, wl.bytes, o->repeat);
+	else
+	{
+		printf("TSC %.3f GHz, %llu messages, %llu bytes from %s, "
+			"%u passes, times per message\n", ghz, wl.n, wl.bytes,
+			o->replay, o->repeat);
+		printf("%-15s %9s %10s %12s %12s %12s %12s %12s %7s\n",
+			"variant", "MB/s", "msg/s", "ns p50", "ns p90", "ns p99",
+			"ns p99.9", "ns max", "final");
+	}
+
+	for (i = 0; i < NVARIANTS; i++)
+	{
+		const struct variant *v = &variants[i];
+		u64 largest = 0;
+
+		if (!variant_selected(v, o->filter) || v->lanes != 1)
+			continue;
+		if (!variant_supported(v))
+		{
+			fprintf(stderr, "%s: skipped, not supported by this CPU\n",
+				v->name);
+			continue;
+		}
+		/* The first messages and the largest one */
+		for (j = 0; j < wl.n; j++)
+			if (wl.sizes[j] == wl.max_size)
+				largest = j;
+		for (j = 0; j < 16 && j < wl.n; j++)
+			if (check_variant(v, msg, wl.sizes[j], out) < 0)
+				break;
+		if ((j < 16 && j < wl.n)
+			|| check_variant(v, msg, wl.sizes[largest], out) < 0)
+		{
+			fprintf(stderr, "%s: skipped, wrong digest\n", v->name);
+			continue;
+		}
+		if (replay_variant(v, o, &wl, buf, window, out, ghz, &r) < 0)
+		{
+			fprintf(stderr, "Out of memory\n");
+			break;
+		}
+		print_replay(v, o, &r, first);
+		first = 0;
+	}
+
+	if (o->json)
+		printf("\n\t]\n}\n");
+
+	free(digests);
+	free(buf);
+	free(wl.sizes);
+
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [options]\n"
+		"  --list            list the variants and exit\n"
+		"  --variant=STR     only run variants whose name contains STR\n"
+		"  --sizes=N,...     message sizes, K and M suffixes allowed\n"
+		"                    (default 0,16,64,256,1K,4K,16K,64K,256K,1M)\n"
+		"  --repeat=N        samples per measurement (default 11)\n"
+		"  --warmup=MS       warm-up time per measurement (default 50)\n"
+		"  --min-time=MS     target time of one sample (default 20)\n"
+		"  --cpu=N           pin to CPU N\n"
+		"  --ghz=F           core clock for the wall time cycles/byte\n"
+		"  --replay=FILE     replay the message sizes in FILE instead\n"
+		"                    of --sizes, --repeat passes (default 1)\n"
+		"  --save-baseline=FILE  store the results for this host\n"
+		"  --compare=FILE    compare against the baseline for this host\n"
+		"                    and exit with 1 on a regression\n"
+		"  --runs=N          repeat the whole run N times (default 1)\n"
+		"  --threshold=PCT   slowdown that counts as a regression\n"
+		"                    (default 5)\n"
+		"  --alpha=P         significance level of the test (default 0.01)\n"
+		"  --json            JSON output\n", argv0);
+}
+
+s32 main(s32 argc, char *argv[])
+{
+	static const struct option long_options[] = {
+		{ "list", no_argument, NULL, 'l' },
+		{ "variant", required_argument, NULL, 'v' },
+		{ "sizes", required_argument, NULL, 's' },
+		{ "repeat", required_argument, NULL, 'r' },
+		{ "warmup", required_argument, NULL, 'w' },
+		{ "min-time", required_argument, NULL, 't' },
+		{ "cpu", required_argument, NULL, 'c' },
+		{ "ghz", required_argument, NULL, 'g' },
+		{ "replay", required_argument, NULL, 'p' },
+		{ "save-baseline", required_argument, NULL, 'B' },
+		{ "compare", required_argument, NULL, 'C' },
+		{ "runs", required_argument, NULL, 'R' },
+		{ "threshold", required_argument, NULL, 'T' },
+		{ "alpha", required_argument, NULL, 'A' },
+		{ "json", no_argument, NULL, 'j' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct options o;
+	struct sample_list base = { 0 }, now = { 0 };
+	const u8 *msg[MAX_LANES];
+	u8 *out[MAX_LANES];
+	u8 *buf, *digests;
+	char key[512];
+	u64 max_size = 0;
+	u32 list = 0, first = 1, repeat_set = 0, regressions = 0;
+	u32 i, j, k, run;
+	u8 skip[NVARIANTS];
+	s32 c, ret;
+
+	memset(&o, 0, sizeof(o));
+	o.warmup_ms = 50;
+	o.min_time_ms = 20;
+	o.repeat = 11;
+	o.cpu = -1;
+	o.runs = 1;
+	o.threshold = 5.0;
+	o.alpha = 0.01;
+	memcpy(o.sizes, default_sizes, sizeof(default_sizes));
+	o.nsizes = sizeof(default_sizes) / sizeof(default_sizes[0]);
+
+	while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+	{
+		switch (c)
+		{
+			case 'l': list = 1; break;
+			case 'v': o.filter = optarg; break;
+			case 's':
+				if (parse_sizes(&o, optarg) < 0)
+				{
+					fprintf(stderr, "Bad --sizes %s\n", optarg);
+					return 1;
+				}
+				break;
+			case 'r':
+				o.repeat = strtoul(optarg, NULL, 10);
+				repeat_set = 1;
+				break;
+			case 'w': o.warmup_ms = strtoul(optarg, NULL, 10); break;
+			case 't': o.min_time_ms = strtoul(optarg, NULL, 10); break;
+			case 'c': o.cpu = strtol(optarg, NULL, 10); break;
+			case 'g': o.ghz = strtod(optarg, NULL); break;
+			case 'p': o.replay = optarg; break;
+			case 'B': o.save_baseline = optarg; break;
+			case 'C': o.compare = optarg; break;
+			case 'R': o.runs = strtoul(optarg, NULL, 10); break;
+			case 'T': o.threshold = strtod(optarg, NULL); break;
+			case 'A': o.alpha = strtod(optarg, NULL); break;
+			case 'j': o.json = 1; break;
+			case 'h': usage(argv[0]); return 0;
+			default: usage(argv[0]); return 1;
+		}
+	}
+	if (o.replay && !repeat_set)
+		o.repeat = 1;
+	if (o.repeat == 0 || o.repeat > MAX_REPEAT || o.min_time_ms == 0
+		|| o.runs == 0)
+	{
+		fprintf(stderr, "--repeat must be 1..%u and --min-time and "
+			"--runs > 0\n", MAX_REPEAT);
+		return 1;
+	}
+
+	__builtin_cpu_init();
+
+	if (list)
+	{
+		for (i = 0; i < NVARIANTS; i++)
+			printf("%-15s lanes=%u %s\n", variants[i].name,
+				variants[i].lanes,
+				variant_supported(&variants[i])
+					? "" : "(not supported by this CPU)");
+		return 0;
+	}
+
+	if (o.cpu >= 0)
+	{
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(o.cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0)
+		{
+			perror("sched_setaffinity");
+			return 1;
+		}
+	}
+
+	if (o.replay && (o.save_baseline || o.compare))
+	{
+		fprintf(stderr, "--replay does not take --save-baseline or "
+			"--compare\n");
+		return 1;
+	}
+	if (o.replay)
+		return replay(&o);
+
+	host_key(key, sizeof(key));
+	if (o.compare)
+	{
+		ret = baseline_load(o.compare, key, &base);
+		if (ret <= 0)
+		{
+			fprintf(stderr, "%s: %s for host %s\n", o.compare,
+				ret < 0 ? strerror(-ret) : "no baseline", key);
+			return 1;
+		}
+	}
+
+	for (j = 0; j < o.nsizes; j++)
+		if (o.sizes[j] > max_size)
+			max_size = o.sizes[j];
+
+	/* A separate message per lane so the lanes do not share cache lines. */
+	buf = aligned_alloc(64, ((max_size + 63) & ~63ULL) * MAX_LANES + 64);
+	digests = aligned_alloc(64, 64 * MAX_LANES);
+	if (buf == NULL || digests == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	srand(1);
+	for (i = 0; i < ((max_size + 63) & ~63ULL) * MAX_LANES; i++)
+		buf[i] = rand();
+	for (k = 0; k < MAX_LANES; k++)
+	{
+		msg[k] = buf + ((max_size + 63) & ~63ULL) * k;
+		out[k] = digests + 64 * k;
+	}
+
+	if (o.json)
+		printf("{\n\t\"tsc_ghz\": %.4f,\n\t\"repeat\": %u,\n"
+			"\t\"results\": [", tsc_ghz(), o.repeat);
+	else
+	{
+		printf("TSC %.3f GHz, %u samples of >= %u ms, times per hash\n",
+			tsc_ghz(), o.repeat, o.min_time_ms);
+		printf("%-15s %8s %10s %10s %10s %9s %8s%s\n", "variant", "bytes",
+			"ns median", "ns p10", "ns p90", "MB/s", "cyc/B",
+			o.ghz > 0.0 ? "  cyc/B@f" : "");
+	}
+
+	for (i = 0; i < NVARIANTS; i++)
+	{
+		const struct variant *v = &variants[i];
+
+		skip[i] = 1;
+		if (!variant_selected(v, o.filter))
+			continue;
+		if (!variant_supported(v))
+		{
+			fprintf(stderr, "%s: skipped, not supported by this CPU\n",
+				v->name);
+			continue;
+		}
+		for (j = 0; j < o.nsizes; j++)
+		{
+			if (check_variant(v, msg, o.sizes[j], out) < 0)
+			{
+				fprintf(stderr, "%s: skipped, wrong digest for "
+					"%llu bytes\n", v->name, o.sizes[j]);
+				break;
+			}
+		}
+		skip[i] = j < o.nsizes;
+	}
+
+	/* Each --runs pass goes over every variant again, so drift between
+	   passes ends up inside the samples instead of between two sets. */
+	for (run = 0; run < o.runs; run++)
+	{
+		for (i = 0; i < NVARIANTS; i++)
+		{
+			const struct variant *v = &variants[i];
+
+			if (skip[i])
+				continue;
+			for (j = 0; j < o.nsizes; j++)
+			{
+				struct result r;
+				struct sample_set *s;
+
+				bench_variant(v, &o, msg, o.sizes[j], out, &r);
+				print_result(v, &o, o.sizes[j], &r, first);
+				first = 0;
+				if (!o.save_baseline && !o.compare)
+					continue;
+				s = sample_list_find(&now, v->name, o.sizes[j]);
+				if (s == NULL)
+					s = sample_list_add(&now, v->name, o.sizes[j]);
+				if (s == NULL)
+				{
+					fprintf(stderr, "Out of memory\n");
+					return 1;
+				}
+				for (k = 0; k < o.repeat && s->n < MAX_REPEAT; k++)
+					s->cpb[s->n++] = r.cpb[k];
+			}
+		}
+	}
+
+	if (o.json)
+		printf("\n\t]\n}\n");
+
+	/* The JSON stays on stdout on its own. */
+	if (o.compare)
+	{
+		FILE *fp = o.json ? stderr : stdout;
+
+		fprintf(fp, "\nAgainst %s, host %s\n", o.compare, key);
+		regressions = baseline_compare(&o, fp, &base, &now);
+	}
+	if (o.save_baseline)
+	{
+		ret = baseline_save(o.save_baseline, key, &now);
+		if (ret < 0)
+		{
+			fprintf(stderr, "%s: %s\n", o.save_baseline,
+				strerror(-ret));
+			return 1;
+		}
+	}
+
+	free(now.sets);
+	free(base.sets);
+	free(digests);
+	free(buf);
+
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * tsha256 - A register based Secure Hashing Algorithm 2 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/* USDT probe points for perf, bpftrace and SystemTap */
+
+#ifndef TSHA_PROBES
+#define TSHA_PROBES
+
+/*
+   TSHA_PROBE(engine, name, state) marks a probe with the arguments
+
+	arg0	- the state pointer
+	arg1	- state->msglen
+	arg2	- state->event
+
+   The probe is written in the .note.stapsdt format of <sys/sdt.h>, but the
+   note is emitted here so neither systemtap-sdt-dev nor any library is
+   needed.  It costs one nop in the code.  The arguments are only described
+   in the note as the register or memory they already live in, so nothing
+   is loaded until a tracer attaches, e.g.
+
+	bpftrace -e 'usdt:./tsha256r:tsha256r:block_start { ... }'
+	perf probe -x ./tsha256r sdt_tsha256r:update_start
+
+   The assembly engines include this file too and use the tsha_probe
+   assembler macro with the argument string spelled out.
+
+   -DNO_PROBES or a target that is not x86-64 ELF leaves the hooks empty.
+*/
+
+#if defined(__x86_64__) && defined(__ELF__) && !defined(NO_PROBES)
+#  define TSHA_PROBES_ENABLED
+#endif
+
+#ifdef __ASSEMBLER__
+
+#ifdef TSHA_PROBES_ENABLED
+.macro tsha_probe provider, name, args
+990:	nop
+	.pushsection .note.stapsdt,"?","note"
+	.balign 4
+	.4byte 992f-991f, 994f-993f, 3
+991:	.asciz "stapsdt"
+992:	.balign 4
+993:	.8byte 990b
+	.8byte _.stapsdt.base
+	.8byte 0
+	.asciz "\provider"
+	.asciz "\name"
+	.asciz "\args"
+994:	.balign 4
+	.popsection
+	.ifndef _.stapsdt.base
+	.pushsection .stapsdt.base,"aG","progbits",.stapsdt.base,comdat
+	.weak _.stapsdt.base
+	.hidden _.stapsdt.base
+_.stapsdt.base:
+	.space 1
+	.size _.stapsdt.base, 1
+	.popsection
+	.endif
+.endm
+#else
+.macro tsha_probe provider, name, args
+.endm
+#endif // TSHA_PROBES_ENABLED
+
+#else
+
+#ifdef TSHA_PROBES_ENABLED
+/* The same note as the tsha_probe macro above.  The sizes come from %c of
+   an "n" operand so the fields keep their own width.  The operand names
+   are prefixed because the engines define a..h as macros. */
+#  define TSHA_PROBE_NOTE(PROVIDER,NAME,ARGS)					\
+	"990:	nop\n"								\
+	"	.pushsection .note.stapsdt,\"?\",\"note\"\n"			\
+	"	.balign 4\n"							\
+	"	.4byte 992f-991f, 994f-993f, 3\n"				\
+	"991:	.asciz \"stapsdt\"\n"						\
+	"992:	.balign 4\n"							\
+	"993:	.8byte 990b\n"							\
+	"	.8byte _.stapsdt.base\n"					\
+	"	.8byte 0\n"							\
+	"	.asciz \"" PROVIDER "\"\n"					\
+	"	.asciz \"" NAME "\"\n"						\
+	"	.asciz \"" ARGS "\"\n"						\
+	"994:	.balign 4\n"							\
+	"	.popsection\n"							\
+	"	.ifndef _.stapsdt.base\n"					\
+	"	.pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	"	.weak _.stapsdt.base\n"						\
+	"	.hidden _.stapsdt.base\n"					\
+	"_.stapsdt.base:\n"							\
+	"	.space 1\n"							\
+	"	.size _.stapsdt.base, 1\n"					\
+	"	.popsection\n"							\
+	"	.endif\n"
+#  define TSHA_PROBE(ENGINE,NAME,STATE)						\
+	__asm__ __volatile__ (TSHA_PROBE_NOTE(#ENGINE, #NAME,			\
+		"%c[tsha_ss]@%[tsha_s] %c[tsha_ls]@%[tsha_l] "		\
+		"%c[tsha_es]@%[tsha_e]")					\
+		:: [tsha_s] "nor" (STATE),					\
+		[tsha_l] "nor" ((STATE)->msglen),				\
+		[tsha_e] "nor" ((STATE)->event),				\
+		[tsha_ss] "n" (sizeof(STATE)),					\
+		[tsha_ls] "n" (sizeof((STATE)->msglen)),			\
+		[tsha_es] "n" (sizeof((STATE)->event)))
+#else
+#  define TSHA_PROBE(ENGINE,NAME,STATE)
+#endif // TSHA_PROBES_ENABLED
+
+#endif // __ASSEMBLER__
+
+#endif // TSHA_PROBES
@@ -0,0 +1,428 @@
+/*
+ * tsha256 - A register based Secure Hashing Algorithm 2 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Per phase hardware counters for the -prof build targets */
+
+#ifndef TSHA_PROF
+#define TSHA_PROF
+
+/*
+   With -DUSE_PROF the engine brackets its phases with TSHA_PROF_PUSH and
+   TSHA_PROF_POP.  Each switch reads cycles, instructions, branch misses and
+   L1D read misses with rdpmc and charges the counts since the last switch to
+   the phase on top of the stack, so a nested phase is not counted twice.
+   tsha_prof_report prints the totals.
+
+   A switch costs a few rdpmc, which is more than one byte insertion or one
+   expansion step.  What a switch adds to an interval is measured at start
+   up as the smallest count of many empty intervals, so an interrupt during
+   the calibration does not inflate it, and taken back out of every phase.
+   The report prints the raw count next to the net one and marks a phase
+   whose raw count was below the overhead instead of silently showing 0.
+
+   A phase that is interleaved with another one, like the rolling message
+   expansion inside the rounds, is bracketed with TSHA_PROF_SPLIT_BEGIN and
+   TSHA_PROF_SPLIT_END instead.  The counts in between are moved from the
+   phase on top to the split phase without a switch, and the cost of the
+   reads is calibrated on its own, inside and around the bracket.
+
+   When perf_event_open fails, e.g. in a guest without a virtual PMU or with
+   a high perf_event_paranoid, the cycles fall back to rdtsc and the other
+   counters are reported as n/a.  When the kernel does not allow rdpmc from
+   user space, the counters are read with read(2), which is far slower.
+
+   Without USE_PROF the macros are empty.
+*/
+
+#define TSHA_PROF_OTHER		0 // the caller, outside the engine
+#define TSHA_PROF_INSERT	1 // message bytes into W
+#define TSHA_PROF_EXPANSION	2 // W[16..63]
+#define TSHA_PROF_ROUNDS	3 // the rounds and the H update
+#define TSHA_PROF_FSM		4 // *_update outside the compression
+#define TSHA_PROF_CLEAR		5 // scrubbing W and the state
+#define TSHA_PROF_NPHASES	6
+
+#ifdef USE_PROF
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define TSHA_PROF_NCOUNTERS	4
+#define TSHA_PROF_DEPTH		8
+
+struct tsha_prof {
+	s32 fd[TSHA_PROF_NCOUNTERS];
+	struct perf_event_mmap_page *pc[TSHA_PROF_NCOUNTERS];
+	u32 ncounters; // 0 when only rdtsc is available
+	u32 use_rdpmc;
+
+	u64 last[TSHA_PROF_NCOUNTERS];
+	u64 total[TSHA_PROF_NPHASES][TSHA_PROF_NCOUNTERS];
+	u64 switches[TSHA_PROF_NPHASES];
+	u64 calls[TSHA_PROF_NPHASES];
+	u64 overhead[TSHA_PROF_NCOUNTERS]; // per interval
+
+	u64 split_start[TSHA_PROF_NCOUNTERS];
+	u32 split_phase;
+	u64 splits[TSHA_PROF_NPHASES]; // brackets charged to the phase
+	u64 split_hosts[TSHA_PROF_NPHASES]; // brackets taken out of the phase
+	u64 split_in[TSHA_PROF_NCOUNTERS]; // per bracket, inside it
+	u64 split_out[TSHA_PROF_NCOUNTERS]; // per bracket, around it
+
+	u32 stack[TSHA_PROF_DEPTH];
+	u32 depth;
+};
+
+static struct tsha_prof tsha_prof;
+
+static const char *tsha_prof_phase_names[TSHA_PROF_NPHASES] = {
+	"other", "insert", "expansion", "rounds", "fsm", "clear"
+};
+
+static const char *tsha_prof_counter_names[TSHA_PROF_NCOUNTERS] = {
+	"cycles", "instructions", "branch-misses", "L1D-misses"
+};
+
+static u64 tsha_prof_read_one(u32 i)
+{
+	struct perf_event_mmap_page *pc = tsha_prof.pc[i];
+	u64 count;
+	u32 seq, idx;
+
+	if (!tsha_prof.use_rdpmc)
+	{
+		if (read(tsha_prof.fd[i], &count, sizeof(count)) != sizeof(count))
+			count = 0;
+		return count;
+	}
+
+	/* The seqlock protocol from linux/perf_event.h */
+	do
+	{
+		seq = pc->lock;
+		__asm__ __volatile__("" ::: "memory");
+		idx = pc->index;
+		count = pc->offset;
+		if (pc->cap_user_rdpmc && idx)
+		{
+			s64 pmc = __rdpmc(idx - 1);
+
+			pmc <<= 64 - pc->pmc_width;
+			pmc >>= 64 - pc->pmc_width;
+			count += pmc;
+		}
+		__asm__ __volatile__("" ::: "memory");
+	} while (pc->lock != seq);
+
+	return count;
+}
+
+static void tsha_prof_read(u64 *now)
+{
+	u32 i;
+
+	if (tsha_prof.ncounters == 0)
+	{
+		memset(now, 0, TSHA_PROF_NCOUNTERS * sizeof(u64));
+		now[0] = __rdtsc();
+		return;
+	}
+	for (i = 0; i < tsha_prof.ncounters; i++)
+		now[i] = tsha_prof_read_one(i);
+}
+
+/* Charges the counts since the last switch to the phase on top. */
+static void tsha_prof_switch(void)
+{
+	u64 now[TSHA_PROF_NCOUNTERS];
+	u32 cur = tsha_prof.stack[tsha_prof.depth];
+	u32 i;
+
+	tsha_prof_read(now);
+	for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+	{
+		tsha_prof.total[cur][i] += now[i] - tsha_prof.last[i];
+		tsha_prof.last[i] = now[i];
+	}
+	tsha_prof.switches[cur]++;
+}
+
+static void tsha_prof_push(u32 phase)
+{
+	tsha_prof_switch();
+	if (tsha_prof.depth + 1 < TSHA_PROF_DEPTH)
+		tsha_prof.depth++;
+	tsha_prof.stack[tsha_prof.depth] = phase;
+	tsha_prof.calls[phase]++;
+}
+
+static void tsha_prof_pop(void)
+{
+	tsha_prof_switch();
+	if (tsha_prof.depth > 0)
+		tsha_prof.depth--;
+}
+
+static void tsha_prof_split_begin(u32 phase)
+{
+	tsha_prof.split_phase = phase;
+	tsha_prof_read(tsha_prof.split_start);
+}
+
+/* Moves the counts since tsha_prof_split_begin from the phase on top to
+   the split phase.  The phase on top is charged at its next switch, so
+   its total may wrap below 0 until then. */
+static void tsha_prof_split_end(void)
+{
+	u64 now[TSHA_PROF_NCOUNTERS];
+	u32 cur = tsha_prof.stack[tsha_prof.depth];
+	u32 i;
+
+	tsha_prof_read(now);
+	for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+	{
+		u64 delta = now[i] - tsha_prof.split_start[i];
+
+		tsha_prof.total[tsha_prof.split_phase][i] += delta;
+		tsha_prof.total[cur][i] -= delta;
+	}
+	tsha_prof.splits[tsha_prof.split_phase]++;
+	tsha_prof.split_hosts[cur]++;
+	tsha_prof.calls[tsha_prof.split_phase]++;
+}
+
+static s32 tsha_prof_open(u32 type, u64 config, s32 group_fd)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/* Opens the counters and measures the cost of a switch.
+   returns:
+	0 - hardware counters
+	<0 - rdtsc only						      */
+static s32 tsha_prof_init(void)
+{
+	static const u32 types[TSHA_PROF_NCOUNTERS] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+		PERF_TYPE_HW_CACHE
+	};
+	static const u64 configs[TSHA_PROF_NCOUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_L1D
+			| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+	};
+	s32 ret = 0;
+	u32 i, n;
+
+	memset(&tsha_prof, 0, sizeof(tsha_prof));
+	tsha_prof.use_rdpmc = 1;
+	for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+	{
+		tsha_prof.fd[i] = tsha_prof_open(types[i], configs[i],
+			i == 0 ? -1 : tsha_prof.fd[0]);
+		if (tsha_prof.fd[i] < 0)
+		{
+			ret = -errno;
+			break;
+		}
+		tsha_prof.pc[i] = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ,
+			MAP_SHARED, tsha_prof.fd[i], 0);
+		if (tsha_prof.pc[i] == MAP_FAILED)
+		{
+			ret = -errno;
+			close(tsha_prof.fd[i]);
+			break;
+		}
+		if (!tsha_prof.pc[i]->cap_user_rdpmc)
+			tsha_prof.use_rdpmc = 0;
+		tsha_prof.ncounters++;
+	}
+	if (ret < 0)
+	{
+		while (tsha_prof.ncounters > 0)
+		{
+			tsha_prof.ncounters--;
+			munmap(tsha_prof.pc[tsha_prof.ncounters],
+				sysconf(_SC_PAGESIZE));
+			close(tsha_prof.fd[tsha_prof.ncounters]);
+		}
+		fprintf(stderr, "perf_event_open: %s.  Only rdtsc is used.\n",
+			strerror(-ret));
+	}
+
+	/* Every interval between two switches carries part of the cost of
+	   the reads at both ends, and a split bracket part of its own reads
+	   inside and the rest around it.  Measure both on empty intervals and
+	   keep the smallest, an interrupt or a migration only adds to them. */
+#	define TSHA_PROF_NCAL 10000
+	for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+	{
+		tsha_prof.overhead[i] = ~0ULL;
+		tsha_prof.split_in[i] = ~0ULL;
+		tsha_prof.split_out[i] = ~0ULL;
+	}
+	tsha_prof_read(tsha_prof.last);
+	for (n = 0; n < TSHA_PROF_NCAL; n++)
+	{
+		u64 other[TSHA_PROF_NCOUNTERS];
+		u64 split[TSHA_PROF_NCOUNTERS];
+
+		memcpy(other, tsha_prof.total[TSHA_PROF_OTHER], sizeof(other));
+		tsha_prof_switch();
+		for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+		{
+			u64 d = tsha_prof.total[TSHA_PROF_OTHER][i] - other[i];
+
+			if (d < tsha_prof.overhead[i])
+				tsha_prof.overhead[i] = d;
+		}
+
+		memcpy(other, tsha_prof.total[TSHA_PROF_OTHER], sizeof(other));
+		memcpy(split, tsha_prof.total[TSHA_PROF_EXPANSION],
+			sizeof(split));
+		tsha_prof_split_begin(TSHA_PROF_EXPANSION);
+		tsha_prof_split_end();
+		tsha_prof_switch();
+		for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+		{
+			u64 in = tsha_prof.total[TSHA_PROF_EXPANSION][i]
+				- split[i];
+			u64 out = tsha_prof.total[TSHA_PROF_OTHER][i]
+				- other[i];
+
+			if (in < tsha_prof.split_in[i])
+				tsha_prof.split_in[i] = in;
+			if (out < tsha_prof.split_out[i])
+				tsha_prof.split_out[i] = out;
+		}
+	}
+	/* What is left around the bracket is an empty interval as well. */
+	for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+		tsha_prof.split_out[i] = tsha_prof.split_out[i]
+			> tsha_prof.overhead[i]
+			? tsha_prof.split_out[i] - tsha_prof.overhead[i] : 0;
+
+	memset(tsha_prof.total, 0, sizeof(tsha_prof.total));
+	memset(tsha_prof.switches, 0, sizeof(tsha_prof.switches));
+	memset(tsha_prof.calls, 0, sizeof(tsha_prof.calls));
+	memset(tsha_prof.splits, 0, sizeof(tsha_prof.splits));
+	memset(tsha_prof.split_hosts, 0, sizeof(tsha_prof.split_hosts));
+	tsha_prof_read(tsha_prof.last);
+	return ret;
+}
+
+/* Prints the counts per phase for bytes of message.  A * after a count
+   marks a net count that was clamped to 0. */
+static void tsha_prof_report(const char *name, u64 bytes)
+{
+	u64 net[TSHA_PROF_NPHASES][TSHA_PROF_NCOUNTERS];
+	u32 clamped[TSHA_PROF_NPHASES][TSHA_PROF_NCOUNTERS];
+	u64 engine_cycles = 0;
+	u32 any_clamped = 0;
+	u32 p, i;
+
+	tsha_prof_switch();
+
+	for (p = 0; p < TSHA_PROF_NPHASES; p++)
+	{
+		for (i = 0; i < TSHA_PROF_NCOUNTERS; i++)
+		{
+			u64 cost = tsha_prof.switches[p] * tsha_prof.overhead[i]
+				+ tsha_prof.splits[p] * tsha_prof.split_in[i]
+				+ tsha_prof.split_hosts[p] * tsha_prof.split_out[i];
+
+			clamped[p][i] = tsha_prof.total[p][i] < cost;
+			net[p][i] = clamped[p][i] ? 0 : tsha_prof.total[p][i] - cost;
+			if (i < tsha_prof.ncounters || i == 0)
+				any_clamped |= clamped[p][i];
+		}
+		if (p != TSHA_PROF_OTHER)
+			engine_cycles += net[p][0];
+	}
+
+	printf("%s: %llu bytes, %s, %llu %s per interval and %llu per split "
+		"taken out\n", name, bytes,
+		tsha_prof.ncounters == 0 ? "rdtsc ticks"
+			: tsha_prof.use_rdpmc ? "rdpmc" : "read(2)",
+		tsha_prof.overhead[0],
+		tsha_prof.ncounters == 0 ? "ticks" : "cycles",
+		tsha_prof.split_in[0] + tsha_prof.split_out[0]);
+	printf("%-10s %10s %14s %14s %6s %14s %6s %13s %13s %9s\n", "phase",
+		"calls", tsha_prof.ncounters == 0 ? "raw ticks" : "raw cycles",
+		tsha_prof.ncounters == 0 ? "ticks" : tsha_prof_counter_names[0],
+		"%", tsha_prof_counter_names[1], "IPC",
+		tsha_prof_counter_names[2], tsha_prof_counter_names[3],
+		"cyc/byte");
+	for (p = 0; p < TSHA_PROF_NPHASES; p++)
+	{
+		printf("%-10s %10llu %14llu %13llu%c %5.1f%%",
+			tsha_prof_phase_names[p], tsha_prof.calls[p],
+			tsha_prof.total[p][0], net[p][0],
+			clamped[p][0] ? '*' : ' ',
+			p == TSHA_PROF_OTHER || engine_cycles == 0 ? 0.0
+				: 100.0 * net[p][0] / engine_cycles);
+		if (tsha_prof.ncounters == TSHA_PROF_NCOUNTERS)
+			printf(" %13llu%c %6.2f %12llu%c %12llu%c", net[p][1],
+				clamped[p][1] ? '*' : ' ',
+				net[p][0] ? (double)net[p][1] / net[p][0] : 0.0,
+				net[p][2], clamped[p][2] ? '*' : ' ',
+				net[p][3], clamped[p][3] ? '*' : ' ');
+		else
+			printf(" %14s %6s %13s %13s", "n/a", "n/a", "n/a",
+				"n/a");
+		printf(" %9.2f\n", bytes ? (double)net[p][0] / bytes : 0.0);
+	}
+	printf("%% is of the engine phases, other is the driver loop.  raw is "
+		"before the overhead\nis taken out.\n");
+	if (any_clamped)
+		printf("* below the overhead taken out, the phase is too fine "
+			"grained to measure.\n");
+}
+
+#  define TSHA_PROF_PUSH(phase) tsha_prof_push(phase)
+#  define TSHA_PROF_POP() tsha_prof_pop()
+#  define TSHA_PROF_SPLIT_BEGIN(phase) tsha_prof_split_begin(phase)
+#  define TSHA_PROF_SPLIT_END() tsha_prof_split_end()
+#else
+#  define TSHA_PROF_PUSH(phase)
+#  define TSHA_PROF_POP()
+#  define TSHA_PROF_SPLIT_BEGIN(phase)
+#  define TSHA_PROF_SPLIT_END()
+#endif // USE_PROF
+
+#endif // TSHA_PROF
@@ -0,0 +1,278 @@
+/*
+ * tsha256 - A register based Secure Hashing Algorithm 2 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Run time statistics for the engines */
+
+#ifndef TSHA_STATS
+#define TSHA_STATS
+
+/*
+   With -DUSE_STATS every engine counts, per thread:
+
+	bytes	- message bytes taken in
+	blocks	- message blocks compressed, per lane for multi-buffer
+	finals	- messages padded and completed
+	errors	- transitions to the FSM error state and calls that fail
+		  with an error code
+	cycles	- rdtsc ticks spent in the compression calls, or ns on
+		  targets without a TSC
+
+   A thread only writes its own counters, so an update is a plain add
+   without a lock prefix.  tsha_stats_snapshot sums the live threads and
+   the threads that already exited.  Without USE_STATS the hooks are empty
+   and tsha_stats_snapshot returns -ENOTSUP.
+
+   The cycles are taken around whole compression calls and not around
+   single byte insertions, where the rdtsc would cost more than the work.
+
+   The registry is defined weak in this header so every object that
+   includes it shares one copy and no extra object file is linked in.
+
+   The assembly engines count in their FSMs with tsha_stats_add, a single
+   add to the thread's counter, so callers of getch and update are counted
+   as well.  The thread is registered in reset, where W is about to be
+   cleared anyway, because the registration calls into the C library.
+   Cycles are only taken by the C wrappers around the assembly.
+*/
+
+#define TSHA_STATS_SHA256R	0
+#define TSHA_STATS_SHA256P	1
+#define TSHA_STATS_SHA256HP	2
+#define TSHA_STATS_SHA256HA	3
+#define TSHA_STATS_SHA256A	4
+#define TSHA_STATS_SHA256MB4	5
+#define TSHA_STATS_SHA256MB8	6
+#define TSHA_STATS_SHA512T256R	7
+#define TSHA_STATS_SHA512T256P	8
+#define TSHA_STATS_SHA512T256A	9
+#define TSHA_STATS_SHA512T256MB4 10
+#define TSHA_STATS_NENGINES	11
+
+/* Offsets into struct tsha_stats_thread for the assembly engines */
+#define TSHA_STATS_SIZE		40
+#define TSHA_STATS_BYTES	0
+#define TSHA_STATS_BLOCKS	8
+#define TSHA_STATS_FINALS	16
+#define TSHA_STATS_ERRORS	24
+#define TSHA_STATS_CYCLES	32
+#define TSHA_STATS_REGISTERED	(TSHA_STATS_NENGINES * TSHA_STATS_SIZE + 8)
+
+#ifdef __ASSEMBLER__
+
+/* Adds n to a counter of this thread.  Only the flags are clobbered.  The
+   objects are linked without -pie, so the TLS offset is a constant. */
+.macro tsha_stats_add engine, field, n
+#ifdef USE_STATS
+	addq		$\n,%fs:tsha_stats_self@tpoff+(\engine * TSHA_STATS_SIZE + \field)
+#endif
+.endm
+
+/* Registers this thread on its first reset.  Clobbers the caller saved
+   registers except rdi, so it has to come before W and a..h are set. */
+.macro tsha_stats_touch
+#ifdef USE_STATS
+	cmpl		$0,%fs:tsha_stats_self@tpoff+TSHA_STATS_REGISTERED
+	jne		993f
+	pushq		%rdi
+	call		tsha_stats_register
+	popq		%rdi
+993:
+#endif
+.endm
+
+#else
+
+struct tsha_stats {
+	u64 bytes;
+	u64 blocks;
+	u64 finals;
+	u64 errors;
+	u64 cycles;
+};
+
+#ifdef USE_STATS
+
+#include <pthread.h>
+#include <stddef.h>
+#if defined(__x86_64__) || defined(__i386__)
+#  include <x86intrin.h>
+#  define tsha_stats_ticks() __rdtsc()
+#else
+#  include <time.h>
+/* Nanoseconds where there is no TSC */
+static inline u64 tsha_stats_ticks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+#endif
+
+struct tsha_stats_thread {
+	struct tsha_stats engine[TSHA_STATS_NENGINES];
+	struct tsha_stats_thread *next;
+	u32 registered;
+};
+
+_Static_assert(sizeof(struct tsha_stats) == TSHA_STATS_SIZE
+	&& offsetof(struct tsha_stats, errors) == TSHA_STATS_ERRORS
+	&& offsetof(struct tsha_stats_thread, registered)
+		== TSHA_STATS_REGISTERED,
+	"tsha_stats_add offsets are out of date");
+
+struct tsha_stats_registry {
+	pthread_mutex_t lock;
+	pthread_once_t once;
+	pthread_key_t key;
+	struct tsha_stats_thread *threads;
+	struct tsha_stats retired[TSHA_STATS_NENGINES];
+};
+
+__thread struct tsha_stats_thread tsha_stats_self __attribute__((weak));
+struct tsha_stats_registry tsha_stats_registry __attribute__((weak)) = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.once = PTHREAD_ONCE_INIT,
+};
+
+__attribute__((weak)) const char *tsha_stats_engine_names[TSHA_STATS_NENGINES] = {
+	"sha256r", "sha256p", "sha256hp", "sha256ha", "sha256a", "sha256mb4",
+	"sha256mb8", "sha512/256r", "sha512/256p", "sha512/256a",
+	"sha512/256mb4"
+};
+
+static void tsha_stats_sum(struct tsha_stats *to, const struct tsha_stats *from)
+{
+	to->bytes += __atomic_load_n(&from->bytes, __ATOMIC_RELAXED);
+	to->blocks += __atomic_load_n(&from->blocks, __ATOMIC_RELAXED);
+	to->finals += __atomic_load_n(&from->finals, __ATOMIC_RELAXED);
+	to->errors += __atomic_load_n(&from->errors, __ATOMIC_RELAXED);
+	to->cycles += __atomic_load_n(&from->cycles, __ATOMIC_RELAXED);
+}
+
+/* Folds an exiting thread into the retired totals. */
+__attribute__((weak)) void tsha_stats_thread_exit(void *arg)
+{
+	struct tsha_stats_registry *r = &tsha_stats_registry;
+	struct tsha_stats_thread *self = arg;
+	struct tsha_stats_thread **p;
+	u32 i;
+
+	pthread_mutex_lock(&r->lock);
+	for (i = 0; i < TSHA_STATS_NENGINES; i++)
+		tsha_stats_sum(&r->retired[i], &self->engine[i]);
+	for (p = &r->threads; *p != NULL; p = &(*p)->next)
+	{
+		if (*p == self)
+		{
+			*p = self->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+__attribute__((weak)) void tsha_stats_key_create(void)
+{
+	pthread_key_create(&tsha_stats_registry.key, tsha_stats_thread_exit);
+}
+
+/* Runs once per thread, on the first count. */
+__attribute__((weak)) void tsha_stats_register(void)
+{
+	struct tsha_stats_registry *r = &tsha_stats_registry;
+
+	pthread_once(&r->once, tsha_stats_key_create);
+	pthread_mutex_lock(&r->lock);
+	tsha_stats_self.next = r->threads;
+	r->threads = &tsha_stats_self;
+	tsha_stats_self.registered = 1;
+	pthread_mutex_unlock(&r->lock);
+	pthread_setspecific(r->key, &tsha_stats_self);
+}
+
+/* Totals over every thread that has hashed so far.
+   returns:
+	0 - success						      */
+__attribute__((weak)) s32 tsha_stats_snapshot(
+	struct tsha_stats out[TSHA_STATS_NENGINES])
+{
+	struct tsha_stats_registry *r = &tsha_stats_registry;
+	struct tsha_stats_thread *t;
+	u32 i;
+
+	memset(out, 0, TSHA_STATS_NENGINES * sizeof(struct tsha_stats));
+	pthread_mutex_lock(&r->lock);
+	for (i = 0; i < TSHA_STATS_NENGINES; i++)
+		tsha_stats_sum(&out[i], &r->retired[i]);
+	for (t = r->threads; t != NULL; t = t->next)
+		for (i = 0; i < TSHA_STATS_NENGINES; i++)
+			tsha_stats_sum(&out[i], &t->engine[i]);
+	pthread_mutex_unlock(&r->lock);
+
+	return 0;
+}
+
+static inline struct tsha_stats *tsha_stats_get(u32 engine)
+{
+	if (__builtin_expect(!tsha_stats_self.registered, 0))
+		tsha_stats_register();
+	return &tsha_stats_self.engine[engine];
+}
+
+/* Only this thread writes the counter.  The relaxed store keeps a
+   concurrent snapshot from reading a torn value. */
+#  define TSHA_STATS_ADD(ENGINE,FIELD,N)					\
+do {										\
+	struct tsha_stats *tsha_stats_ = tsha_stats_get(ENGINE);		\
+	__atomic_store_n(&tsha_stats_->FIELD, tsha_stats_->FIELD + (N),		\
+		__ATOMIC_RELAXED);						\
+} while (0)
+/* Registers the thread ahead of the first count.  For engines that keep W
+   in registers between calls, where the library calls of the registration
+   must not run. */
+#  define TSHA_STATS_TOUCH(ENGINE) ((void)tsha_stats_get(ENGINE))
+#  define TSHA_STATS_TSC_BEGIN() u64 tsha_stats_t0 = tsha_stats_ticks()
+#  define TSHA_STATS_TSC_END(ENGINE)						\
+	TSHA_STATS_ADD(ENGINE, cycles, tsha_stats_ticks() - tsha_stats_t0)
+#else
+static inline s32 tsha_stats_snapshot(
+	struct tsha_stats out[TSHA_STATS_NENGINES])
+{
+	memset(out, 0, TSHA_STATS_NENGINES * sizeof(struct tsha_stats));
+	return -ENOTSUP;
+}
+
+/* Still a statement so an unbraced if or else around it stays warning
+   clean. */
+#  define TSHA_STATS_ADD(ENGINE,FIELD,N) do { } while (0)
+#  define TSHA_STATS_TOUCH(ENGINE) do { } while (0)
+#  define TSHA_STATS_TSC_BEGIN()
+#  define TSHA_STATS_TSC_END(ENGINE) do { } while (0)
+#endif // USE_STATS
+
+#endif // __ASSEMBLER__
+
+#endif // TSHA_STATS
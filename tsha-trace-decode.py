@@ -0,0 +1,158 @@
+#!/usr/bin/python3
+#
+# Binary Round Trace Decoder for the rings written by tsha-trace.h
+#
+# Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+
+# Prints a trace written by a USE_TRACE=1 build in the same layout as the
+# DEBUG round output of tsha256r.  Only a..h and W32[j] (or T1) are kept per
+# round, the rest is recomputed here.
+#
+# Usage: ./tsha-trace-decode.py [tsha-trace.bin]
+
+import struct
+import sys
+
+TSHA_TRACE_ROUND_W = 1
+TSHA_TRACE_ROUND_T1 = 2
+
+ENGINES = [ "sha256r", "sha256hp", "sha256a", "sha256ha" ]
+
+K = [
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+]
+
+M32 = 0xffffffff
+
+def rotr(x, n):
+	return ((x >> n) | (x << (32 - n))) & M32
+
+def round_values(v, w, j):
+	a, b, c, d, e, f, g, h = v
+	Ch = (e & f) ^ ((~e) & g)
+	Maj = (a & b) ^ (a & c) ^ (b & c)
+	SIG0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)
+	SIG1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)
+	T1 = (h + SIG1 + Ch + K[j] + w) & M32
+	T2 = (SIG0 + Maj) & M32
+	return Ch, Maj, SIG0, SIG1, T1, T2
+
+def next_state(v, T1, T2):
+	a, b, c, d, e, f, g, h = v
+	return [ (T1 + T2) & M32, a, b, c, (d + T1) & M32, e, f, g ]
+
+def hex8(v):
+	return " ".join("%08x" % x for x in v)
+
+def read_trace(path):
+	with open(path, "rb") as fp:
+		data = fp.read()
+	if data[0:8] != b"TSHATRC1":
+		sys.exit(path + ": not a tsha trace")
+	rec_size, nrecs, total = struct.unpack_from("<IIQ", data, 8)
+	recs = []
+	off = 24
+	for i in range(nrecs):
+		kind, engine, j, pad, *rest = struct.unpack_from("<BBBB9I", data, off)
+		recs.append((kind, engine, j, rest[0:8], rest[8]))
+		off += rec_size
+	return total, recs
+
+# Splits the rounds into blocks, a block starts at round 0.
+def split_blocks(recs):
+	blocks = []
+	for r in recs:
+		if r[2] == 0 or not blocks or r[2] != blocks[-1][-1][2] + 1:
+			blocks.append([])
+		blocks[-1].append(r)
+	return blocks
+
+def print_block(block):
+	kind, engine, j0, v0, _ = block[0]
+	W = {}
+	rounds = []
+	for kind, engine, j, v, x in block:
+		if kind == TSHA_TRACE_ROUND_W:
+			w = x
+		else:
+			# T1 = h + SIG1 + Ch + K[j] + W32[j]
+			Ch, Maj, SIG0, SIG1, T1, T2 = round_values(v, 0, j)
+			w = (x - T1) & M32
+		W[j] = w
+		rounds.append((j, v, w))
+
+	name = ENGINES[engine] if engine < len(ENGINES) else str(engine)
+	print("Block from " + name + ", rounds " + str(j0) + ".." + str(block[-1][2]))
+	if j0 == 0 and len(block) == 64:
+		print("Message contents of W32:")
+		for j in range(16):
+			if j % 8 == 0:
+				print()
+			print("%08x " % W[j], end="")
+		print()
+		print("Expanding message blocks")
+		for j in range(16, 64):
+			if j % 4 == 0:
+				print()
+			print("%08x " % W[j], end="")
+		print()
+
+	for j, v, w in rounds:
+		Ch, Maj, SIG0, SIG1, T1, T2 = round_values(v, w, j)
+		print("j-1=%d Ch=%08x Maj=%08x SIG0=%08x SIG1=%08x T1=%08x"
+			" T2=%08x h=%08x K=%08x W32=%08x"
+			% (j-1, Ch, Maj, SIG0, SIG1, T1, T2, v[7], K[j], w))
+		print("Hex values %d:" % (j-1))
+		print(hex8(v))
+
+	if block[-1][2] != 63:
+		print("(block cut off)")
+		return
+	j, v, w = rounds[-1]
+	Ch, Maj, SIG0, SIG1, T1, T2 = round_values(v, w, j)
+	v = next_state(v, T1, T2)
+	print("Updating intermediate hash values")
+	print("hex values %d:" % j)
+	print(hex8(v))
+	if j0 != 0:
+		return
+	# H on entry to the block is a..h of round 0
+	print()
+	print("Digest as in hex little endian:")
+	print("".join("%08x" % ((x + y) & M32) for x, y in zip(v0, v)))
+
+def main():
+	path = sys.argv[1] if len(sys.argv) > 1 else "tsha-trace.bin"
+	total, recs = read_trace(path)
+	if total > len(recs):
+		print("Dropped " + str(total - len(recs)) + " older rounds")
+	for block in split_blocks(recs):
+		print_block(block)
+
+main()
@@ -0,0 +1,173 @@
+/*
+ * tsha256 - A register based Secure Hashing Algorithm 2 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+/* Binary round trace for debugging large messages */
+
+#ifndef TSHA_TRACE
+#define TSHA_TRACE
+
+/*
+   With -DUSE_TRACE the engines append one fixed size record per round to a
+   ring in memory instead of printing the round with printf.  A record holds
+
+	kind	- TSHA_TRACE_ROUND_W or TSHA_TRACE_ROUND_T1
+	engine	- TSHA_TRACE_SHA256R, ...
+	j	- the round
+	v	- a..h on entry to the round
+	w	- W32[j], or T1 where W32[j] is not at hand (tsha256a.S)
+
+   Everything else the DEBUG output shows, the message block, the expanded
+   words, Ch, Maj, SIG0, SIG1, T1, T2 and the digest, follows from these and
+   is recomputed by tsha-trace-decode.py.  The ring keeps the last
+   TSHA_TRACE_NRECS rounds and is written out at exit to the file named by
+   the TSHA_TRACE environment variable, or tsha-trace.bin:
+
+	USE_TRACE=1 ./build sha256r && ./tsha256r > /dev/null
+	./tsha-trace-decode.py tsha-trace.bin
+
+   The ring is not locked.  Trace one thread at a time.
+*/
+
+#define TSHA_TRACE_ROUND_W	1
+#define TSHA_TRACE_ROUND_T1	2
+
+#define TSHA_TRACE_SHA256R	0
+#define TSHA_TRACE_SHA256HP	1
+#define TSHA_TRACE_SHA256A	2
+#define TSHA_TRACE_SHA256HA	3
+
+#ifndef TSHA_TRACE_NRECS
+#  define TSHA_TRACE_NRECS	65536 // a power of 2, 1024 blocks
+#endif
+#define TSHA_TRACE_REC_SIZE	40
+
+#ifdef __ASSEMBLER__
+
+/* Appends a TSHA_TRACE_ROUND_T1 record for round j.  a..h are packed two to
+   a register in mm0-mm3 and T1 is in ecx.  Clobbers r8, r10 and the flags. */
+.macro trace_round j
+#ifdef USE_TRACE
+	movq		tsha_trace_head(rip),r10
+	incq		tsha_trace_head(rip)
+	andq		$(TSHA_TRACE_NRECS - 1),r10
+	leaq		(r10,r10,4),r10
+	leaq		tsha_trace_ring(rip),r8
+	leaq		(r8,r10,8),r10 /* ring + head * 40 */
+	movl		$(TSHA_TRACE_ROUND_T1 | (TSHA_TRACE_SHA256A << 8) | (\j << 16)),(r10)
+	movq		mm0,4(r10)
+	movq		mm1,12(r10)
+	movq		mm2,20(r10)
+	movq		mm3,28(r10)
+	movl		ecx,36(r10)
+#endif
+.endm
+
+#else
+
+struct tsha_trace_rec {
+	u8 kind;
+	u8 engine;
+	u8 j;
+	u8 pad;
+	u32 v[8];
+	u32 w;
+};
+
+#ifdef USE_TRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Shared by every object through the weak definitions, as in tsha-stats.h */
+struct tsha_trace_rec tsha_trace_ring[TSHA_TRACE_NRECS] __attribute__((weak));
+u64 tsha_trace_head __attribute__((weak));
+
+static inline void tsha_trace_round(u32 engine, u32 j, u32 v0, u32 v1,
+	u32 v2, u32 v3, u32 v4, u32 v5, u32 v6, u32 v7, u32 w)
+{
+	struct tsha_trace_rec *r =
+		&tsha_trace_ring[tsha_trace_head++ & (TSHA_TRACE_NRECS - 1)];
+
+	r->kind = TSHA_TRACE_ROUND_W;
+	r->engine = engine;
+	r->j = j;
+	r->v[0] = v0; r->v[1] = v1; r->v[2] = v2; r->v[3] = v3;
+	r->v[4] = v4; r->v[5] = v5; r->v[6] = v6; r->v[7] = v7;
+	r->w = w;
+}
+
+/* Writes the ring, oldest record first, behind a header of
+	char magic[8]	- "TSHATRC1"
+	u32 rec_size	- TSHA_TRACE_REC_SIZE
+	u32 nrecs	- records that follow
+	u64 total	- records ever written, older ones were overwritten
+   returns:
+	<0 - error
+	0 - success							      */
+__attribute__((weak)) s32 tsha_trace_dump(const char *path)
+{
+	u64 total = tsha_trace_head;
+	u64 first = total > TSHA_TRACE_NRECS ? total - TSHA_TRACE_NRECS : 0;
+	u32 hdr[2] = { TSHA_TRACE_REC_SIZE, (u32)(total - first) };
+	FILE *fp;
+	u64 i;
+
+	fp = fopen(path, "wb");
+	if (fp == NULL)
+		return -1;
+	fwrite("TSHATRC1", 1, 8, fp);
+	fwrite(hdr, sizeof(hdr), 1, fp);
+	fwrite(&total, sizeof(total), 1, fp);
+	for (i = first; i < total; i++)
+		fwrite(&tsha_trace_ring[i & (TSHA_TRACE_NRECS - 1)],
+			TSHA_TRACE_REC_SIZE, 1, fp);
+	return fclose(fp) == 0 ? 0 : -1;
+}
+
+__attribute__((weak)) void tsha_trace_exit(void)
+{
+	const char *path = getenv("TSHA_TRACE");
+
+	if (path == NULL)
+		path = "tsha-trace.bin";
+	if (tsha_trace_dump(path) < 0)
+		fprintf(stderr, "Cannot write the trace to %s\n", path);
+}
+
+__attribute__((weak, constructor)) void tsha_trace_init(void)
+{
+	atexit(tsha_trace_exit);
+}
+
+#  define TSHA_TRACE_ROUND(ENGINE,J,V0,V1,V2,V3,V4,V5,V6,V7,W)			\
+	tsha_trace_round(ENGINE, J, V0, V1, V2, V3, V4, V5, V6, V7, W)
+#else
+#  define TSHA_TRACE_ROUND(ENGINE,J,V0,V1,V2,V3,V4,V5,V6,V7,W)
+#endif // USE_TRACE
+
+#endif // __ASSEMBLER__
+
+#endif // TSHA_TRACE
@@ -29,11 +29,27 @@
 #ifdef ALG_ASM
 #  define CPP_ASMLINKAGE
 #  define asmlinkage CPP_ASMLINKAGE __attribute__((regparm(0)))
+/* -DTSHA256A_SUFFIX renames the C wrappers in main-tsha256a.c along with
+   the assembly, so tsha-bench can link one copy per kernel. */
+#  ifdef TSHA256A_SUFFIX
+#    define TSHA256A_SYM2(NAME,SUFFIX) NAME##_##SUFFIX
+#    define TSHA256A_SYM(NAME,SUFFIX) TSHA256A_SYM2(NAME,SUFFIX)
+#    define tsha256a_update TSHA256A_SYM(tsha256a_update,TSHA256A_SUFFIX)
+#    define tsha256a_getch TSHA256A_SYM(tsha256a_getch,TSHA256A_SUFFIX)
+#    define tsha256a_reset TSHA256A_SYM(tsha256a_reset,TSHA256A_SUFFIX)
+#    define tsha256a_close TSHA256A_SYM(tsha256a_close,TSHA256A_SUFFIX)
+#    define tsha256a_get_hashcode TSHA256A_SYM(tsha256a_get_hashcode,TSHA256A_SUFFIX)
+#    define tsha256a_write_blocks TSHA256A_SYM(tsha256a_write_blocks,TSHA256A_SUFFIX)
+#    define tsha256a_write TSHA256A_SYM(tsha256a_write,TSHA256A_SUFFIX)
+#    define tsha256a_digest TSHA256A_SYM(tsha256a_digest,TSHA256A_SUFFIX)
+#  endif // TSHA256A_SUFFIX
 asmlinkage s32 tsha256a_update(struct tsha256 *state, u32 finish);
 asmlinkage s32 tsha256a_reset(struct tsha256 *state);
 asmlinkage s32 tsha256a_close(struct tsha256 *state);
 asmlinkage s32 tsha256a_getch(struct tsha256 *state, u8 c);
 asmlinkage u32* tsha256a_get_hashcode(struct tsha256 *state);
+asmlinkage s64 tsha256a_write_blocks(struct tsha256 *state, const u8 *buf,
+	u64 nblocks);
 #endif // ALG_ASM
 
 #endif // TSHA256_ASM
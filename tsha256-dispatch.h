@@ -0,0 +1,132 @@
+/*
+ * tsha256 - A register based Secure Hashing Algorithm 2 implementation
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Run time CPU dispatch for the assembly module */
+
+#ifndef TSHA256_DISPATCH
+#define TSHA256_DISPATCH
+
+/*
+   tsha256a.S, tsha256a-avx2.S and tsha256a-shani.S are assembled once per
+   ISA with -DTSHA256A_SUFFIX and all the builds are linked into one binary.
+   The tsha256_* entry points are GNU ifuncs.  The dynamic loader runs each
+   resolver once before main and binds the symbol to the fastest build the
+   CPU supports, so a call costs the same as a call through the PLT.
+
+   Kernels:
+	sse2	- the lowest common denominator for x86-64
+	sse4_1	- pinsrd/pextrd based W access
+	bmi	- sse4_1 with andn for Ch
+	bmi2	- bmi with rorx for the Sigma and sigma functions
+	avx2	- tsha256a-avx2.S, W in ymm0-ymm1 and a..h in GPRs, no MMX
+	shani	- tsha256a-shani.S, the rounds and the schedule in the SHA
+		  extensions, W and a..h in xmm registers
+*/
+
+#define TSHA256_KERNEL_SSE2	0
+#define TSHA256_KERNEL_SSE4_1	1
+#define TSHA256_KERNEL_BMI	2
+#define TSHA256_KERNEL_BMI2	3
+#define TSHA256_KERNEL_AVX2	4
+#define TSHA256_KERNEL_SHANI	5
+
+/* Resolvers run before constructors so the CPU model must be initialized
+   by hand. */
+static int tsha256_probe_cpu(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+		return TSHA256_KERNEL_SHANI;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+		return TSHA256_KERNEL_AVX2;
+	if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("bmi")
+		&& __builtin_cpu_supports("bmi2"))
+		return TSHA256_KERNEL_BMI2;
+	if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("bmi"))
+		return TSHA256_KERNEL_BMI;
+	if (__builtin_cpu_supports("sse4.1"))
+		return TSHA256_KERNEL_SSE4_1;
+	return TSHA256_KERNEL_SSE2;
+}
+
+#define TSHA256_IFUNC(RET,NAME,ARGS)						\
+	asmlinkage RET tsha256a_##NAME##_sse2 ARGS;				\
+	asmlinkage RET tsha256a_##NAME##_sse4_1 ARGS;				\
+	asmlinkage RET tsha256a_##NAME##_bmi ARGS;				\
+	asmlinkage RET tsha256a_##NAME##_bmi2 ARGS;				\
+	asmlinkage RET tsha256a_##NAME##_avx2 ARGS;				\
+	asmlinkage RET tsha256a_##NAME##_shani ARGS;				\
+	static RET (*tsha256_resolve_##NAME(void)) ARGS				\
+	{									\
+		switch (tsha256_probe_cpu())					\
+		{								\
+			case TSHA256_KERNEL_SHANI:				\
+				return tsha256a_##NAME##_shani;			\
+			case TSHA256_KERNEL_AVX2:				\
+				return tsha256a_##NAME##_avx2;			\
+			case TSHA256_KERNEL_BMI2:				\
+				return tsha256a_##NAME##_bmi2;			\
+			case TSHA256_KERNEL_BMI:				\
+				return tsha256a_##NAME##_bmi;			\
+			case TSHA256_KERNEL_SSE4_1:				\
+				return tsha256a_##NAME##_sse4_1;		\
+			default:						\
+				return tsha256a_##NAME##_sse2;			\
+		}								\
+	}									\
+	RET tsha256_##NAME ARGS							\
+		__attribute__((ifunc("tsha256_resolve_" #NAME)));
+
+TSHA256_IFUNC(s32, update, (struct tsha256 *state, u32 finish))
+TSHA256_IFUNC(s32, reset, (struct tsha256 *state))
+TSHA256_IFUNC(s32, close, (struct tsha256 *state))
+TSHA256_IFUNC(s32, getch, (struct tsha256 *state, u8 c))
+TSHA256_IFUNC(u32*, get_hashcode, (struct tsha256 *state))
+TSHA256_IFUNC(s64, write_blocks, (struct tsha256 *state, const u8 *buf,
+	u64 nblocks))
+
+/* Name of the kernel the ifuncs were bound to. */
+static inline const char *tsha256_kernel_name(void)
+{
+	switch (tsha256_probe_cpu())
+	{
+		case TSHA256_KERNEL_SHANI: return "shani";
+		case TSHA256_KERNEL_AVX2: return "avx2";
+		case TSHA256_KERNEL_BMI2: return "bmi2";
+		case TSHA256_KERNEL_BMI: return "bmi";
+		case TSHA256_KERNEL_SSE4_1: return "sse4_1";
+		default: return "sse2";
+	}
+}
+
+/* Route callers written against the assembly module to the ifuncs. */
+#define tsha256a_update tsha256_update
+#define tsha256a_reset tsha256_reset
+#define tsha256a_close tsha256_close
+#define tsha256a_getch tsha256_getch
+#define tsha256a_get_hashcode tsha256_get_hashcode
+#define tsha256a_write_blocks tsha256_write_blocks
+
+#endif // TSHA256_DISPATCH
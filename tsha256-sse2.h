@@ -27,7 +27,7 @@
 
 /* ci must be 0 4 8 12 */
 #      define GET_W(W,CI,XMM,TXMM)						\
-	asm (	"movdqa          %2,%1\n\t"					\
+	asm volatile (	"movdqa          %2,%1\n\t"				\
 		"psrldq          %3,%1\n\t"					\
 		"movd            %1,%k0"					\
 		: "=r" (W),							\
@@ -36,33 +36,33 @@
 		  "i" (CI));
 
 #      define GET_W_ALT_C0(W,MM)						\
-	asm ( 	"movd		%1,%k0"						\
+	asm volatile ( 	"movd		%1,%k0"					\
 		: "=r" (W)							\
 		: "y" (MM));
 
 #      define INSERT_BYTE(CI,C,XMM,TXMM)					\
-	asm (	"movd		%k2,%1\n\t"					\
+	asm volatile (	"movd		%k2,%1\n\t"				\
 		"pslldq		%3,%1\n\t"					\
 		"pxor		%1,%0"						\
-		: "=x" (XMM),							\
+		: "+x" (XMM),							\
 		  "+x" (TXMM)							\
 		: "r" (C),							\
 		  "i" (CI));
 
 #      define INSERT_BYTE_ALT(CI,C,MM,GPR0,GPR1)				\
-	asm (	"movl		%k3,%k1\n\t"					\
+	asm volatile (	"movl		%k3,%k1\n\t"				\
 		"shlq		%4,%q1\n\t"					\
 		"movq		%0,%q2\n\t"					\
 		"xorq		%q1,%q2\n\t"					\
 		"movq		%q2,%0"						\
-		: "+x" (MM),							\
+		: "+y" (MM),							\
 		  "+r" (GPR0),							\
 		  "+r" (GPR1)							\
 		: "r" (C),							\
-		  "i" (CI));
+		  "i" (CI * 8));
 
 #      define GET_W_ALT_C1(W,MM,GPR)						\
-	asm (	"movq		%2,%q1\n\t"					\
+	asm volatile (	"movq		%2,%q1\n\t"				\
 	      	"shrq		$32,%q1\n\t"					\
 	      	"movl		%k1,%k0"					\
 		: "=r" (W),							\
@@ -72,7 +72,7 @@
 
 /* CI must be 0,4,8,12 */
 #      define SET_W(W,CI,XMM,TXMM,GPR)						\
-	asm (	"movl            $0xffffffff,%k2\n\t"				\
+	asm volatile (	"movl            $0xffffffff,%k2\n\t"			\
 		"movd            %k2,%1\n\t"					\
 		"pslldq          %4,%1\n\t"					\
 		"pandn           %0,%1\n\t"					\
@@ -88,7 +88,7 @@
 
 /* CI is only 0 or 32 */
 #      define SET_W_ALT(W,CI,MM,GPR0,GPR1)					\
-	asm (	"movl            $0xffffffff,%k0\n\t"				\
+	asm volatile (	"movl            $0xffffffff,%k0\n\t"			\
 		"movq            %2,%q1\n\t"					\
 		"shlq            %4,%q0\n\t"					\
 		PANDN0								\
@@ -105,6 +105,7 @@
 u32 /*:rax*/
 get_w(u32 wi	/*:rdi - wi position*/)
 {
+	DECLARE_REGISTERS();
 //	debug_printf("\nwi=%d\n",wi);
 
 	register u32 w asm ("rax");
@@ -114,6 +115,7 @@ get_w(u32 wi	/*:rdi - wi position*/)
 		/* Unrolled to get rid of div which is ~38 clocks */
 		/* This gets converted into a jump table by GCC with -O0 still */
 		/* Generated by a BASH script.  Set gen_conditional.sh for details. */
+		/* With W_ROLLING only xmm0-xmm3 hold W and callers pass WI(j). */
 		case 0: GET_W(w,0,xmm0,xmm15); break;
 		case 1: GET_W(w,4,xmm0,xmm15); break;
 		case 2: GET_W(w,8,xmm0,xmm15); break;
@@ -130,6 +132,7 @@ get_w(u32 wi	/*:rdi - wi position*/)
 		case 13: GET_W(w,4,xmm3,xmm15); break;
 		case 14: GET_W(w,8,xmm3,xmm15); break;
 		case 15: GET_W(w,12,xmm3,xmm15); break;
+#ifndef W_ROLLING
 		case 16: GET_W(w,0,xmm4,xmm15); break;
 		case 17: GET_W(w,4,xmm4,xmm15); break;
 		case 18: GET_W(w,8,xmm4,xmm15); break;
@@ -178,12 +181,14 @@ get_w(u32 wi	/*:rdi - wi position*/)
 		case 61: GET_W_ALT_C1(w,mm4,gpr); break;
 		case 62: GET_W_ALT_C0(w,mm5); break;
 		case 63: GET_W_ALT_C1(w,mm5,gpr); break;
+#endif // !W_ROLLING
 	}
 	return w;
 }
 
 void _insert_W_byte(u32 bi, u32 c)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("r10");
 	register u32 gpr1 asm ("r11");
 	switch(bi)
@@ -454,6 +459,7 @@ void /*:rax*/
 set_w(u32 w		/*:rdi*/,
       u32 wi		/*:rsi - wi position*/)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("r8");
 	register u32 gpr1 asm ("r13");
 	switch (wi)
@@ -477,6 +483,7 @@ set_w(u32 w		/*:rdi*/,
 		case 13: SET_W(w,4,xmm3,xmm15,gpr0); break;
 		case 14: SET_W(w,8,xmm3,xmm15,gpr0); break;
 		case 15: SET_W(w,12,xmm3,xmm15,gpr0); break;
+#ifndef W_ROLLING
 		case 16: SET_W(w,0,xmm4,xmm15,gpr0); break;
 		case 17: SET_W(w,4,xmm4,xmm15,gpr0); break;
 		case 18: SET_W(w,8,xmm4,xmm15,gpr0); break;
@@ -525,6 +532,7 @@ set_w(u32 w		/*:rdi*/,
 		case 61: SET_W_ALT(w,32,mm4,gpr0,gpr1); break;
 		case 62: SET_W_ALT(w,0,mm5,gpr0,gpr1); break;
 		case 63: SET_W_ALT(w,32,mm5,gpr0,gpr1); break;
+#endif // !W_ROLLING
 	}
 }
 
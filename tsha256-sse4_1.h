@@ -27,22 +27,22 @@
 #define TSHA256_SSE4_1
 
 #      define GET_W(W,CI,XMM)							\
-	asm (									\
+	asm volatile (								\
 		"pextrd          %2,%1,%k0"					\
 		: "=r" (W)							\
 		: "x" (XMM),							\
 		  "i" (CI));
 
 #      define INSERT_BYTE(CI,C,XMM)						\
-	asm (	"pinsrb		%2,%k1,%0"					\
-		: "=x" (XMM)							\
-		: "r" (C)							\
-		: "i" (CI)
+	asm volatile (	"pinsrb		%2,%k1,%0"				\
+		: "+x" (XMM)							\
+		: "r" (C),							\
+		  "i" (CI));
 
 #      define SET_W(W,CI,XMM)							\
-	asm (									\
+	asm volatile (								\
 		"pinsrd          %2,%k1,%0"					\
-		: "=x" (XMM)							\
+		: "+x" (XMM)							\
 		: "r" (W),							\
 		  "i" (CI));
 
@@ -50,12 +50,14 @@
 u32 /*:rax*/
 get_w(u32 wi	/*:rdi - wi position*/)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("rax");
 	switch (wi)
 	{
 		/* Unrolled to get rid of div which is ~38 clocks */
 		/* This gets converted into a jump table by GCC with -O0 still */
 		/* Generated by a BASH script.  Set gen_conditional.sh for details. */
+		/* With W_ROLLING only xmm0-xmm3 hold W and callers pass WI(j). */
 		case 0: GET_W(w,0,xmm0); break;
 		case 1: GET_W(w,1,xmm0); break;
 		case 2: GET_W(w,2,xmm0); break;
@@ -72,6 +74,7 @@ get_w(u32 wi	/*:rdi - wi position*/)
 		case 13: GET_W(w,1,xmm3); break;
 		case 14: GET_W(w,2,xmm3); break;
 		case 15: GET_W(w,3,xmm3); break;
+#ifndef W_ROLLING
 		case 16: GET_W(w,0,xmm4); break;
 		case 17: GET_W(w,1,xmm4); break;
 		case 18: GET_W(w,2,xmm4); break;
@@ -120,12 +123,14 @@ get_w(u32 wi	/*:rdi - wi position*/)
 		case 61: GET_W(w,1,xmm15); break;
 		case 62: GET_W(w,2,xmm15); break;
 		case 63: GET_W(w,3,xmm15); break;
+#endif // !W_ROLLING
 	}
 	return w;
 }
 
 void _insert_W_byte(u32 bi, u32 c)
 {
+	DECLARE_REGISTERS();
 	switch(bi)
 	{
 		/* Unrolled to get rid of div which is ~38 clocks */
@@ -394,6 +399,7 @@ void /*:rax*/
 set_w(u32 w		/*:rdi*/,
       u32 wi		/*:rsi - wi position*/)
 {
+	DECLARE_REGISTERS();
 	switch (wi)
 	{
 		/* Unrolled to get rid of div which is ~38 clocks */
@@ -415,6 +421,7 @@ set_w(u32 w		/*:rdi*/,
 		case 13: SET_W(w,1,xmm3); break;
 		case 14: SET_W(w,2,xmm3); break;
 		case 15: SET_W(w,3,xmm3); break;
+#ifndef W_ROLLING
 		case 16: SET_W(w,0,xmm4); break;
 		case 17: SET_W(w,1,xmm4); break;
 		case 18: SET_W(w,2,xmm4); break;
@@ -463,6 +470,7 @@ set_w(u32 w		/*:rdi*/,
 		case 61: SET_W(w,1,xmm15); break;
 		case 62: SET_W(w,2,xmm15); break;
 		case 63: SET_W(w,3,xmm15); break;
+#endif // !W_ROLLING
 	}
 }
 
@@ -28,59 +28,69 @@
 
 #ifdef ALG_PLAIN
 #  ifdef USE_ASM
-register u128 xmm0 asm ("xmm0");
-register u128 xmm1 asm ("xmm1");
-register u128 xmm2 asm ("xmm2");
-register u128 xmm3 asm ("xmm3");
-register u128 xmm4 asm ("xmm4");
-register u128 xmm5 asm ("xmm5");
-register u128 xmm6 asm ("xmm6");
-register u128 xmm7 asm ("xmm7");
-register u128 xmm8 asm ("xmm8");
-register u128 xmm9 asm ("xmm9");
-register u128 xmm10 asm ("xmm10");
-register u128 xmm11 asm ("xmm11");
-register u128 xmm12 asm ("xmm12");
-register u128 xmm13 asm ("xmm13");
-register u128 xmm14 asm ("xmm14");
-register u128 xmm15 asm ("xmm15");
-
-register u64 mm0 asm ("mm0");
-register u64 mm1 asm ("mm1");
-register u64 mm2 asm ("mm2");
-register u64 mm3 asm ("mm3");
-register u64 mm4 asm ("mm4");
-register u64 mm5 asm ("mm5");
-register u64 mm6 asm ("mm6");
-register u64 mm7 asm ("mm7");
-
-register u64 rax asm ("rax");
-register u64 rbx asm ("rbx");
-register u64 rcx asm ("rcx");
-register u64 rdx asm ("rdx");
-
-register u32 eax asm ("eax");
-register u32 ebx asm ("ebx");
-register u32 ecx asm ("ecx");
-register u32 edx asm ("edx");
-
-register u64 r8 asm ("r8");
-register u64 r9 asm ("r9");
-register u64 r10 asm ("r10");
-register u64 r11 asm ("r11");
-register u64 r12 asm ("r12");
-register u64 r13 asm ("r13");
-register u64 r14 asm ("r14");
-register u64 r15 asm ("r15");
-
-register u32 r8d asm ("r8");
-register u32 r9d asm ("r9");
-register u32 r10d asm ("r10");
-register u32 r11d asm ("r11");
-register u32 r12d asm ("r12");
-register u32 r13d asm ("r13");
-register u32 r14d asm ("r14");
-register u32 r15d asm ("r15");
+/* The W array is kept in xmm0-xmm15 (mm4 and mm5 too for SSE2) and a-h in
+   mm0-mm3 from one call to the next.  Those are call-clobbered, so instead
+   of global register variables, which the compiler cannot keep across a
+   libc call either, build reserves them for the whole file with
+   -ffixed-xmm0 ... -ffixed-mm7.  Each function that touches them names
+   them with DECLARE_REGISTERS().  The asm statements are volatile since
+   those locals look dead to the compiler once the function returns.  The
+   GPRs are ordinary locals that are pinned to a register for the asm
+   statements. */
+#    define DECLARE_REGISTERS()							\
+	register u128 xmm0 asm ("xmm0");					\
+	register u128 xmm1 asm ("xmm1");					\
+	register u128 xmm2 asm ("xmm2");					\
+	register u128 xmm3 asm ("xmm3");					\
+	register u128 xmm4 asm ("xmm4");					\
+	register u128 xmm5 asm ("xmm5");					\
+	register u128 xmm6 asm ("xmm6");					\
+	register u128 xmm7 asm ("xmm7");					\
+	register u128 xmm8 asm ("xmm8");					\
+	register u128 xmm9 asm ("xmm9");					\
+	register u128 xmm10 asm ("xmm10");					\
+	register u128 xmm11 asm ("xmm11");					\
+	register u128 xmm12 asm ("xmm12");					\
+	register u128 xmm13 asm ("xmm13");					\
+	register u128 xmm14 asm ("xmm14");					\
+	register u128 xmm15 asm ("xmm15");					\
+										\
+	register u64 mm0 asm ("mm0");						\
+	register u64 mm1 asm ("mm1");						\
+	register u64 mm2 asm ("mm2");						\
+	register u64 mm3 asm ("mm3");						\
+	register u64 mm4 asm ("mm4");						\
+	register u64 mm5 asm ("mm5");						\
+	register u64 mm6 asm ("mm6");						\
+	register u64 mm7 asm ("mm7");						\
+										\
+	register u64 rax asm ("rax");						\
+	register u64 rbx asm ("rbx");						\
+	register u64 rcx asm ("rcx");						\
+	register u64 rdx asm ("rdx");						\
+										\
+	register u32 eax asm ("eax");						\
+	register u32 ebx asm ("ebx");						\
+	register u32 ecx asm ("ecx");						\
+	register u32 edx asm ("edx");						\
+										\
+	register u64 r8 asm ("r8");						\
+	register u64 r9 asm ("r9");						\
+	register u64 r10 asm ("r10");						\
+	register u64 r11 asm ("r11");						\
+	register u64 r12 asm ("r12");						\
+	register u64 r13 asm ("r13");						\
+	register u64 r14 asm ("r14");						\
+	register u64 r15 asm ("r15");						\
+										\
+	register u32 r8d asm ("r8");						\
+	register u32 r9d asm ("r9");						\
+	register u32 r10d asm ("r10");						\
+	register u32 r11d asm ("r11");						\
+	register u32 r12d asm ("r12");						\
+	register u32 r13d asm ("r13");						\
+	register u32 r14d asm ("r14");						\
+	register u32 r15d asm ("r15")
 
 #      ifdef HAVE_BMI
 #	 define PANDN0								\
@@ -91,45 +101,10 @@ register u32 r15d asm ("r15");
 		"andq            %q0,%q1\n\t"
 #      endif
 
-#      ifdef DEBUG
-
-/* printf clobbers xmm, so push and pop xmm registers. */
-#        define POPAGPR64()							\
-	asm(	"popq		%%rax\n\t"					\
-		"popq		%%rbx\n\t"					\
-		"popq		%%rcx\n\t"					\
-		"popq		%%rdx\n\t"					\
-		"popq		%%rsi\n\t"					\
-		"popq		%%rdi"						\
-		:								\
-		:								\
-		: "rax",							\
-		  "rbx",							\
-		  "rcx",							\
-		  "rdx",							\
-		  "rsi",							\
-		  "rdi");
-
-#        define PUSHAGPR64()							\
-	asm(	"pushq		%%rax\n\t"					\
-		"pushq		%%rbx\n\t"					\
-		"pushq		%%rcx\n\t"					\
-		"pushq		%%rdx\n\t"					\
-		"pushq		%%rsi\n\t"					\
-		"pushq		%%rdi"						\
-		:								\
-		:								\
-		: "rax",							\
-		  "rbx",							\
-		  "rcx",							\
-		  "rdx",							\
-		  "rsi",							\
-		  "rdi");
-#      endif // DEBUG
 
 /* Clears a, b, c, d, e, f, g, h and tmp variables */
 #    define CLEAR_A()								\
-	asm (	"pxor		%%mm0,%%mm0\n\t"				\
+	asm volatile (	"pxor		%%mm0,%%mm0\n\t"			\
 	 	"pxor		%%mm1,%%mm1\n\t"				\
 	 	"pxor		%%mm2,%%mm2\n\t"				\
 	 	"pxor		%%mm3,%%mm3\n\t"				\
@@ -148,7 +123,7 @@ register u32 r15d asm ("r15");
 		  "mm7");
 
 #    define CLEAR_GPR()								\
-	asm (	"xorq		%%rax,%%rax\n\t"				\
+	asm volatile (	"xorq		%%rax,%%rax\n\t"			\
 		"xorq		%%rbx,%%rbx\n\t"				\
 		"xorq		%%rcx,%%rcx\n\t"				\
 		"xorq		%%rdx,%%rdx\n\t"				\
@@ -176,7 +151,7 @@ register u32 r15d asm ("r15");
 
 /* Clears w0 - w63 */
 #    define CLEAR_W()								\
-	asm ( 	"pxor		%%xmm0,%%xmm0\n\t"				\
+	asm volatile ( 	"pxor		%%xmm0,%%xmm0\n\t"			\
 		"pxor		%%xmm1,%%xmm1\n\t"				\
 		"pxor		%%xmm2,%%xmm2\n\t"				\
 		"pxor		%%xmm3,%%xmm3\n\t"				\
@@ -212,25 +187,26 @@ register u32 r15d asm ("r15");
 
 
 #    define DUMP_XMM(A,XMM)							\
-	asm (	"movdqu          %1,%0"						\
+	asm volatile (	"movdqu          %1,%0"					\
 		: "=m" (A)							\
 		: "x" (XMM));
 
 #    define DUMP_MM2(A,MM0,MM1)							\
-	asm (	"movq		%1,0%V0\n\t"					\
-		"movq		%2,8%V0"					\
-		: "=m" (A)							\
+	asm volatile (	"movq		%2,%0\n\t"				\
+		"movq		%3,%1"						\
+		: "=m" (((u64 *)(A))[0]),					\
+		  "=m" (((u64 *)(A))[1])					\
 		: "y" (MM0),							\
 		  "y" (MM1));
 
 #    define GET_ACEG(W,MM)							\
-	asm (	"movd		%1,%k0"						\
+	asm volatile (	"movd		%1,%k0"					\
 		: "=r" (W)							\
 		: "y" (MM));
 
 
 #    define GET_BDFH(W,MM,GPR)							\
-	asm (	"movq		%2,%q1\n\t"					\
+	asm volatile (	"movq		%2,%q1\n\t"				\
 		"shrq		$32,%q1\n\t"					\
 		"movl		%k1,%k0"					\
 		: "=r" (W),							\
@@ -238,7 +214,7 @@ register u32 r15d asm ("r15");
 		: "y" (MM));
 
 #    define INIT_ABCDEFGH(H0,H2,H4,H6)						\
-	asm(	"movq		%0,%%mm0\n\t"					\
+	asm volatile (	"movq		%0,%%mm0\n\t"				\
 		"movq		%1,%%mm1\n\t"					\
 		"movq		%2,%%mm2\n\t"					\
 		"movq		%3,%%mm3"					\
@@ -253,24 +229,55 @@ register u32 r15d asm ("r15");
 		  "mm3");
 
 #    define INIT_H(XMM,HASH,A0,A1)						\
-	asm (	"movdqa          %2,%0\n\t"					\
-		"movdqa          %0,0%V1\n\t"					\
-		"movdqa          %3,%0\n\t"					\
-		"movdqa          %0,16%V1\n\t"					\
+	asm volatile (	"movdqa          %3,%0\n\t"				\
+		"movdqa          %0,%1\n\t"					\
+		"movdqa          %4,%0\n\t"					\
+		"movdqa          %0,%2\n\t"					\
 		"pxor            %0,%0"						\
 		: "+x" (XMM),							\
-		  "=m" (HASH)							\
+		  "=m" (((u128 *)(HASH))[0]),					\
+		  "=m" (((u128 *)(HASH))[1])					\
 		: "m" (A0),							\
 		  "m" (A1));
 
 #    define ROTRL(V,AMT)							\
-	asm(	"rorl		%k1,%k0"					\
-		: "=r" (V)							\
+	asm volatile (	"rorl		%k1,%k0"				\
+		: "+r" (V)							\
 		: "i"  (AMT));
 
+#    ifdef HAVE_BMI2
+/* D = ROTR(S,A0) ^ ROTR(S,A1) ^ ROTR(S,A2).  S is left intact. */
+#      define BIG_SIGMA_RORX(D,S,T,A0,A1,A2)					\
+	asm volatile (	"rorxl		%3,%k2,%k0\n\t"				\
+		"rorxl		%4,%k2,%k1\n\t"					\
+		"xorl		%k1,%k0\n\t"					\
+		"rorxl		%5,%k2,%k1\n\t"					\
+		"xorl		%k1,%k0"					\
+		: "=&r" (D),							\
+		  "=&r" (T)							\
+		: "r" (S),							\
+		  "i" (A0),							\
+		  "i" (A1),							\
+		  "i" (A2));
+
+/* D = ROTR(S,A0) ^ ROTR(S,A1) ^ (S >> A2).  S is destroyed. */
+#      define SMALL_SIGMA_RORX(D,S,T,A0,A1,A2)					\
+	asm volatile (	"rorxl		%3,%k2,%k0\n\t"				\
+		"rorxl		%4,%k2,%k1\n\t"					\
+		"xorl		%k1,%k0\n\t"					\
+		"shrl		%5,%k2\n\t"					\
+		"xorl		%k2,%k0"					\
+		: "=&r" (D),							\
+		  "=&r" (T),							\
+		  "+r" (S)							\
+		: "i" (A0),							\
+		  "i" (A1),							\
+		  "i" (A2));
+#    endif // HAVE_BMI2
+
 
 #    define SET_ACEG(W,MM,GPR0,GPR1,MASK)					\
-	asm (	"movq		%0,%q1\n\t"					\
+	asm volatile (	"movq		%0,%q1\n\t"				\
 		"andq		%4,%q1\n\t"					\
 		"movl		%k3,%k2\n\t"					\
 		"shlq		$0,%q2\n\t"					\
@@ -285,7 +292,7 @@ register u32 r15d asm ("r15");
 
 
 #    define SET_BDFH(W,MM,GPR0,GPR1,MASK)					\
-	asm (	"movq		%0,%q1\n\t"	 				\
+	asm volatile (	"movq		%0,%q1\n\t"				\
 		"andq		%4,%q1\n\t" 					\
 		"movl		%k3,%k2\n\t" 					\
 		"shlq		$32,%q2\n\t"					\
@@ -298,7 +305,7 @@ register u32 r15d asm ("r15");
 		  "m" (MASK));
 
 #    define SET_XMM(XMM,I32_3,I32_2,I32_1,I32_0,TXMM,GPR)			\
-	asm (	"movl		 %k2,%k6\n\t"					\
+	asm volatile (	"movl		 %k2,%k6\n\t"				\
 		"movd		 %q6,%1\n\t"					\
 		"pslldq		 $4,%0\n\t"					\
 		"pxor		 %1,%0\n\t"					\
@@ -314,7 +321,7 @@ register u32 r15d asm ("r15");
 		"movd		 %q6,%1\n\t"					\
 		"pslldq		 $4,%0\n\t"					\
 		"pxor		 %1,%0"						\
-		: "=x" (XMM),							\
+		: "+x" (XMM),							\
 		  "+x" (TXMM)							\
 		: "ir" (I32_3),							\
 		  "ir" (I32_2),							\
@@ -322,11 +329,129 @@ register u32 r15d asm ("r15");
 		  "ir" (I32_0),							\
 		  "r" (GPR));
 
+/* sigma1 of the 32-bit lanes in T0 added into XMM.  T0 is destroyed. */
+#    define SIGMA1_ADD_X4(XMM,T0,T1,T2,T3)					\
+	"movdqa		 " T0 "," T1 "\n\t"					\
+	"psrld		 $17," T1 "\n\t"					\
+	"movdqa		 " T0 "," T2 "\n\t"					\
+	"pslld		 $15," T2 "\n\t"					\
+	"por		 " T2 "," T1 "\n\t"					\
+	"movdqa		 " T0 "," T2 "\n\t"					\
+	"psrld		 $19," T2 "\n\t"					\
+	"movdqa		 " T0 "," T3 "\n\t"					\
+	"pslld		 $13," T3 "\n\t"					\
+	"por		 " T3 "," T2 "\n\t"					\
+	"pxor		 " T2 "," T1 "\n\t"					\
+	"psrld		 $10," T0 "\n\t"					\
+	"pxor		 " T0 "," T1 "\n\t"					\
+	"paddd		 " T1 "," XMM "\n\t"
+
+/* Computes W[j..j+3] over W[j-16..j-13] in X0 from X1 = W[j-12..j-9],
+   X2 = W[j-8..j-5] and X3 = W[j-4..j-1].  Only SSE2 is used.  sigma1 is
+   done in two halves since W[j+2] and W[j+3] depend on W[j] and W[j+1]. */
+#    define EXPAND_W4(X0,X1,X2,X3,T0,T1,T2,T3)					\
+	asm volatile (	"movdqa		 %4,%0\n\t"				\
+		"psrldq		 $4,%0\n\t"					\
+		"movdqa		 %5,%1\n\t"					\
+		"pslldq		 $12,%1\n\t"					\
+		"por		 %1,%0\n\t"					\
+		"movdqa		 %0,%1\n\t"					\
+		"psrld		 $7,%1\n\t"					\
+		"movdqa		 %0,%2\n\t"					\
+		"pslld		 $25,%2\n\t"					\
+		"por		 %2,%1\n\t"					\
+		"movdqa		 %0,%2\n\t"					\
+		"psrld		 $18,%2\n\t"					\
+		"movdqa		 %0,%3\n\t"					\
+		"pslld		 $14,%3\n\t"					\
+		"por		 %3,%2\n\t"					\
+		"pxor		 %2,%1\n\t"					\
+		"psrld		 $3,%0\n\t"					\
+		"pxor		 %0,%1\n\t"					\
+		"paddd		 %1,%4\n\t"					\
+		"movdqa		 %6,%0\n\t"					\
+		"psrldq		 $4,%0\n\t"					\
+		"movdqa		 %7,%1\n\t"					\
+		"pslldq		 $12,%1\n\t"					\
+		"por		 %1,%0\n\t"					\
+		"paddd		 %0,%4\n\t"					\
+		"movdqa		 %7,%0\n\t"					\
+		"psrldq		 $8,%0\n\t"					\
+		SIGMA1_ADD_X4("%4","%0","%1","%2","%3")				\
+		"movdqa		 %4,%0\n\t"					\
+		"pslldq		 $8,%0\n\t"					\
+		SIGMA1_ADD_X4("%4","%0","%1","%2","%3")				\
+		"pxor		 %0,%0\n\t"					\
+		"pxor		 %1,%1\n\t"					\
+		"pxor		 %2,%2\n\t"					\
+		"pxor		 %3,%3"						\
+		: "+x" (T0),							\
+		  "+x" (T1),							\
+		  "+x" (T2),							\
+		  "+x" (T3),							\
+		  "+x" (X0)							\
+		: "x" (X1),							\
+		  "x" (X2),							\
+		  "x" (X3));
+
+/* Blends byte 0 of TC into XMM where TBI matches the lane index in IDX. */
+#    define INSERT_BYTE_BLEND(XMM,IDX,TC,TBI,T0,T1)				\
+	"movdqa		 " IDX "," T0 "\n\t"					\
+	"pcmpeqb	 " TBI "," T0 "\n\t"					\
+	"movdqa		 " T0 "," T1 "\n\t"					\
+	"pand		 " TC "," T1 "\n\t"					\
+	"pandn		 " XMM "," T0 "\n\t"					\
+	"por		 " T1 "," T0 "\n\t"					\
+	"movdqa		 " T0 "," XMM "\n\t"
+
+/* W8[BI] = C for BI < 64 without a jump on BI.  C and BI are broadcast to
+   every byte and each of X0-X3 is blended under a pcmpeqb mask. */
+#    define INSERT_W_BYTE_BLEND(BI,C,X0,X1,X2,X3,T0,T1,T2,T3)			\
+	asm volatile (	"movd		 %k8,%4\n\t"				\
+		"punpcklbw	 %4,%4\n\t"					\
+		"punpcklwd	 %4,%4\n\t"					\
+		"pshufd		 $0,%4,%4\n\t"					\
+		"movd		 %k9,%5\n\t"					\
+		"punpcklbw	 %5,%5\n\t"					\
+		"punpcklwd	 %5,%5\n\t"					\
+		"pshufd		 $0,%5,%5\n\t"					\
+		INSERT_BYTE_BLEND("%0","%10","%4","%5","%6","%7")		\
+		INSERT_BYTE_BLEND("%1","%11","%4","%5","%6","%7")		\
+		INSERT_BYTE_BLEND("%2","%12","%4","%5","%6","%7")		\
+		INSERT_BYTE_BLEND("%3","%13","%4","%5","%6","%7")		\
+		"pxor		 %4,%4\n\t"					\
+		"pxor		 %5,%5\n\t"					\
+		"pxor		 %6,%6\n\t"					\
+		"pxor		 %7,%7"						\
+		: "+x" (X0),							\
+		  "+x" (X1),							\
+		  "+x" (X2),							\
+		  "+x" (X3),							\
+		  "+x" (T0),							\
+		  "+x" (T1),							\
+		  "+x" (T2),							\
+		  "+x" (T3)							\
+		: "r" (C),							\
+		  "r" (BI),							\
+		  "m" (insert_byte_index[0]),					\
+		  "m" (insert_byte_index[1]),					\
+		  "m" (insert_byte_index[2]),					\
+		  "m" (insert_byte_index[3]));
+
+/* Byte index of each lane of xmm0-xmm3 for INSERT_W_BYTE_BLEND. */
+u128 __attribute__((used)) insert_byte_index[4] = {
+	((u128)0x0f0e0d0c0b0a0908 << 64) | 0x0706050403020100,
+	((u128)0x1f1e1d1c1b1a1918 << 64) | 0x1716151413121110,
+	((u128)0x2f2e2d2c2b2a2928 << 64) | 0x2726252423222120,
+	((u128)0x3f3e3d3c3b3a3938 << 64) | 0x3736353433323130
+};
+
 u128 __attribute__((used)) mask0 = 0x00000000ffffffff;
 u128 __attribute__((used)) mask1 = 0xffffffff00000000;
 
 u32 get_a(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	GET_ACEG(w,mm0);
 	return w;
@@ -334,6 +459,7 @@ u32 get_a(void)
 
 void set_a(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_ACEG(w,mm0,gpr0,gpr1,mask1);
@@ -341,6 +467,7 @@ void set_a(u32 w)
 
 u32 get_c(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	GET_ACEG(w,mm1);
 	return w;
@@ -348,6 +475,7 @@ u32 get_c(void)
 
 void set_c(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_ACEG(w,mm1,gpr0,gpr1,mask1);
@@ -355,6 +483,7 @@ void set_c(u32 w)
 
 u32 get_e(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	GET_ACEG(w,mm2);
 	return w;
@@ -362,6 +491,7 @@ u32 get_e(void)
 
 void set_e(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_ACEG(w,mm2,gpr0,gpr1,mask1);
@@ -369,6 +499,7 @@ void set_e(u32 w)
 
 u32 get_g(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	GET_ACEG(w,mm3);
 	return w;
@@ -376,6 +507,7 @@ u32 get_g(void)
 
 void set_g(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_ACEG(w,mm3,gpr0,gpr1,mask1);
@@ -384,6 +516,7 @@ void set_g(u32 w)
 
 u32 get_b(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	register u32 gpr0 asm ("rdx");
 	GET_BDFH(w,mm0,gpr0);
@@ -392,6 +525,7 @@ u32 get_b(void)
 
 void set_b(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_BDFH(w,mm0,gpr0,gpr1,mask0);
@@ -400,6 +534,7 @@ void set_b(u32 w)
 
 u32 get_d(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	register u32 gpr0 asm ("rsi");
 	GET_BDFH(w,mm1,gpr0);
@@ -408,6 +543,7 @@ u32 get_d(void)
 
 void set_d(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_BDFH(w,mm1,gpr0,gpr1,mask0);
@@ -416,6 +552,7 @@ void set_d(u32 w)
 
 u32 get_f(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	register u32 gpr0 asm ("rsi");
 	GET_BDFH(w,mm2,gpr0);
@@ -424,6 +561,7 @@ u32 get_f(void)
 
 void set_f(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_BDFH(w,mm2,gpr0,gpr1,mask0);
@@ -431,6 +569,7 @@ void set_f(u32 w)
 
 u32 get_h(void)
 {
+	DECLARE_REGISTERS();
 	register u32 w asm ("eax");
 	register u32 gpr0 asm ("rsi");
 	GET_BDFH(w,mm3,gpr0);
@@ -439,22 +578,49 @@ u32 get_h(void)
 
 void set_h(u32 w)
 {
+	DECLARE_REGISTERS();
 	register u32 gpr0 asm ("rsi");
 	register u32 gpr1 asm ("rdx");
 	SET_BDFH(w,mm3,gpr0,gpr1,mask0);
 }
+
+#    ifdef W_ROLLING
+/* W8[bi] = c for message bytes.  Branch free unlike _insert_W_byte.
+   xmm4-xmm7 are free with the rolling window and are used as temps. */
+void insert_W_byte_blend(u32 bi, u32 c)
+{
+	DECLARE_REGISTERS();
+	INSERT_W_BYTE_BLEND(bi,c,xmm0,xmm1,xmm2,xmm3,xmm4,xmm5,xmm6,xmm7);
+}
+
+/* Expands W[wi..wi+3] in place.  wi must be a multiple of 4 and >= 16.
+   xmm4-xmm7 are free with the rolling window and are used as temps. */
+void expand_w4(u32 wi)
+{
+	DECLARE_REGISTERS();
+	switch (WI(wi) / 4)
+	{
+		case 0: EXPAND_W4(xmm0,xmm1,xmm2,xmm3,xmm4,xmm5,xmm6,xmm7); break;
+		case 1: EXPAND_W4(xmm1,xmm2,xmm3,xmm0,xmm4,xmm5,xmm6,xmm7); break;
+		case 2: EXPAND_W4(xmm2,xmm3,xmm0,xmm1,xmm4,xmm5,xmm6,xmm7); break;
+		case 3: EXPAND_W4(xmm3,xmm0,xmm1,xmm2,xmm4,xmm5,xmm6,xmm7); break;
+	}
+}
+#    endif // W_ROLLING
 #  endif // USE_ASM
 
 #  if defined(DEBUG) && defined(USE_ASM)
+/* printf clobbers the xmm and mm registers, so fxsave keeps W and a-h.  The
+   GPRs are not live across it. */
 #    define debug_printf(format, ...)						\
 	do {									\
 		u8 __attribute__ ((aligned (16))) da[512];			\
-		PUSHAGPR64();							\
 		_fxsave64(da);							\
 		printf(format, ##__VA_ARGS__);					\
 		_fxrstor64(da);							\
-		POPAGPR64();							\
 	} while(0)
+#  elif defined(USE_ASM)
+#    define debug_printf(format, ...)
 #  endif // DEBUG
 
 #endif // ALG_PLAIN
@@ -28,8 +28,17 @@
 
 #define MESSAGE_SIZE_BYTES 64
 #define MESSAGE_SIZE_WORDS MESSAGE_SIZE_BYTES/4
-#define W_SIZE_WORDS 64 /* 48 message expansion words + 16 message words */
+/* By default W is a rolling window of 16 words and W[j] is computed in
+   place over W[j-16] just before round j.  Define USE_FULL_W to keep all
+   64 expanded words live instead. */
+#ifdef USE_FULL_W
+#  define W_SIZE_WORDS 64 /* 48 message expansion words + 16 message words */
+#else
+#  define W_ROLLING
+#  define W_SIZE_WORDS 16 /* 16 message words reused by the expansion */
+#endif
 #define W_SIZE_BYTES W_SIZE_WORDS*4
+#define WI(j) ((j) & (W_SIZE_WORDS - 1))
 #define DIGEST_SIZE_BITS 256
 #define DIGEST_SIZE_BYTES DIGEST_SIZE_BITS/8
 #define DIGEST_SIZE_WORDS DIGEST_SIZE_BITS/8/4
@@ -91,6 +100,10 @@ struct tsha256 {
 
 #ifdef ALG_PLAIN
 #  ifndef USE_ASM
+	/* Set by tsha256hp_init_with_length */
+	u64 total_msglen;
+	u32 has_total_msglen;
+
 	u32 A[N_LETTERS];
 	u8 W8[W_SIZE_BYTES];
 	u32 sig0, sig1;
@@ -100,7 +113,7 @@ struct tsha256 {
 };
 
 #ifdef ALG_PLAIN
-u32 H_0[] = {
+static u32 H_0[] = {
 	0x6a09e667,
 	0xbb67ae85,
 	0x3c6ef372,
@@ -114,7 +127,7 @@ u32 H_0[] = {
 /* Faster than byteswap because of loop overhead and duplicate loops */
 /* char[0] MSB when printing le u64 */
 /* char[7] LSB when printing le u64 */
-u32 seq[] = {
+static u32 seq[] = {
 	3,  2,   1,  0,
 	7,  6,   5,  4,
 	11, 10,  9,  8,
@@ -134,7 +147,7 @@ u32 seq[] = {
 };
 /* End of sub-array index position: 56 57 58 59 60 61 62 63 */
 /* 63 is lsb and 56 is msb */
-u32 seq2[] = {
+static u32 seq2[] = {
 	60, 61, 62, 63, /* 63 is lsb.  60 is mid. */
 	56, 57, 58, 59  /* 59 is mid.  56 is msb. */
 };
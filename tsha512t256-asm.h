@@ -36,6 +36,8 @@ asmlinkage s32 tsha512t256a_reset(struct tsha512 *state);
 asmlinkage s32 tsha512t256a_close(struct tsha512 *state);
 asmlinkage s32 tsha512t256a_getch(struct tsha512 *state, u8 c);
 asmlinkage u64* tsha512t256a_get_hashcode(struct tsha512 *state);
+asmlinkage s64 tsha512t256a_write_blocks(struct tsha512 *state, const u8 *buf,
+	u64 nblocks);
 #endif // ALG_ASM
 
 #endif // TSHA512T256_ASM
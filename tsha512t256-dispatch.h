@@ -0,0 +1,115 @@
+/*
+ * tsha512/256 - A register only implementation for SHA2-512/256
+ *
+ * Copyright (c) 2021-2022 Orson Teodoro <orsonteodoro@hotmail.com>.  All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Run time CPU dispatch for the assembly module */
+
+#ifndef TSHA512T256_DISPATCH
+#define TSHA512T256_DISPATCH
+
+/*
+   tsha512t256a.S is assembled with -DTSHA512T256A_SUFFIX=avx2 and the
+   tsha512t256_* entry points are GNU ifuncs resolved once at load time.
+   There is only the AVX2 kernel.  On older CPUs the entry points are bound
+   to stubs that return -ENOTSUP instead of faulting on the first vpbroadcastb.
+*/
+
+#define TSHA512T256_KERNEL_NONE	0
+#define TSHA512T256_KERNEL_AVX2	1
+
+static int tsha512t256_probe_cpu(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return TSHA512T256_KERNEL_AVX2;
+	return TSHA512T256_KERNEL_NONE;
+}
+
+static s32 tsha512t256_unsupported_update(struct tsha512 *state, u32 finish)
+{
+	return -ENOTSUP;
+}
+
+static s32 tsha512t256_unsupported_reset(struct tsha512 *state)
+{
+	return -ENOTSUP;
+}
+
+static s32 tsha512t256_unsupported_close(struct tsha512 *state)
+{
+	return -ENOTSUP;
+}
+
+static s32 tsha512t256_unsupported_getch(struct tsha512 *state, u8 c)
+{
+	return -ENOTSUP;
+}
+
+static u64* tsha512t256_unsupported_get_hashcode(struct tsha512 *state)
+{
+	return NULL;
+}
+
+static s64 tsha512t256_unsupported_write_blocks(struct tsha512 *state,
+	const u8 *buf, u64 nblocks)
+{
+	return -ENOTSUP;
+}
+
+#define TSHA512T256_IFUNC(RET,NAME,ARGS)					\
+	asmlinkage RET tsha512t256a_##NAME##_avx2 ARGS;				\
+	static RET (*tsha512t256_resolve_##NAME(void)) ARGS			\
+	{									\
+		if (tsha512t256_probe_cpu() == TSHA512T256_KERNEL_AVX2)		\
+			return tsha512t256a_##NAME##_avx2;			\
+		return tsha512t256_unsupported_##NAME;				\
+	}									\
+	RET tsha512t256_##NAME ARGS						\
+		__attribute__((ifunc("tsha512t256_resolve_" #NAME)));
+
+TSHA512T256_IFUNC(s32, update, (struct tsha512 *state, u32 finish))
+TSHA512T256_IFUNC(s32, reset, (struct tsha512 *state))
+TSHA512T256_IFUNC(s32, close, (struct tsha512 *state))
+TSHA512T256_IFUNC(s32, getch, (struct tsha512 *state, u8 c))
+TSHA512T256_IFUNC(u64*, get_hashcode, (struct tsha512 *state))
+TSHA512T256_IFUNC(s64, write_blocks, (struct tsha512 *state, const u8 *buf,
+	u64 nblocks))
+
+/* Name of the kernel the ifuncs were bound to. */
+static inline const char *tsha512t256_kernel_name(void)
+{
+	if (tsha512t256_probe_cpu() == TSHA512T256_KERNEL_AVX2)
+		return "avx2";
+	return "none";
+}
+
+/* Route callers written against the assembly module to the ifuncs. */
+#define tsha512t256a_update tsha512t256_update
+#define tsha512t256a_reset tsha512t256_reset
+#define tsha512t256a_close tsha512t256_close
+#define tsha512t256a_getch tsha512t256_getch
+#define tsha512t256a_get_hashcode tsha512t256_get_hashcode
+#define tsha512t256a_write_blocks tsha512t256_write_blocks
+
+#endif // TSHA512T256_DISPATCH
@@ -31,7 +31,7 @@
 #if defined (HAVE_SSE2)
 #  define GET_WR(W,XMM)								\
 	asm (	"movq            %1,%q0"					\
-		: "=r" (W),							\
+		: "=r" (W)							\
 		: "x" (XMM));
 
 #  define GET_WL(W,XMM,TXMM)							\
@@ -46,7 +46,7 @@
 	asm (	"movd		%k2,%1\n\t"					\
 		"pslldq		%3,%1\n\t"					\
 		"pxor		%1,%0"						\
-		: "=x" (XMM),							\
+		: "+x" (XMM),							\
 		  "+x" (TXMM)							\
 		: "r" (C),							\
 		  "i" (CI));
@@ -37,13 +37,13 @@
 
 #  define INSERT_BYTE(CI,C,XMM)						\
 	asm (	"pinsrb		%2,%k1,%0"					\
-		: "=x" (XMM)							\
-		: "r" (C)							\
-		: "i" (CI)
+		: "+x" (XMM)							\
+		: "r" (C),							\
+		  "i" (CI));
 
 #  define SET_W(W,CI,XMM)							\
 	asm (	"pinsrq          %2,%q1,%0"					\
-		: "=x" (XMM)							\
+		: "+x" (XMM)							\
 		: "r" (W),							\
 		  "i" (CI));
 
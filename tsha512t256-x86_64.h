@@ -227,7 +227,7 @@ register u64 r15 asm ("r15");
 
 #    define ROTRQ(V,AMT)							\
 	asm(	"rorq		%q1,%q0"					\
-		: "=r" (V)							\
+		: "+r" (V)							\
 		: "i"  (AMT));
 
 #    define SET_XMM(XMM,I32_3,I32_2,I32_1,I32_0,TXMM,GPR)			\
@@ -247,7 +247,7 @@ register u64 r15 asm ("r15");
 		"movd		 %q6,%1\n\t"					\
 		"pslldq		 $4,%0\n\t"					\
 		"pxor		 %1,%0"						\
-		: "=x" (XMM),							\
+		: "+x" (XMM),							\
 		  "+x" (TXMM)							\
 		: "ir" (I32_3),							\
 		  "ir" (I32_2),							\
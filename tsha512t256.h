@@ -27,8 +27,9 @@
 #define MAIN_TSHA512T256
 
 //#define USE_ASM
+#ifndef ALG_ASM
 #define ALG_PLAIN
-//#define ALG_ASM
+#endif
 
 #define MESSAGE_SIZE_BYTES 128
 #define MESSAGE_SIZE_WORDS MESSAGE_SIZE_BYTES/8
@@ -65,7 +66,7 @@ typedef unsigned __int128 u128;
 
 #ifdef ALG_PLAIN
 
-u64 K[80] = {
+static u64 K[80] = {
 	0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
 	0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
 	0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
@@ -87,7 +88,7 @@ u64 K[80] = {
 	0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
 	0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817 };
 
-u64 H_0[] = {
+static u64 H_0[] = {
 	0x22312194fc2bf72c,
 	0x9f555fa3c84c64c2,
 	0x2393b86b6f53b151,
@@ -101,7 +102,7 @@ u64 H_0[] = {
 /* Faster than byteswap because of loop overhead and duplicate loops */
 /* char[0] MSB when printing le u64 */
 /* char[7] LSB when printing le u64 */
-u64 seq[] = {
+static u64 seq[] = {
 	 7,  6,  5,  4,  3,  2,  1,  0,
 	15, 14, 13, 12, 11, 10,  9,  8,
 	23, 22, 21, 20, 19, 18, 17, 16,
@@ -121,7 +122,7 @@ u64 seq[] = {
 };
 /* End of sub-array index position: 56 57 58 59 60 61 62 63 */
 /* 63 is lsb and 56 is msb */
-u64 seq2[] = {
+static u64 seq2[] = {
 	120, 121, 122, 123, 124, 125, 126, 127,   /* 127 is msb, 120 is mid */
 	112, 113, 114, 115, 116, 117, 118, 119   /* 119 is mid. 112 is msb */
 };
@@ -131,7 +132,7 @@ u64 seq2[] = {
 
 /* For OOP */
 struct tsha512 {
-	u64 __attribute__ ((aligned (16))) digest[N_LETTERS*WORD_SIZE_BYTES];
+	u64 __attribute__ ((aligned (16))) digest[N_LETTERS];
 	u64 msglen;
 	u64 i_message;
 	u32 event;